@@ -3,11 +3,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "../pacing.h"
+
 #define TBUF_SZ 64
 char tbuf[TBUF_SZ];
 
 uint16_t winw = 800, winh = 800, frame = 0;
 
+/* Frame pacing, picked on the command line with -uncapped (the default),
+   -fps N or -ondemand. */
+frame_pacer pacer;
+
 void display(void);
 void idle(void);
 void resize(int, int);
@@ -16,6 +22,9 @@ void timer(int);
 int main(int argc, char **argv)
 {
 	glutInit(&argc, argv);
+	frame_pacer_init(&pacer, PACING_UNCAPPED, 60);
+	if (!frame_pacer_parse_args(&pacer, argc, argv))
+		return EXIT_FAILURE;
 	glutInitContextVersion(4, 0);
 	glutInitContextFlags(GLUT_FORWARD_COMPATIBLE);
 	glutInitContextProfile(GLUT_CORE_PROFILE);
@@ -29,7 +38,8 @@ int main(int argc, char **argv)
 	}
 	glClearColor(0.0f, 0.0f, 1.0f, 1.0f);
 	glutDisplayFunc(display);
-	glutIdleFunc(idle);
+	if (pacer.mode != PACING_ON_DEMAND)
+		glutIdleFunc(idle);
 	glutReshapeFunc(resize);
 	glutTimerFunc(0, timer, 0);
 	GLenum result = glewInit();
@@ -47,12 +57,12 @@ void display(void)
 	frame++;
 	glClear(GL_COLOR_BUFFER_BIT);
 	glutSwapBuffers();
-	glutPostRedisplay();
 }
 
 void idle(void)
 {
-	glutPostRedisplay();
+	if (frame_pacer_poll(&pacer))
+		glutPostRedisplay();
 }
 
 void resize(int neww, int newh)
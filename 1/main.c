@@ -3,6 +3,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "../pacing.h"
+
 GLuint fshaderid, vshaderid, programid, vao, vbo, cbo;
 
 const GLchar *fshader = {
@@ -36,6 +38,10 @@ char tbuf[TBUF_SZ];
 
 uint16_t winw = 800, winh = 800, frame = 0;
 
+/* Frame pacing, picked on the command line with -uncapped (the default),
+   -fps N or -ondemand. */
+frame_pacer pacer;
+
 void createshaders(void);
 void createvbo(void);
 void display(void);
@@ -46,6 +52,9 @@ void timer(int);
 int main(int argc, char **argv)
 {
 	glutInit(&argc, argv);
+	frame_pacer_init(&pacer, PACING_UNCAPPED, 60);
+	if (!frame_pacer_parse_args(&pacer, argc, argv))
+		return EXIT_FAILURE;
 	glutInitContextVersion(4, 0);
 	glutInitContextFlags(GLUT_FORWARD_COMPATIBLE);
 	glutInitContextProfile(GLUT_CORE_PROFILE);
@@ -66,7 +75,8 @@ int main(int argc, char **argv)
 	createvbo();
 	glClearColor(0.0f, 0.0f, 1.0f, 1.0f);
 	glutDisplayFunc(display);
-	glutIdleFunc(idle);
+	if (pacer.mode != PACING_ON_DEMAND)
+		glutIdleFunc(idle);
 	glutReshapeFunc(resize);
 	glutTimerFunc(0, timer, 0);
 	fprintf(stdout, "INFO: OpenGL Version: %s\n", glGetString(GL_VERSION));
@@ -123,12 +133,12 @@ void display(void)
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glDrawArrays(GL_TRIANGLES, 0, 3);
 	glutSwapBuffers();
-	glutPostRedisplay();
 }
 
 void idle(void)
 {
-	glutPostRedisplay();
+	if (frame_pacer_poll(&pacer))
+		glutPostRedisplay();
 }
 
 void resize(int neww, int newh)
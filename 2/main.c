@@ -4,6 +4,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "../pacing.h"
+
 GLuint fshaderid, vshaderid, programid, vao, vbo, cbo;
 
 float angle;
@@ -48,6 +50,11 @@ char tbuf[TBUF_SZ];
 
 uint16_t winw = 800, winh = 800, frame = 0;
 
+/* Frame pacing, picked on the command line with -uncapped (the default),
+   -fps N or -ondemand. */
+frame_pacer pacer;
+
+void animate(int);
 void createshaders(void);
 void createvbo(void);
 void display(void);
@@ -58,6 +65,9 @@ void timer(int);
 int main(int argc, char **argv)
 {
 	glutInit(&argc, argv);
+	frame_pacer_init(&pacer, PACING_UNCAPPED, 60);
+	if (!frame_pacer_parse_args(&pacer, argc, argv))
+		return EXIT_FAILURE;
 	glutInitContextVersion(4, 0);
 	glutInitContextFlags(GLUT_FORWARD_COMPATIBLE);
 	glutInitContextProfile(GLUT_CORE_PROFILE);
@@ -78,7 +88,10 @@ int main(int argc, char **argv)
 	createvbo();
 	glClearColor(0.0f, 0.0f, 1.0f, 1.0f);
 	glutDisplayFunc(display);
-	glutIdleFunc(idle);
+	if (pacer.mode != PACING_ON_DEMAND)
+		glutIdleFunc(idle);
+	else
+		glutTimerFunc(1000 / pacer.target_fps, animate, 0);
 	glutReshapeFunc(resize);
 	glutTimerFunc(0, timer, 0);
 	fprintf(stdout, "INFO: OpenGL Version: %s\n", glGetString(GL_VERSION));
@@ -86,6 +99,16 @@ int main(int argc, char **argv)
 	return EXIT_SUCCESS;
 }
 
+/* Redraws the rotating triangle when frames are only drawn on demand. It never
+   stops rotating, so that is every frame at the target framerate. Only main
+   and animate itself start the timer, so however often the window is
+   redrawn there is one. */
+void animate(int x)
+{
+	glutPostRedisplay();
+	glutTimerFunc(1000 / pacer.target_fps, animate, 0);
+}
+
 void createshaders(void)
 {
 	vshaderid = glCreateShader(GL_VERTEX_SHADER);
@@ -144,12 +167,12 @@ void display(void)
 		rotY);
 	glDrawArrays(GL_TRIANGLES, 0, 3);
 	glutSwapBuffers();
-	glutPostRedisplay();
 }
 
 void idle(void)
 {
-	glutPostRedisplay();
+	if (frame_pacer_poll(&pacer))
+		glutPostRedisplay();
 }
 
 void resize(int neww, int newh)
@@ -4,6 +4,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "../gl_state.h"
+#include "../gpu_memory.h"
+#include "../indexed_mesh.h"
+#include "../meshopt.h"
+#include "../pacing.h"
+
 const float step = 0.04;
 
 /* camera angle (Y) and pos. */
@@ -27,6 +33,9 @@ static const double PI = 3.14159265358979323846;
 
 GLuint fshaderid, vshaderid, programid, vao, vbo, ibo;
 
+/* The cube's indices, packed as small as they go. */
+indexed_mesh *cube;
+
 float angle;
 
 float pers[] = {
@@ -106,6 +115,10 @@ char tbuf[TBUF_SZ];
 
 uint16_t winw = 800, winh = 800, frame = 0;
 
+/* Frame pacing, picked on the command line with -uncapped (the default),
+   -fps N or -ondemand. */
+frame_pacer pacer;
+
 void createshaders(void);
 void createvbo(void);
 void display(void);
@@ -117,6 +130,9 @@ void timer(int);
 int main(int argc, char **argv)
 {
 	glutInit(&argc, argv);
+	frame_pacer_init(&pacer, PACING_UNCAPPED, 60);
+	if (!frame_pacer_parse_args(&pacer, argc, argv))
+		return EXIT_FAILURE;
 	glutInitContextVersion(4, 0);
 	glutInitContextFlags(GLUT_FORWARD_COMPATIBLE);
 	glutInitContextProfile(GLUT_CORE_PROFILE);
@@ -142,7 +158,8 @@ int main(int argc, char **argv)
 	glCullFace(GL_BACK);
 	glFrontFace(GL_CCW);
 	glutDisplayFunc(display);
-	glutIdleFunc(idle);
+	if (pacer.mode != PACING_ON_DEMAND)
+		glutIdleFunc(idle);
 	glutKeyboardFunc(keyboard);
 	glutReshapeFunc(resize);
 	glutTimerFunc(0, timer, 0);
@@ -163,12 +180,12 @@ void createshaders(void)
 	glAttachShader(programid, vshaderid);
 	glAttachShader(programid, fshaderid);
 	glLinkProgram(programid);
-	glUseProgram(programid);
+	gl_state_use_program(programid);
 }
 
 void createvbo(void)
 {
-	const float vertices[64] = {
+	float vertices[64] = {
 		-.5f, -.5f, -0.5f, 1,  0, 0, 1, 1,
 		-.5f, .5f, -0.5f, 1,   1, 0, 0, 1,
 		.5f, .5f, -0.5f, 1,    0, 1, 0, 1,
@@ -178,7 +195,7 @@ void createvbo(void)
 		.5f, .5f, 0.5f, 1,   1, 0, 1, 1,
 		.5f, -.5f, 0.5f, 1,  0, 0, 1, 1  
 	};
-	const GLuint indices[36] = {
+	GLuint indices[36] = {
 		0,2,1, 0,3,2,
 		4,3,0, 4,7,3,
 		4,1,5, 4,0,1,
@@ -186,22 +203,38 @@ void createvbo(void)
 		1,6,5, 1,2,6,
 		7,5,6, 7,4,5
 	};
+	float acmr = meshopt_acmr(indices, 36, MESHOPT_ACMR_CACHE_SIZE);
+	meshopt_optimize_vertex_cache(indices, 36, 8);
+	meshopt_optimize_vertex_fetch(vertices, 8 * sizeof(float), 8, indices,
+		36);
+	fprintf(stdout, "INFO: ACMR %.3f before reordering, %.3f after\n", acmr,
+		meshopt_acmr(indices, 36, MESHOPT_ACMR_CACHE_SIZE));
+	cube = indexed_mesh_new(indices, 36);
+	if (!cube) {
+		fprintf(stderr, "ERROR: Out of memory.\n");
+		exit(EXIT_FAILURE);
+	}
 	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	gl_state_bind_vertex_array(vao);
 	glEnableVertexAttribArray(0);
 	glEnableVertexAttribArray(1);
-	glGenBuffers(1, &vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof vertices, vertices,
-		GL_STATIC_DRAW);
+	vbo = gpu_memory_buffer_new(GPU_MEMORY_MESH, GL_ARRAY_BUFFER,
+		sizeof vertices, vertices, GL_STATIC_DRAW);
+	ibo = gpu_memory_buffer_new(GPU_MEMORY_INDEX, GL_ELEMENT_ARRAY_BUFFER,
+		indexed_mesh_size(cube), cube->indices, GL_STATIC_DRAW);
+	if (!vbo || !ibo) {
+		fprintf(stderr, "ERROR: Out of memory.\n");
+		exit(EXIT_FAILURE);
+	}
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, vbo);
 	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(GL_FLOAT),
 		0);
 	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(GL_FLOAT),
 		(GLvoid *) (4 * sizeof(GL_FLOAT)));
-	glGenBuffers(1, &ibo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof indices, indices,
-		GL_STATIC_DRAW);
+	gpu_memory_stats memory = gpu_memory_get_stats();
+	fprintf(stdout, "INFO: %lu bytes of vertices, %lu bytes of indices\n",
+		(unsigned long) memory.current[GPU_MEMORY_MESH],
+		(unsigned long) memory.current[GPU_MEMORY_INDEX]);
 }
 
 void display(void)
@@ -219,43 +252,37 @@ void display(void)
 	camtranso[12] = -cx;
 	camtranso[13] = -cy;
 	camtranso[14] = -cz;
-	glUniformMatrix4fv(glGetUniformLocation(programid, "camtranso"), 1,
-		GL_FALSE, camtranso);
+	gl_state_uniform_matrix4fv(programid, "camtranso", GL_FALSE, camtranso);
 
 	camtransb[12] = cx;
 	camtransb[13] = cy;
 	camtransb[14] = cz;
-	glUniformMatrix4fv(glGetUniformLocation(programid, "camtransb"), 1,
-		GL_FALSE, camtransb);
+	gl_state_uniform_matrix4fv(programid, "camtransb", GL_FALSE, camtransb);
 
-	glUniformMatrix4fv(glGetUniformLocation(programid, "trans"), 1, GL_FALSE,
-		trans);
-	glUniformMatrix4fv(glGetUniformLocation(programid, "rotY"), 1, GL_FALSE,
-		rotY);
+	gl_state_uniform_matrix4fv(programid, "trans", GL_FALSE, trans);
+	gl_state_uniform_matrix4fv(programid, "rotY", GL_FALSE, rotY);
 	if (cangley > 180)
 		cangley = 0;
 	viewY[0] = (float) cos(cangley);
 	viewY[8] = (float) sin(cangley);
 	viewY[2] = (float) -sin(cangley);
 	viewY[10] = (float) cos(cangley);
-	glUniformMatrix4fv(glGetUniformLocation(programid, "viewY"), 1, GL_FALSE,
-		viewY);
+	gl_state_uniform_matrix4fv(programid, "viewY", GL_FALSE, viewY);
 
 	viewX[5] = (float) cos(canglex);
 	viewX[6] = (float) -sin(canglex);
 	viewX[9] = (float) sin(canglex);
 	viewX[10] = (float) cos(canglex);
-	glUniformMatrix4fv(glGetUniformLocation(programid, "viewX"), 1, GL_FALSE,
-		viewX);
+	gl_state_uniform_matrix4fv(programid, "viewX", GL_FALSE, viewX);
 
-	glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+	indexed_mesh_draw(cube);
 	glutSwapBuffers();
-	glutPostRedisplay();
 }
 
 void idle(void)
 {
-	glutPostRedisplay();
+	if (frame_pacer_poll(&pacer))
+		glutPostRedisplay();
 }
 
 void keyboard(unsigned char key, int x, int y)
@@ -311,13 +338,10 @@ void resize(int neww, int newh)
 	pers[11] = -1;
 	pers[14] = -((2 * near * far) / (far - near));
 
-	glUniformMatrix4fv(glGetUniformLocation(programid, "pers"), 1, GL_FALSE,
-		pers);
+	gl_state_uniform_matrix4fv(programid, "pers", GL_FALSE, pers);
 
-	glUniformMatrix4fv(glGetUniformLocation(programid, "viewX"), 1, GL_FALSE,
-		viewX);
-	glUniformMatrix4fv(glGetUniformLocation(programid, "viewY"), 1, GL_FALSE,
-		viewY);
+	gl_state_uniform_matrix4fv(programid, "viewX", GL_FALSE, viewX);
+	gl_state_uniform_matrix4fv(programid, "viewY", GL_FALSE, viewY);
 }
 
 void timer(int x)
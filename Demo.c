@@ -1,29 +1,133 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
-#include <assert.h>
 #include <inttypes.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-
-#include "sc_mat4f.h"
+#include <string.h>
+
+#include "command_buffer.h"
+#include "gl_state.h"
+#include "gpu_memory.h"
+#include "gpu_mesher.h"
+#include "light.h"
+#include "mesher.h"
+#include "pacing.h"
+#include "palette.h"
+#include "raycast.h"
+#include "raymarch.h"
+#include "render_queue.h"
+#include "render_thread.h"
+#include "resolution.h"
+#include "parallel.h"
 #include "sc_vecf.h"
-#include "sc_vec4f.h"
+#include "shader.h"
+#include "simulation.h"
+#include "terrain.h"
+#include "timing.h"
+#include "upload.h"
+#include "visibility.h"
+#include "voxel.h"
 
 //#define DEBUG
 
+#ifdef DEBUG
+/* Palette entries past the voxel materials, for the points and axes. */
+#define DEBUG_WHITE 252
+#define DEBUG_YELLOW 253
+#define DEBUG_BLUE 254
+#define DEBUG_RED 255
+#endif
+
 #define RAD(x) (x * 0.0174532925)
 
+/* Define a three-dimensional grid of uniformly-spaced points (voxels). */
+#define NUM_VOXELS_X 100
+#define NUM_VOXELS_Y 100
+#define NUM_VOXELS_Z 100
+
+/* Simulation ticks per second. */
+#define SIMULATION_TICK_RATE 120.0
+
+/* Terrain seed unless --seed says otherwise. */
+#define DEFAULT_SEED 1
+
+/* Mesh bytes uploaded per frame unless --upload-budget says otherwise. */
+#define DEFAULT_UPLOAD_BUDGET (4 * 1024 * 1024)
+
+/* Chunks that lost their meshes to --memory-budget handed to the remesher at once, at most. */
+#define REMESHES_PER_FRAME 16
+
+/* Frames drawn per renderer and grid size by --benchmark-renderers. */
+#define BENCHMARK_FRAMES 60
+
+/*
+ * How --wireframe draws the meshes, and the value of the mesh shaders'
+ * wireframe uniform. WIREFRAME_LINES rasterises the triangles' edges with
+ * GL_LINE polygon mode and keeps every fragment, which is also how
+ * everything else drawn with the mesh programs is drawn. The others fill
+ * the triangles and keep only the fragments within half a pixel of an
+ * edge, a line a pixel wide between the triangles on either side, found
+ * from barycentric coordinates, so each triangle is one primitive
+ * instead of three lines. WIREFRAME_HIDDEN paints the rest of each triangle
+ * in the background colour instead of discarding it, so the depth test
+ * takes out the lines behind the surfaces.
+ */
+typedef enum
+{
+	WIREFRAME_LINES,
+	WIREFRAME_BARYCENTRIC,
+	WIREFRAME_HIDDEN
+} wireframe_mode;
+
+/*
+ * Shared by the mesh vertex shaders: each triangle's corners, from its
+ * vertices' order in the draw, as barycentric coordinates for the fragment
+ * shader to find the edges with. They are interpolated in screen space, so
+ * their rate of change is the same all along an edge and lines keep the
+ * same width however steeply they are seen.
+ */
+#define BARYCENTRIC_SOURCE \
+"noperspective out vec3 barycentric;\n"\
+"void set_barycentric(void)\n"\
+"{\n"\
+"	barycentric = vec3(equal(ivec3(gl_VertexID % 3), ivec3(0, 1, 2)));\n"\
+"}\n"
+
+/*
+ * Shared by the mesh shaders: how bright a light.h light byte makes a face.
+ * Sunlight and block light count the same, the brighter of the two, and
+ * each level is a fifth dimmer than the one above. Alpha is left alone.
+ */
+#define BRIGHTNESS_SOURCE \
+"vec4 brightness(uint light)\n"\
+"{\n"\
+"	float level = float(max(light >> 4, light & 15u));\n"\
+"	return vec4(vec3(pow(0.8, 15.0 - level)), 1.0);\n"\
+"}\n"
+
 static const GLchar *fragment_shader_source =
 {
 "#version 130\n"\
 
 "in vec4 out_colour;\n"\
+"noperspective in vec3 barycentric;\n"\
+
+"uniform int wireframe;\n"\
 
 "void main(void)\n"\
 "{\n"\
+"	vec3 pixels_to_edges = barycentric / fwidth(barycentric);\n"\
+"	if (wireframe != 0 && min(min(pixels_to_edges.x, pixels_to_edges.y), pixels_to_edges.z) >= 0.5) {\n"\
+"		if (wireframe == 1)\n"\
+"			discard;\n"\
+"		gl_FragColor = vec4(0.0, 0.0, 0.0, 1.0);\n"\
+"		return;\n"\
+"	}\n"\
 "	gl_FragColor = out_colour;\n"\
 "}\n"\
 };
@@ -32,26 +136,1034 @@ static const GLchar *vertex_shader_source =
 {
 "#version 130\n"\
 
-"in vec4 in_colour;\n"\
-"in vec4 position;\n"\
+"in uint material;\n"\
+"in uint light;\n"\
+"in uint occlusion;\n"\
+"in vec3 position;\n"\
+"out vec4 out_colour;\n"\
+
+"uniform sampler1D palette;\n"\
+
+"uniform vec3 chunk_offset;\n"\
+"uniform mat4 camera_x_rotation_matrix;\n"\
+"uniform mat4 camera_y_rotation_matrix;\n"\
+"uniform mat4 perspective_matrix;\n"\
+
+BRIGHTNESS_SOURCE
+BARYCENTRIC_SOURCE
+
+"void main(void)\n"\
+"{\n"\
+"	mat4 view_matrix = camera_x_rotation_matrix * camera_y_rotation_matrix;\n"\
+"	gl_Position = (perspective_matrix * view_matrix) * vec4(position + chunk_offset, 1.0);\n"\
+"	set_barycentric();\n"\
+"	float shade = 0.55 + 0.15 * float(occlusion);\n"\
+"	out_colour = texelFetch(palette, int(material), 0) * brightness(light) * vec4(vec3(shade), 1.0);\n"\
+"}\n"\
+};
+
+/*
+ * Both mesh shaders take positions relative to the chunk and chunk_offset,
+ * the chunk's origin minus the camera's position, worked out in double
+ * precision on the CPU. So the view has no translation, and whatever gets
+ * rounded to a float is small near the camera, where precision shows.
+ */
+
+/*
+ * For --vertex-pulling: there are no attributes, only a storage buffer of
+ * mesher.h's face records. Each face is drawn as six vertices, and the
+ * shader finds its record and corner from gl_VertexID. The corners are in
+ * mesher.c's order, so the triangles are the same as the other shader's.
+ */
+static const GLchar *pulled_vertex_shader_source =
+{
+"#version 430\n"\
+
+"layout(std430, binding = 0) readonly buffer Faces { uint faces[]; };\n"\
 "out vec4 out_colour;\n"\
 
-"uniform mat4 camera_translation_matrix;\n"\
+"uniform vec3 chunk_offset;\n"\
+"uniform sampler1D palette;\n"\
 "uniform mat4 camera_x_rotation_matrix;\n"\
 "uniform mat4 camera_y_rotation_matrix;\n"\
 "uniform mat4 perspective_matrix;\n"\
 
+"const vec2 corners[6] = vec2[](vec2(-0.5, 0.5), vec2(0.5, 0.5), vec2(0.5, -0.5),\n"\
+"	vec2(0.5, -0.5), vec2(-0.5, -0.5), vec2(-0.5, 0.5));\n"\
+
+BRIGHTNESS_SOURCE
+BARYCENTRIC_SOURCE
+
 "void main(void)\n"\
 "{\n"\
-"	mat4 view_matrix = camera_x_rotation_matrix * camera_y_rotation_matrix * camera_translation_matrix;\n"\
-"	gl_Position = (perspective_matrix * view_matrix) * position;\n"\
-"	out_colour = in_colour;\n"\
+"	uint face = faces[gl_VertexID / 6];\n"\
+"	vec3 voxel = vec3(face & 15u, (face >> 4) & 15u, (face >> 8) & 15u) + 0.5;\n"\
+"	uint direction = (face >> 12) & 7u;\n"\
+"	float offset = direction < 3u ? -0.5 : 0.5;\n"\
+"	vec2 corner = corners[gl_VertexID % 6];\n"\
+
+"	vec3 position;\n"\
+"	if (direction % 3u == 0u)\n"\
+"		position = vec3(offset, corner);\n"\
+"	else if (direction % 3u == 1u)\n"\
+"		position = vec3(corner.x, offset, corner.y);\n"\
+"	else\n"\
+"		position = vec3(corner, offset);\n"\
+
+"	mat4 view_matrix = camera_x_rotation_matrix * camera_y_rotation_matrix;\n"\
+"	gl_Position = (perspective_matrix * view_matrix) * vec4(voxel + position + chunk_offset, 1.0);\n"\
+"	set_barycentric();\n"\
+"	out_colour = texelFetch(palette, int((face >> 16) & 255u), 0) * brightness(face >> 24);\n"\
 "}\n"\
 };
 
-int32_t main(int32_t num_args, uint8_t args)
+/*
+ * The CPU-only part of startup. It runs on its own thread (fanning out to the
+ * workers in parallel.c) while the main thread creates the OpenGL context and
+ * compiles the shaders. Each chunk mesh goes to the upload queue as soon as it
+ * is built, and the render thread streams them in between frames. With
+ * --mesher=gpu or --renderer=raymarch only the voxels are made here and the
+ * render thread takes them from there.
+ */
+struct world_loader
+{
+	voxel_grid *grid;
+	voxel_light *light;	/* NULL if the meshes are fully lit. */
+	chunk_visibility *visibility;	/* NULL without --cave-culling=on and the CPU mesher. */
+	int32_t solid, gpu_meshing, raymarch, pulled;
+	terrain_params terrain;
+	upload_queue *uploads;
+	timing_phase generation_phase, lighting_phase, meshing_phase;
+	atomic_int done, failed;
+};
+
+/* Mesh chunk as the loader is set up to. Returns NULL, and flags the loader as failed, if out of memory. */
+static chunk_mesh *build_chunk_mesh(struct world_loader *loader, uint32_t chunk)
+{
+	chunk_mesh *mesh = chunk_mesh_new();
+	if (!mesh) {
+		atomic_store(&loader->failed, 1);
+		return NULL;
+	}
+
+	int32_t cx, cy, cz;
+	voxel_grid_chunk_coords(loader->grid, chunk, &cx, &cy, &cz);
+	if (loader->pulled)
+		mesher_mesh_chunk_faces(loader->grid, loader->light, cx, cy, cz, mesh);
+	else
+		mesher_mesh_chunk(loader->grid, loader->light, cx, cy, cz, mesh);
+	return mesh;
+}
+
+static void mesh_chunk(void *context, uint32_t chunk)
+{
+	struct world_loader *loader = context;
+
+	if (loader->visibility)
+		chunk_visibility_build_chunk(loader->visibility, loader->grid, chunk);
+	chunk_mesh *mesh = build_chunk_mesh(loader, chunk);
+	if (mesh)
+		upload_queue_push(loader->uploads, chunk, mesh);
+}
+
+static void mesh_world(struct world_loader *loader)
+{
+	timing_phase_begin(&loader->meshing_phase, "meshing");
+	parallel_for(voxel_grid_num_chunks(loader->grid), mesh_chunk, loader);
+	timing_phase_end(&loader->meshing_phase);
+}
+
+static void *load_world(void *arg)
+{
+	struct world_loader *loader = arg;
+
+	timing_phase_begin(&loader->generation_phase, "voxel generation");
+	if (loader->solid)
+		voxel_grid_fill_solid(loader->grid);
+	else
+		terrain_generate(loader->grid, &loader->terrain);
+	voxel_grid_build_occupancy(loader->grid);
+	timing_phase_end(&loader->generation_phase);
+
+	/* Only the CPU mesher bakes in light. */
+	timing_phase_begin(&loader->lighting_phase, "lighting");
+	if (loader->light && !voxel_light_build(loader->light, loader->grid))
+		atomic_store(&loader->failed, 1);
+	timing_phase_end(&loader->lighting_phase);
+
+	if (!loader->gpu_meshing && !loader->raymarch)
+		mesh_world(loader);
+
+	atomic_store(&loader->done, 1);
+	return NULL;
+}
+
+/*
+ * Set up the light and cave culling the CPU mesher needs, unless the GPU
+ * meshes the world or it's ray-marched, and start load_world on thread.
+ * Returns 0, having said why, on failure.
+ */
+static int32_t start_loader(struct world_loader *loader, int32_t cave_culling, pthread_t *thread)
+{
+	if (!loader->gpu_meshing && !loader->raymarch) {
+		loader->light = voxel_light_new(loader->grid);
+		if (loader->light && cave_culling)
+			loader->visibility = chunk_visibility_new(loader->grid);
+		if (!loader->light || (cave_culling && !loader->visibility)) {
+			fprintf(stderr, "Memory allocation error.\n");
+			return 0;
+		}
+	}
+
+	if (pthread_create(thread, NULL, load_world, loader)) {
+		fprintf(stderr, "The world loader thread couldn't be started. Exiting.\n");
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Meshes chunks again after they lose their meshes to --memory-budget, on
+ * the workers in parallel.c so the main thread never waits for the mesher.
+ * The main thread hands over a batch of chunks when the remesher is idle
+ * and pushes the meshes to the upload queue once it is done.
+ */
+enum { REMESHER_IDLE, REMESHER_WORKING, REMESHER_DONE };
+
+struct remesher
+{
+	struct world_loader *loader;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t state_changed;
+	int32_t state, quit;	/* Under lock. */
+	uint32_t num_chunks;
+	uint32_t chunks[REMESHES_PER_FRAME];
+	chunk_mesh *meshes[REMESHES_PER_FRAME];
+};
+
+static void remesh_chunk(void *context, uint32_t index)
+{
+	struct remesher *remesher = context;
+	remesher->meshes[index] = build_chunk_mesh(remesher->loader, remesher->chunks[index]);
+}
+
+static void *run_remesher(void *arg)
+{
+	struct remesher *remesher = arg;
+
+	pthread_mutex_lock(&remesher->lock);
+	for (;;) {
+		while (remesher->state != REMESHER_WORKING && !remesher->quit)
+			pthread_cond_wait(&remesher->state_changed, &remesher->lock);
+		if (remesher->quit)
+			break;
+
+		pthread_mutex_unlock(&remesher->lock);
+		parallel_for(remesher->num_chunks, remesh_chunk, remesher);
+		pthread_mutex_lock(&remesher->lock);
+
+		remesher->state = REMESHER_DONE;
+	}
+	pthread_mutex_unlock(&remesher->lock);
+
+	return NULL;
+}
+
+/* Returns 0 if the thread couldn't be started. */
+static int32_t remesher_start(struct remesher *remesher, struct world_loader *loader)
+{
+	memset(remesher, 0, sizeof *remesher);
+	remesher->loader = loader;
+	pthread_mutex_init(&remesher->lock, NULL);
+	pthread_cond_init(&remesher->state_changed, NULL);
+	if (pthread_create(&remesher->thread, NULL, run_remesher, remesher)) {
+		pthread_cond_destroy(&remesher->state_changed);
+		pthread_mutex_destroy(&remesher->lock);
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Push the last batch's meshes if it is done. Returns whether the remesher
+ * is idle, in which case remesher->chunks can be filled for the next batch.
+ */
+static int32_t remesher_collect(struct remesher *remesher)
+{
+	pthread_mutex_lock(&remesher->lock);
+	int32_t state = remesher->state;
+	pthread_mutex_unlock(&remesher->lock);
+
+	if (state == REMESHER_WORKING)
+		return 0;
+
+	if (state == REMESHER_DONE) {
+		uint32_t i;
+		for (i = 0; i < remesher->num_chunks; i++)
+			if (remesher->meshes[i])
+				upload_queue_push(remesher->loader->uploads, remesher->chunks[i], remesher->meshes[i]);
+
+		pthread_mutex_lock(&remesher->lock);
+		remesher->state = REMESHER_IDLE;
+		pthread_mutex_unlock(&remesher->lock);
+	}
+
+	remesher->num_chunks = 0;
+	return 1;
+}
+
+/* Hand the chunks put in remesher->chunks to the workers, if there are any. */
+static void remesher_submit(struct remesher *remesher)
+{
+	if (!remesher->num_chunks)
+		return;
+
+	pthread_mutex_lock(&remesher->lock);
+	remesher->state = REMESHER_WORKING;
+	pthread_cond_signal(&remesher->state_changed);
+	pthread_mutex_unlock(&remesher->lock);
+}
+
+/* Wait for the batch in hand, if any, and stop the thread. Meshes not yet pushed are freed. */
+static void remesher_stop(struct remesher *remesher)
+{
+	pthread_mutex_lock(&remesher->lock);
+	remesher->quit = 1;
+	pthread_cond_signal(&remesher->state_changed);
+	pthread_mutex_unlock(&remesher->lock);
+	pthread_join(remesher->thread, NULL);
+
+	if (remesher->state == REMESHER_DONE) {
+		uint32_t i;
+		for (i = 0; i < remesher->num_chunks; i++)
+			chunk_mesh_free(remesher->meshes[i]);
+	}
+
+	pthread_cond_destroy(&remesher->state_changed);
+	pthread_mutex_destroy(&remesher->lock);
+}
+
+/* Set by the GLFW callbacks when something happens that needs a new frame. */
+static int32_t redraw_requested;
+
+static void request_redraw(GLFWwindow *window)
+{
+	redraw_requested = 1;
+}
+
+static void key_changed(GLFWwindow *window, int key, int scancode, int action, int mods)
+{
+	redraw_requested = 1;
+}
+
+static void framebuffer_resized(GLFWwindow *window, int width, int height)
+{
+	redraw_requested = 1;
+}
+
+/* Read the camera keys into the bits the simulation integrates. */
+static uint32_t sample_input(GLFWwindow *window)
+{
+	static const struct
+	{
+		int key;
+		uint32_t bit;
+	} bindings[] =
+	{
+		{ GLFW_KEY_H, INPUT_TURN_LEFT }, { GLFW_KEY_J, INPUT_LOOK_DOWN },
+		{ GLFW_KEY_K, INPUT_LOOK_UP }, { GLFW_KEY_L, INPUT_TURN_RIGHT },
+		{ GLFW_KEY_W, INPUT_FORWARD }, { GLFW_KEY_A, INPUT_LEFT },
+		{ GLFW_KEY_S, INPUT_BACKWARD }, { GLFW_KEY_D, INPUT_RIGHT },
+		{ GLFW_KEY_SPACE, INPUT_UP }
+	};
+
+	uint32_t i, input = 0;
+	for (i = 0; i < sizeof bindings / sizeof *bindings; i++)
+		if (glfwGetKey(window, bindings[i].key) == GLFW_PRESS)
+			input |= bindings[i].bit;
+
+	return input;
+}
+
+/* The last ticks after a key is released still move the camera. */
+static int32_t camera_settling(const sim_snapshot *snapshot)
+{
+	return memcmp(&snapshot->previous, &snapshot->current, sizeof snapshot->current) != 0;
+}
+
+/*
+ * Record loading the camera's rotation into the program's uniforms, all the
+ * mesh shaders take. Returns 0 if out of memory.
+ */
+static int32_t record_camera_rotation(command_buffer *commands, GLuint program_id, const camera_state *camera)
+{
+	float x_rotation_inverse[] =
+	{
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, cos(RAD(-camera->x_rotation)), -sin(RAD(-camera->x_rotation)), 0.0f,
+		0.0f, sin(RAD(-camera->x_rotation)), cos(RAD(-camera->x_rotation)), 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f
+	};
+
+	float y_rotation_inverse[] =
+	{
+		cos(RAD(-camera->y_rotation)), 0.0f, sin(RAD(-camera->y_rotation)), 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		-sin(RAD(-camera->y_rotation)), 0.0f, cos(RAD(-camera->y_rotation)), 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f
+	};
+
+	return command_buffer_uniform_matrix4fv(commands, program_id, "camera_x_rotation_matrix", GL_TRUE,
+			x_rotation_inverse)
+		&& command_buffer_uniform_matrix4fv(commands, program_id, "camera_y_rotation_matrix", GL_TRUE,
+			y_rotation_inverse);
+}
+
+/* The same with the camera's translation as well, for the raymarcher. Returns 0 if out of memory. */
+static int32_t record_camera_uniforms(command_buffer *commands, GLuint program_id, const camera_state *camera)
+{
+	float camera_translation_matrix[] =
+	{
+		1.0f, 0.0f, 0.0f, -camera->x,
+		0.0f, 1.0f, 0.0f, -camera->y,
+		0.0f, 0.0f, 1.0f, -camera->z,
+		0.0f, 0.0f, 0.0f, 1.0f
+	};
+
+	return command_buffer_uniform_matrix4fv(commands, program_id, "camera_translation_matrix", GL_TRUE,
+			camera_translation_matrix)
+		&& record_camera_rotation(commands, program_id, camera);
+}
+
+/* Where positions in the grid's space count from. */
+static const double grid_origin[3] = { 0.0, 0.0, 0.0 };
+
+/* Place what the program draws next at origin, relative to the camera at eye. */
+static void set_chunk_offset(GLuint program, const double *eye, const double *origin)
+{
+	gl_state_uniform3f(program, "chunk_offset", origin[0] - eye[0], origin[1] - eye[1], origin[2] - eye[2]);
+}
+
+/*
+ * What a frame's commands work on when they are replayed. Apart from
+ * world_streamed, it is only touched by the thread replaying them.
+ */
+struct render_state
+{
+	struct world_loader *loader;
+	gpu_mesher *voxel_mesher;
+	voxel_raymarcher *raymarcher;
+	resolution_scaler *scaler;
+	int32_t verify_gpu_mesher;
+	int32_t gpu_meshed, voxels_uploaded, first_frame_drawn;
+	double startup_time;
+	timing_phase glfw_phase, glew_phase, shader_phase, streaming_phase;
+	atomic_int world_streamed;
+	GLuint program;		/* The mesh program, for what is drawn in the grid's space. */
+	wireframe_mode wireframe;	/* Its wireframe uniform while the meshes are drawn. */
+	double eye[3];		/* Where the frame being replayed was recorded from. */
+	gl_state_stats frame_start, last_frame;	/* last_frame's counts are for the frame alone. */
+};
+
+/* A frame's eye, recorded by copy and set on replay. */
+struct eye_update
+{
+	struct render_state *state;
+	double eye[3];
+};
+
+static void set_eye(const void *data)
+{
+	const struct eye_update *update = data;
+	memcpy(update->state->eye, update->eye, sizeof update->eye);
+}
+
+/*
+ * What drawing a chunk needs. Its mesh is only known to the thread uploading
+ * it, so it is looked up on replay.
+ */
+struct chunk_draw
+{
+	gpu_mesh *mesh;
+	GLuint program;
+	double origin[3];	/* The chunk's low corner, where its vertex positions count from. */
+	const double *eye;	/* Read when the draw is replayed. */
+};
+
+/* One for each chunk, made once so recorded frames can point at them. */
+static struct chunk_draw *chunk_draws_new(upload_queue *uploads, const voxel_grid *grid, GLuint program,
+	const double *eye)
+{
+	struct chunk_draw *draws = malloc(uploads->num_meshes * sizeof *draws);
+	if (!draws)
+		return NULL;
+
+	uint32_t chunk;
+	for (chunk = 0; chunk < uploads->num_meshes; chunk++) {
+		int32_t cx, cy, cz;
+		voxel_grid_chunk_coords(grid, chunk, &cx, &cy, &cz);
+		draws[chunk].mesh = &uploads->meshes[chunk];
+		draws[chunk].program = program;
+		draws[chunk].origin[0] = cx * CHUNK_SIZE - 0.5;
+		draws[chunk].origin[1] = cy * CHUNK_SIZE - 0.5;
+		draws[chunk].origin[2] = cz * CHUNK_SIZE - 0.5;
+		draws[chunk].eye = eye;
+	}
+
+	return draws;
+}
+
+static void draw_chunk(const void *context)
+{
+	const struct chunk_draw *draw = context;
+	if (!draw->mesh->num_vertices)
+		return;
+
+	set_chunk_offset(draw->program, draw->eye, draw->origin);
+	gpu_mesh_draw(draw->mesh);
+}
+
+/*
+ * Queue every chunk's mesh as wireframe, in polygon_mode as --wireframe
+ * wants it, keyed by its distance from the camera. Once the voxels are
+ * final, chunks with nothing in them are left out, as are those not in
+ * visible unless it is NULL, and if the remesher is idle up to
+ * REMESHES_PER_FRAME of the rest that lost their meshes to --memory-budget
+ * are handed to it.
+ */
+static int32_t queue_chunks(render_queue *queue, GLuint program_id, GLenum polygon_mode,
+	const struct chunk_draw *chunk_draws, struct remesher *remesher, const uint8_t *visible,
+	const camera_state *camera)
+{
+	struct world_loader *loader = remesher->loader;
+	const voxel_grid *grid = loader->grid;
+	int32_t voxels_final = atomic_load(&loader->done);
+	int32_t remeshing = voxels_final && remesher_collect(remesher), recorded = 1;
+
+	uint32_t chunk;
+	for (chunk = 0; chunk < voxel_grid_num_chunks(grid); chunk++) {
+		if (voxels_final && (!grid->brick_masks[chunk] || (visible && !visible[chunk])))
+			continue;
+
+		if (remeshing && remesher->num_chunks < REMESHES_PER_FRAME
+			&& upload_queue_take_evicted(loader->uploads, chunk))
+			remesher->chunks[remesher->num_chunks++] = chunk;
+
+		int32_t cx, cy, cz;
+		voxel_grid_chunk_coords(grid, chunk, &cx, &cy, &cz);
+		float dx = (cx + 0.5f) * CHUNK_SIZE - 0.5f - camera->x;
+		float dy = (cy + 0.5f) * CHUNK_SIZE - 0.5f - camera->y;
+		float dz = (cz + 0.5f) * CHUNK_SIZE - 0.5f - camera->z;
+
+		/* The mesh's vertex array is only known on replay, so draw_chunk binds it. */
+		render_packet packet =
+		{
+			.key = render_key(RENDER_PASS_WIREFRAME, program_id, sqrtf(dx * dx + dy * dy + dz * dz), 0),
+			.program = program_id, .vao = 0, .polygon_mode = polygon_mode,
+			.draw = draw_chunk, .context = &chunk_draws[chunk]
+		};
+		if (!render_queue_push(queue, &packet)) {
+			recorded = 0;
+			break;
+		}
+	}
+
+	if (remeshing)
+		remesher_submit(remesher);
+	return recorded;
+}
+
+static void draw_raymarcher(const void *context)
+{
+	const struct render_state *state = context;
+	if (state->voxels_uploaded)
+		voxel_raymarcher_draw(state->raymarcher);
+}
+
+/* Its positions are in the grid's space rather than a chunk's. */
+static void draw_gpu_mesh(const void *context)
+{
+	const struct render_state *state = context;
+	if (!state->gpu_meshed)
+		return;
+
+	set_chunk_offset(state->program, state->eye, grid_origin);
+	gpu_mesher_draw(state->voxel_mesher);
+}
+
+#ifdef DEBUG
+/* The points or the axes, which are in the grid's space too. */
+struct debug_draw
+{
+	const struct render_state *state;
+	GLenum primitive;
+	GLsizei count;
+};
+
+/* Points and lines have no triangle edges to find, so the wireframe uniform is off while they are drawn. */
+static void draw_debug(const void *context)
+{
+	const struct debug_draw *draw = context;
+	set_chunk_offset(draw->state->program, draw->state->eye, grid_origin);
+	gl_state_uniform1i(draw->state->program, "wireframe", WIREFRAME_LINES);
+	glDrawArrays(draw->primitive, 0, draw->count);
+	gl_state_uniform1i(draw->state->program, "wireframe", draw->state->wireframe);
+}
+#endif
+
+/* Build whatever the loader has finished since the last frame, then stream in meshes. */
+static void prepare_frame(const void *context)
+{
+	struct render_state *state = (struct render_state *) context;
+	struct world_loader *loader = state->loader;
+
+	if (loader->gpu_meshing && !state->gpu_meshed && atomic_load(&loader->done)) {
+		state->gpu_meshed = 1;
+		timing_phase_begin(&loader->meshing_phase, "GPU meshing");
+		gpu_mesher_mesh(state->voxel_mesher, loader->grid);
+		glFinish();
+		timing_phase_end(&loader->meshing_phase);
+
+		if (state->verify_gpu_mesher)
+			printf("The GPU mesh %s the CPU mesh.\n",
+				gpu_mesher_verify(state->voxel_mesher, loader->grid) ? "matches" : "DOES NOT match");
+	}
+
+	if (state->raymarcher && !state->voxels_uploaded && atomic_load(&loader->done)) {
+		state->voxels_uploaded = 1;
+		timing_phase_begin(&loader->meshing_phase, "voxel texture upload");
+		if (!voxel_raymarcher_upload(state->raymarcher, loader->grid))
+			atomic_store(&loader->failed, 1);
+		timing_phase_end(&loader->meshing_phase);
+	}
+
+	upload_queue_process(loader->uploads);
+}
+
+/* The window size a frame was recorded for. */
+struct scaled_frame
+{
+	resolution_scaler *scaler;
+	int32_t window_width, window_height;
+};
+
+static void begin_scaled_frame(const void *data)
+{
+	const struct scaled_frame *frame = data;
+	resolution_scaler_begin(frame->scaler, frame->window_width, frame->window_height);
+}
+
+static void end_scaled_frame(const void *data)
+{
+	const struct scaled_frame *frame = data;
+	resolution_scaler_end(frame->scaler, frame->window_width, frame->window_height);
+}
+
+/* Report startup progress once the first frame and the whole world are drawn. */
+static void finish_frame(const void *context)
+{
+	struct render_state *state = (struct render_state *) context;
+	struct world_loader *loader = state->loader;
+
+	gl_state_stats now = gl_state_get_stats();
+	state->last_frame.programs_used = now.programs_used - state->frame_start.programs_used;
+	state->last_frame.vertex_arrays_bound = now.vertex_arrays_bound - state->frame_start.vertex_arrays_bound;
+	state->last_frame.polygon_mode_changes = now.polygon_mode_changes - state->frame_start.polygon_mode_changes;
+	state->frame_start = now;
+
+	if (!state->first_frame_drawn) {
+		state->first_frame_drawn = 1;
+		printf("Time to first frame: %.2f ms.\n", (timing_now() - state->startup_time) * 1e3);
+	}
+
+	if (!atomic_load(&state->world_streamed) && atomic_load(&loader->done) && !loader->uploads->stats.queue_depth
+		&& (!loader->gpu_meshing || state->gpu_meshed) && (!state->raymarcher || state->voxels_uploaded)) {
+		timing_phase_end(&state->streaming_phase);
+
+		timing_phase phases[] =
+		{
+			state->glfw_phase, state->glew_phase, state->shader_phase,
+			loader->generation_phase, loader->lighting_phase, loader->meshing_phase,
+			state->streaming_phase
+		};
+
+		printf("*---* Startup phases: *---*\n");
+		timing_report(phases, sizeof phases / sizeof *phases, state->startup_time);
+		printf("Whole world drawn after %.2f ms, %" PRIu64 " bytes uploaded.\n",
+			(timing_now() - state->startup_time) * 1e3, loader->uploads->stats.bytes_total);
+		atomic_store(&state->world_streamed, 1);
+	}
+}
+
+/* The second half of the P key's report, about what only the replaying thread knows. */
+static void print_render_stats(const void *context)
+{
+	const struct render_state *state = context;
+	const upload_stats *uploads = &state->loader->uploads->stats;
+
+	printf("*-* Upload queue depth: %" PRIu32 "\n", uploads->queue_depth);
+	printf("*-* Bytes uploaded last frame: %" PRIu64 "\n", uploads->bytes_this_frame);
+	printf("*-* Bytes uploaded in total: %" PRIu64 "\n", uploads->bytes_total);
+	gl_state_stats gl_stats = gl_state_get_stats();
+	printf("*-* GL state calls: %" PRIu64 " issued, %" PRIu64 " elided\n", gl_stats.issued, gl_stats.elided);
+	const gl_state_stats *frame = &state->last_frame;
+	printf("*-* Last frame bound %" PRIu64 " programs, %" PRIu64 " vertex arrays, %" PRIu64 " polygon modes\n",
+		frame->programs_used, frame->vertex_arrays_bound, frame->polygon_mode_changes);
+
+	gpu_memory_stats memory = gpu_memory_get_stats();
+	printf("*-* GPU buffer memory: %" PRIu64 " bytes in %" PRIu32 " buffers, peak %" PRIu64 "\n",
+		memory.total, memory.buffers, memory.total_peak);
+	gpu_memory_category category;
+	for (category = 0; category < GPU_MEMORY_CATEGORIES; category++)
+		printf("*-*   %s: %" PRIu64 " bytes, peak %" PRIu64 "\n", gpu_memory_category_name(category),
+			memory.current[category], memory.peak[category]);
+	printf("*-* Meshes evicted: %" PRIu64 ", dropped: %" PRIu64 "\n",
+		uploads->meshes_evicted, uploads->meshes_dropped);
+
+	if (state->scaler)
+		printf("*-* Resolution: %" PRId32 " x %" PRId32 " (%.0f%%), %.2f ms GPU\n",
+			state->scaler->width, state->scaler->height, state->scaler->scale * 100.0f,
+			state->scaler->gpu_time * 1e3);
+	printf("*-------------------------*\n\n");
+}
+
+/* Whether vertex shaders can read storage buffers. Some GL 4.3 hardware only has them in fragment and compute shaders. */
+static int32_t vertex_pulling_supported(void)
+{
+	if (!GLEW_VERSION_4_3 && !GLEW_ARB_shader_storage_buffer_object)
+		return 0;
+
+	GLint blocks = 0;
+	glGetIntegerv(GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS, &blocks);
+	return blocks > 0;
+}
+
+/* Milliseconds per frame over a benchmark run. */
+struct frame_times
 {
+	double mean, median, p95;
+};
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Time one renderer, the chunks when chunk_draws is given, drawn in
+ * polygon_mode with the wireframe uniform set to wireframe, else the
+ * raymarcher, while the camera turns once on the spot. Every frame is
+ * finished before the next begins so that each can be timed on its own.
+ * Returns 0 if out of memory.
+ */
+static int32_t time_frames(GLFWwindow *window, command_buffer *commands, GLuint program_id,
+	const camera_state *camera, const struct chunk_draw *chunk_draws, uint32_t num_chunks,
+	GLenum polygon_mode, wireframe_mode wireframe, const voxel_raymarcher *raymarcher, struct frame_times *times)
+{
+	double frame_ms[BENCHMARK_FRAMES];
+	camera_state view = *camera;
+	if (chunk_draws) {
+		gl_state_uniform1i(program_id, "wireframe", wireframe);
+		gl_state_polygon_mode(polygon_mode);
+	}
+	glFinish();
+
+	int32_t frame;
+	for (frame = 0; frame < BENCHMARK_FRAMES; frame++) {
+		double start = timing_now();
+
+		view.y_rotation = camera->y_rotation + 360.0f * frame / BENCHMARK_FRAMES;
+		command_buffer_reset(commands);
+		int32_t recorded = chunk_draws ? record_camera_rotation(commands, program_id, &view)
+			: record_camera_uniforms(commands, program_id, &view);
+		if (!recorded)
+			return 0;
+		command_buffer_execute(commands);
+
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		if (chunk_draws) {
+			uint32_t chunk;
+			for (chunk = 0; chunk < num_chunks; chunk++)
+				draw_chunk(&chunk_draws[chunk]);
+		} else
+			voxel_raymarcher_draw(raymarcher);
+		glfwSwapBuffers(window);
+		glFinish();
+
+		frame_ms[frame] = (timing_now() - start) * 1e3;
+	}
+	gl_state_polygon_mode(GL_FILL);
+
+	qsort(frame_ms, BENCHMARK_FRAMES, sizeof *frame_ms, compare_doubles);
+	times->mean = 0.0;
+	for (frame = 0; frame < BENCHMARK_FRAMES; frame++)
+		times->mean += frame_ms[frame] / BENCHMARK_FRAMES;
+	times->median = frame_ms[BENCHMARK_FRAMES / 2];
+	times->p95 = frame_ms[(BENCHMARK_FRAMES * 95 - 1) / 100];
+
+	return 1;
+}
+
+/* One line of --benchmark-json's output, in the format of bench/main.c's --json. */
+static void write_frame_times(FILE *json, const char *renderer, int32_t size, const struct frame_times *times)
+{
+	fprintf(json, "{\"name\": \"demo/%s/%" PRId32 "\", \"mean_ms\": %.4f, \"median_ms\": %.4f, \"p95_ms\": %.4f}\n",
+		renderer, size, times->mean, times->median, times->p95);
+}
+
+/*
+ * Draw terrain of a few sizes along the same camera path with filled
+ * triangles, as wireframe with GL_LINE polygon mode and with the
+ * barycentric shader, and with the raymarcher, and print the time per frame
+ * of each. If json is given, the times are written to it as well.
+ */
+static void benchmark_renderers(GLFWwindow *window, GLuint program_id, voxel_raymarcher *raymarcher, FILE *json)
+{
+	static const int32_t sizes[] = { 32, 64, 128, 256 };
+
+	/* Nothing runs on another thread here; the uniforms are recorded and replayed straight away. */
+	command_buffer *commands = command_buffer_new();
+	if (!commands) {
+		fprintf(stderr, "Memory allocation error.\n");
+		return;
+	}
+
+	printf("*---* Renderer benchmark: *---*\n");
+	printf("%6s %12s %16s %10s %16s %10s %18s %10s %16s %10s\n", "Grid", "Mesh bytes", "Triangles (ms)", "p95",
+		"Lines (ms)", "p95", "Barycentric (ms)", "p95", "Raymarch (ms)", "p95");
+
+	uint32_t i;
+	for (i = 0; i < sizeof sizes / sizeof *sizes; i++) {
+		int32_t size = sizes[i];
+		struct world_loader world = { 0 };
+		atomic_init(&world.failed, 0);
+		world.grid = voxel_grid_new(size, size, size);
+		if (world.grid)
+			world.uploads = upload_queue_new(voxel_grid_num_chunks(world.grid), UINT64_MAX);
+		if (!world.grid || !world.uploads) {
+			fprintf(stderr, "Memory allocation error.\n");
+			voxel_grid_free(world.grid);
+			command_buffer_free(commands);
+			return;
+		}
+
+		terrain_params_default(&world.terrain, DEFAULT_SEED, size);
+		terrain_generate(world.grid, &world.terrain);
+		voxel_grid_build_occupancy(world.grid);
+		mesh_world(&world);
+		upload_queue_process(world.uploads);
+
+		if (atomic_load(&world.failed) || !voxel_raymarcher_upload(raymarcher, world.grid)) {
+			fprintf(stderr, "Memory allocation error.\n");
+		} else {
+			/* From above one corner, looking down across the whole grid and then turning round. */
+			camera_state camera =
+			{
+				.x = -0.3 * size, .y = 1.1 * size, .z = -0.3 * size,
+				.x_rotation = -30.0f, .y_rotation = -135.0f, .z_rotation = 0
+			};
+			double eye[3] = { camera.x, camera.y, camera.z };
+			struct chunk_draw *chunk_draws = chunk_draws_new(world.uploads, world.grid, program_id, eye);
+
+			/* WIREFRAME_LINES keeps every fragment, so it draws the filled triangles too. */
+			uint32_t num_chunks = world.uploads->num_meshes;
+			struct frame_times triangles, lines, barycentric, raymarched;
+			int32_t timed = chunk_draws
+				&& time_frames(window, commands, program_id, &camera, chunk_draws, num_chunks, GL_FILL,
+					WIREFRAME_LINES, NULL, &triangles)
+				&& time_frames(window, commands, program_id, &camera, chunk_draws, num_chunks, GL_LINE,
+					WIREFRAME_LINES, NULL, &lines)
+				&& time_frames(window, commands, program_id, &camera, chunk_draws, num_chunks, GL_FILL,
+					WIREFRAME_BARYCENTRIC, NULL, &barycentric)
+				&& time_frames(window, commands, raymarcher->program, &camera, NULL, 0, GL_FILL, WIREFRAME_LINES,
+					raymarcher, &raymarched);
+			free(chunk_draws);
+			if (!timed) {
+				fprintf(stderr, "Memory allocation error.\n");
+			} else {
+				printf("%5" PRId32 "^3 %12" PRIu64 " %16.3f %10.3f %16.3f %10.3f %18.3f %10.3f %16.3f %10.3f\n",
+					size, world.uploads->stats.bytes_total, triangles.mean, triangles.p95, lines.mean, lines.p95,
+					barycentric.mean, barycentric.p95, raymarched.mean, raymarched.p95);
+				if (json) {
+					write_frame_times(json, "triangles", size, &triangles);
+					write_frame_times(json, "lines", size, &lines);
+					write_frame_times(json, "barycentric", size, &barycentric);
+					write_frame_times(json, "raymarch", size, &raymarched);
+				}
+			}
+		}
+
+		upload_queue_free(world.uploads);
+		voxel_grid_free(world.grid);
+	}
+
+	printf("*----------------------------*\n");
+	command_buffer_free(commands);
+}
+
+int32_t main(int32_t num_args, char **args)
+{
+	double startup_time = timing_now();
+
+	frame_pacer pacer;
+	frame_pacer_init(&pacer, PACING_UNCAPPED, 60.0);
+
+	/* Bytes of mesh data uploaded per frame at most. */
+	uint64_t upload_budget = DEFAULT_UPLOAD_BUDGET;
+
+	/* Bytes of buffers to keep chunk meshes within, or 0 for no limit. */
+	uint64_t memory_budget = 0;
+
+	struct world_loader loader = { 0 };
+	terrain_params_default(&loader.terrain, DEFAULT_SEED, NUM_VOXELS_Y);
+
+	/* Check the compute shader mesh against mesher.c once it is built. */
+	int32_t verify_gpu_mesher = 0;
+
+	/* Time both renderers at a few grid sizes and exit. */
+	int32_t benchmark = 0;
+
+	/* Where --benchmark-json writes the times, for perf/run.sh. */
+	const char *benchmark_json = NULL;
+
+	/* GPU milliseconds per frame to scale the resolution for, or 0 for the window's. */
+	double resolution_budget = 0.0;
+
+	/* Replay the frames on a thread of their own, or on this one. */
+	int32_t threaded_rendering = 1;
+
+	wireframe_mode wireframe = WIREFRAME_BARYCENTRIC;
+
+	/* Leave out the CPU-meshed chunks that the camera can't see into. */
+	int32_t cave_culling = 1;
+
+	int32_t arg;
+	for (arg = 1; arg < num_args; arg++) {
+		if (!strncmp(args[arg], "--pacing=", 9) && frame_pacer_parse(&pacer, args[arg] + 9))
+			continue;
+
+		if (!strncmp(args[arg], "--upload-budget=", 16)) {
+			char *end;
+			upload_budget = strtoull(args[arg] + 16, &end, 10);
+			if (*end == '\0' && upload_budget > 0)
+				continue;
+		}
+
+		if (!strncmp(args[arg], "--memory-budget=", 16)) {
+			char *end;
+			memory_budget = strtoull(args[arg] + 16, &end, 10);
+			if (*end == '\0' && memory_budget > 0)
+				continue;
+		}
+
+		if (!strcmp(args[arg], "--world=solid") || !strcmp(args[arg], "--world=terrain")) {
+			loader.solid = !strcmp(args[arg], "--world=solid");
+			continue;
+		}
+
+		if (!strncmp(args[arg], "--seed=", 7)) {
+			char *end;
+			loader.terrain.seed = strtoul(args[arg] + 7, &end, 10);
+			if (*end == '\0')
+				continue;
+		}
+
+		if (!strcmp(args[arg], "--mesher=cpu") || !strcmp(args[arg], "--mesher=gpu")) {
+			loader.gpu_meshing = !strcmp(args[arg], "--mesher=gpu");
+			continue;
+		}
+
+		if (!strcmp(args[arg], "--vertex-pulling")) {
+			loader.pulled = 1;
+			continue;
+		}
+
+		if (!strcmp(args[arg], "--verify-gpu-mesher")) {
+			verify_gpu_mesher = 1;
+			continue;
+		}
+
+		if (!strcmp(args[arg], "--renderer=mesh") || !strcmp(args[arg], "--renderer=raymarch")) {
+			loader.raymarch = !strcmp(args[arg], "--renderer=raymarch");
+			continue;
+		}
+
+		if (!strcmp(args[arg], "--benchmark-renderers")) {
+			benchmark = 1;
+			continue;
+		}
+
+		if (!strncmp(args[arg], "--benchmark-json=", 17) && args[arg][17]) {
+			benchmark = 1;
+			benchmark_json = args[arg] + 17;
+			continue;
+		}
+
+		if (!strncmp(args[arg], "--resolution-budget=", 20)) {
+			char *end;
+			resolution_budget = strtod(args[arg] + 20, &end);
+			if (end != args[arg] + 20 && *end == '\0' && resolution_budget > 0)
+				continue;
+		}
+
+		if (!strcmp(args[arg], "--render-thread=on") || !strcmp(args[arg], "--render-thread=off")) {
+			threaded_rendering = !strcmp(args[arg], "--render-thread=on");
+			continue;
+		}
+
+		if (!strcmp(args[arg], "--wireframe=lines") || !strcmp(args[arg], "--wireframe=barycentric")
+			|| !strcmp(args[arg], "--wireframe=hidden")) {
+			wireframe = !strcmp(args[arg], "--wireframe=lines") ? WIREFRAME_LINES
+				: !strcmp(args[arg], "--wireframe=barycentric") ? WIREFRAME_BARYCENTRIC : WIREFRAME_HIDDEN;
+			continue;
+		}
+
+		if (!strcmp(args[arg], "--cave-culling=on") || !strcmp(args[arg], "--cave-culling=off")) {
+			cave_culling = !strcmp(args[arg], "--cave-culling=on");
+			continue;
+		}
+
+		fprintf(stderr, "Usage: %s [--pacing=uncapped|ondemand|<fps>] [--upload-budget=<bytes>]"
+			" [--memory-budget=<bytes>] [--world=terrain|solid] [--seed=<n>] [--mesher=cpu|gpu]"
+			" [--vertex-pulling] [--verify-gpu-mesher] [--renderer=mesh|raymarch] [--benchmark-renderers]"
+			" [--benchmark-json=<file>] [--resolution-budget=<ms>] [--render-thread=on|off]"
+			" [--wireframe=barycentric|hidden|lines] [--cave-culling=on|off]\n", args[0]);
+		return EXIT_FAILURE;
+	}
+
+	gpu_memory_set_budget(memory_budget);
+
+	/* Nothing is meshed when the voxels are ray-marched. Face records are only made by the CPU mesher. */
+	if (loader.raymarch)
+		loader.gpu_meshing = 0;
+	if (loader.raymarch || loader.gpu_meshing || benchmark)
+		loader.pulled = 0;
+
+	/*
+	 * Start generating and meshing the world straight away, unless the GPU
+	 * was asked to mesh it: whether it can is only known once there's a
+	 * context, and without compute shaders the loader meshes and lights it.
+	 */
+	atomic_init(&loader.done, 0);
+	atomic_init(&loader.failed, 0);
+	loader.grid = voxel_grid_new(NUM_VOXELS_X, NUM_VOXELS_Y, NUM_VOXELS_Z);
+	if (loader.grid)
+		loader.uploads = upload_queue_new(voxel_grid_num_chunks(loader.grid), upload_budget);
+	if (!loader.grid || !loader.uploads) {
+		fprintf(stderr, "Memory allocation error.\n");
+		return EXIT_FAILURE;
+	}
+
+	pthread_t loader_thread;
+	if (!loader.gpu_meshing && !start_loader(&loader, cave_culling, &loader_thread))
+		return EXIT_FAILURE;
+
 	/* Use GLFW to create an OpenGL context. */
+	timing_phase glfw_phase;
+	timing_phase_begin(&glfw_phase, "GLFW init");
 	if (!glfwInit())
 	{
 		fprintf(stderr, "GLFW couldn't be initialised. Exiting.\n");
@@ -66,8 +1178,17 @@ int32_t main(int32_t num_args, uint8_t args)
 		return EXIT_FAILURE;
 	}
 	glfwMakeContextCurrent(window);
+	timing_phase_end(&glfw_phase);
+
+	/* Pacing is done by frame_pacer, not by waiting for vertical sync. */
+	glfwSwapInterval(0);
+	glfwSetKeyCallback(window, key_changed);
+	glfwSetFramebufferSizeCallback(window, framebuffer_resized);
+	glfwSetWindowRefreshCallback(window, request_redraw);
 
 	/* Once the OpenGL context is created GLEW can be initialised. */
+	timing_phase glew_phase;
+	timing_phase_begin(&glew_phase, "GLEW init");
 	GLenum result = glewInit();
 	if (result != GLEW_OK)
 	{
@@ -76,8 +1197,23 @@ int32_t main(int32_t num_args, uint8_t args)
 	}
 
 	printf("Using GLEW %s.\n", glewGetString(GLEW_VERSION));
+	timing_phase_end(&glew_phase);
+
+	/* Now the GPU mesher can be tried, falling back to the loader meshing on the CPU. */
+	gpu_mesher *voxel_mesher = NULL;
+	if (loader.gpu_meshing) {
+		if (!gpu_mesher_supported())
+			fprintf(stderr, "OpenGL 4.3 compute shaders aren't available, meshing on the CPU.\n");
+		else if (!(voxel_mesher = gpu_mesher_new()))
+			fprintf(stderr, "The GPU mesher couldn't be set up, meshing on the CPU.\n");
+		loader.gpu_meshing = voxel_mesher != NULL;
+		if (!start_loader(&loader, cave_culling, &loader_thread))
+			return EXIT_FAILURE;
+	}
 
 	/* Set up the shaders. */
+	timing_phase shader_phase;
+	timing_phase_begin(&shader_phase, "shader compile");
 	GLuint fragment_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
 	glShaderSource(fragment_shader_id, 1, &fragment_shader_source, NULL);
 	glCompileShader(fragment_shader_id);
@@ -125,7 +1261,9 @@ int32_t main(int32_t num_args, uint8_t args)
 
 	GLuint program_id = glCreateProgram();
 	glBindAttribLocation(program_id, 0, "position");
-	glBindAttribLocation(program_id, 1, "in_colour");
+	glBindAttribLocation(program_id, 1, "material");
+	glBindAttribLocation(program_id, 2, "light");
+	glBindAttribLocation(program_id, 3, "occlusion");
 
 	glAttachShader(program_id, fragment_shader_id);
 	glAttachShader(program_id, vertex_shader_id);
@@ -151,209 +1289,66 @@ int32_t main(int32_t num_args, uint8_t args)
 		return EXIT_FAILURE;
 	}
 
-	glUseProgram(program_id);
-
-	/* Define a three-dimensional grid of uniformly-spaced points (voxels). */
-	#define NUM_VOXELS_X 100
-	#define NUM_VOXELS_Y 100
-	#define NUM_VOXELS_Z 100
-	#define COMPONENTS_PER_VERTEX 4
-
-	uint8_t voxels[NUM_VOXELS_X][NUM_VOXELS_Y][NUM_VOXELS_Z] =
-	{
-		0
-	};
-
-	sc_vecf *vertex_buffer, *colour_buffer;
-	{
-		float *initial_vertex_buffer = malloc(64 * sizeof *initial_vertex_buffer);
-		vertex_buffer = sc_vecf_new(initial_vertex_buffer, 0, 64, 64);
-
-		float *initial_colour_buffer = malloc(64 * sizeof *initial_colour_buffer);
-		colour_buffer = sc_vecf_new(initial_colour_buffer, 0, 64, 64);
-
-		if (!initial_vertex_buffer || !vertex_buffer
-			|| !initial_colour_buffer || !colour_buffer) {
-			printf("Memory allocation error.\n");
+	/*
+	 * The GPU mesher's vertex array has no light or occlusion attributes, so
+	 * its chunks are drawn fully lit and without ambient occlusion.
+	 */
+	glVertexAttribI4ui(2, LIGHT_FULL, 0, 0, 1);
+	glVertexAttribI4ui(3, 3, 0, 0, 1);
+
+	voxel_raymarcher *raymarcher = NULL;
+	if (loader.raymarch || benchmark) {
+		raymarcher = voxel_raymarcher_new();
+		if (!raymarcher) {
+			glfwTerminate();
 			return EXIT_FAILURE;
 		}
 	}
 
-	{
-		int32_t x, y, z;
-		for (x = 0; x < NUM_VOXELS_X; x++)
-			for (y = 0; y < NUM_VOXELS_Y; y++)
-				for (z = 0; z < NUM_VOXELS_Z; z++)
-					voxels[x][y][z] = 1;
-	}
-
-	int32_t x, y, z;
-
-	#define add_x_quad(offset) \
-		do { \
-			sc_vecf_append(vertex_buffer, x + (offset)); \
-			sc_vecf_append(vertex_buffer, y - 0.5f); \
-			sc_vecf_append(vertex_buffer, z + 0.5f); \
-			sc_vecf_append(vertex_buffer, 1.0f); \
-			sc_vecf_append(vertex_buffer, x + (offset)); \
-			sc_vecf_append(vertex_buffer, y + 0.5f); \
-			sc_vecf_append(vertex_buffer, z + 0.5f); \
-			sc_vecf_append(vertex_buffer, 1.0f); \
-			sc_vecf_append(vertex_buffer, x + (offset)); \
-			sc_vecf_append(vertex_buffer, y + 0.5f); \
-			sc_vecf_append(vertex_buffer, z - 0.5f); \
-			sc_vecf_append(vertex_buffer, 1.0f); \
-			sc_vecf_append(vertex_buffer, x + (offset)); \
-			sc_vecf_append(vertex_buffer, y + 0.5f); \
-			sc_vecf_append(vertex_buffer, z - 0.5f); \
-			sc_vecf_append(vertex_buffer, 1.0f); \
-			sc_vecf_append(vertex_buffer, x + (offset)); \
-			sc_vecf_append(vertex_buffer, y - 0.5f); \
-			sc_vecf_append(vertex_buffer, z - 0.5f); \
-			sc_vecf_append(vertex_buffer, 1.0f); \
-			sc_vecf_append(vertex_buffer, x + (offset)); \
-			sc_vecf_append(vertex_buffer, y - 0.5f); \
-			sc_vecf_append(vertex_buffer, z + 0.5f); \
-			sc_vecf_append(vertex_buffer, 1.0f); \
-			int32_t i; \
-			for (i = 0; i < 6; i++) { \
-				sc_vecf_append(colour_buffer, 0.0f); \
-				sc_vecf_append(colour_buffer, 1.0f); \
-				sc_vecf_append(colour_buffer, 0.0f); \
-				sc_vecf_append(colour_buffer, 1.0f); \
-			} \
-		} while (0)
-
-	#define add_y_quad(offset) \
-		do { \
-			sc_vecf_append(vertex_buffer, x - 0.5f); \
-			sc_vecf_append(vertex_buffer, y + (offset)); \
-			sc_vecf_append(vertex_buffer, z + 0.5f); \
-			sc_vecf_append(vertex_buffer, 1.0f); \
-			sc_vecf_append(vertex_buffer, x + 0.5f ); \
-			sc_vecf_append(vertex_buffer, y + (offset)); \
-			sc_vecf_append(vertex_buffer, z + 0.5f); \
-			sc_vecf_append(vertex_buffer, 1.0f); \
-			sc_vecf_append(vertex_buffer, x + 0.5f); \
-			sc_vecf_append(vertex_buffer, y + (offset)); \
-			sc_vecf_append(vertex_buffer, z - 0.5f); \
-			sc_vecf_append(vertex_buffer, 1.0f); \
-			sc_vecf_append(vertex_buffer, x + 0.5f); \
-			sc_vecf_append(vertex_buffer, y + (offset)); \
-			sc_vecf_append(vertex_buffer, z - 0.5f); \
-			sc_vecf_append(vertex_buffer, 1.0f); \
-			sc_vecf_append(vertex_buffer, x - 0.5f); \
-			sc_vecf_append(vertex_buffer, y + (offset)); \
-			sc_vecf_append(vertex_buffer, z - 0.5f); \
-			sc_vecf_append(vertex_buffer, 1.0f); \
-			sc_vecf_append(vertex_buffer, x - 0.5f); \
-			sc_vecf_append(vertex_buffer, y + (offset)); \
-			sc_vecf_append(vertex_buffer, z + 0.5f); \
-			sc_vecf_append(vertex_buffer, 1.0f); \
-			int32_t i; \
-			for (i = 0; i < 6; i++) { \
-				sc_vecf_append(colour_buffer, 0.0f); \
-				sc_vecf_append(colour_buffer, 1.0f); \
-				sc_vecf_append(colour_buffer, 0.0f); \
-				sc_vecf_append(colour_buffer, 1.0f); \
-			} \
-		} while (0)
-
-	#define add_z_quad(offset) \
-		do { \
-			sc_vecf_append(vertex_buffer, x - 0.5f); \
-			sc_vecf_append(vertex_buffer, y + 0.5f); \
-			sc_vecf_append(vertex_buffer, z + (offset)); \
-			sc_vecf_append(vertex_buffer, 1.0f); \
-			sc_vecf_append(vertex_buffer, x + 0.5f ); \
-			sc_vecf_append(vertex_buffer, y + 0.5f); \
-			sc_vecf_append(vertex_buffer, z + (offset)); \
-			sc_vecf_append(vertex_buffer, 1.0f); \
-			sc_vecf_append(vertex_buffer, x + 0.5f); \
-			sc_vecf_append(vertex_buffer, y - 0.5f); \
-			sc_vecf_append(vertex_buffer, z + (offset)); \
-			sc_vecf_append(vertex_buffer, 1.0f); \
-			sc_vecf_append(vertex_buffer, x + 0.5f); \
-			sc_vecf_append(vertex_buffer, y - 0.5f); \
-			sc_vecf_append(vertex_buffer, z + (offset)); \
-			sc_vecf_append(vertex_buffer, 1.0f); \
-			sc_vecf_append(vertex_buffer, x - 0.5f); \
-			sc_vecf_append(vertex_buffer, y - 0.5f); \
-			sc_vecf_append(vertex_buffer, z + (offset)); \
-			sc_vecf_append(vertex_buffer, 1.0f); \
-			sc_vecf_append(vertex_buffer, x - 0.5f); \
-			sc_vecf_append(vertex_buffer, y + 0.5f); \
-			sc_vecf_append(vertex_buffer, z + (offset)); \
-			sc_vecf_append(vertex_buffer, 1.0f); \
-			int32_t i; \
-			for (i = 0; i < 6; i++) { \
-				sc_vecf_append(colour_buffer, 0.0f); \
-				sc_vecf_append(colour_buffer, 1.0f); \
-				sc_vecf_append(colour_buffer, 0.0f); \
-				sc_vecf_append(colour_buffer, 1.0f); \
-			} \
-		} while (0)
-
-	for (x = 0; x < NUM_VOXELS_X; x++) {
-		for (y = 0; y < NUM_VOXELS_Y; y++) {
-			for (z = 0; z < NUM_VOXELS_Z; z++) {
-				if (voxels[x][y][z]) {
-					if (!x) /* Do left. */
-						add_x_quad(-0.5f);
-
-					if (!y) /* Do bottom. */
-						add_y_quad(-0.5f);
-
-					if (!z) /* Do back. */
-						add_z_quad(-0.5f);
-
-					if (x == NUM_VOXELS_X - 1 || (voxels[x][y][z] != voxels[x + 1][y][z])) /* Do right. */
-						add_x_quad(0.5f);
-
-					if (y == NUM_VOXELS_Y - 1 || voxels[x][y][z] != voxels[x][y + 1][z]) /* Do top. */
-						add_y_quad(0.5f);
-
-					if (z == NUM_VOXELS_Z - 1 || voxels[x][y][z] != voxels[x][y][z + 1]) /* Do front. */
-						add_z_quad(0.5f);
-				}
-			}
+	/* Chunks of face records are drawn by a program of their own. */
+	GLuint pulling_program = 0;
+	if (loader.pulled) {
+		if (!vertex_pulling_supported()) {
+			fprintf(stderr, "Vertex pulling needs storage buffers in vertex shaders, which aren't available. Exiting.\n");
+			glfwTerminate();
+			return EXIT_FAILURE;
 		}
-	}
-
-	printf("Vertex buffer index: %" PRIu64 ".\n", vertex_buffer->index);
-	printf("Colour buffer index: %" PRIu64 ".\n", colour_buffer->index);
-	printf("Vertex buffer size: %" PRIu64 ".\n", vertex_buffer->size);
-	printf("Colour buffer size: %" PRIu64 ".\n", colour_buffer->size);
-
-	GLuint voxel_vao, voxel_vbo, voxel_cbo;
 
-	glGenVertexArrays(1, &voxel_vao);
-	glBindVertexArray(voxel_vao);
-
-	glGenBuffers(1, &voxel_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, voxel_vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(float) * vertex_buffer->index, vertex_buffer->data, GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(0);
+		pulling_program = shader_program_new(pulled_vertex_shader_source, fragment_shader_source);
+		if (!pulling_program) {
+			glfwTerminate();
+			return EXIT_FAILURE;
+		}
+	}
 
-	glGenBuffers(1, &voxel_cbo);
-	glBindBuffer(GL_ARRAY_BUFFER, voxel_cbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(float) * colour_buffer->index, colour_buffer->data, GL_STATIC_DRAW);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(1);
+	/* Every program colours voxels by looking their values up in here. */
+	material_palette *palette = material_palette_new();
+	if (!palette) {
+		fprintf(stderr, "Memory allocation error.\n");
+		glfwTerminate();
+		return EXIT_FAILURE;
+	}
 
-	uint32_t num_voxel_vertices = vertex_buffer->index / 4;
+	gl_state_use_program(program_id);
+	timing_phase_end(&shader_phase);
 
-	sc_vecf_free(vertex_buffer);
-	sc_vecf_free(colour_buffer);
+	/* Chunks are drawn as their meshes arrive. */
+	timing_phase streaming_phase;
+	timing_phase_begin(&streaming_phase, "mesh streaming");
 
 #ifdef DEBUG
-	float voxel_vertices[NUM_VOXELS_X * NUM_VOXELS_Y * NUM_VOXELS_Z * COMPONENTS_PER_VERTEX];
-	float voxel_colours[NUM_VOXELS_X * NUM_VOXELS_Y * NUM_VOXELS_Z * COMPONENTS_PER_VERTEX];
+	material_palette_set(palette, DEBUG_WHITE, 255, 255, 255, 255);
+	material_palette_set(palette, DEBUG_YELLOW, 255, 255, 0, 255);
+	material_palette_set(palette, DEBUG_BLUE, 0, 0, 255, 255);
+	material_palette_set(palette, DEBUG_RED, 255, 0, 0, 255);
+	material_palette_upload(palette);
+
+	/* In mesher.h's vertex format, which holds the grid as long as it is under 256 voxels a side. */
+	static uint8_t voxel_vertices[NUM_VOXELS_X * NUM_VOXELS_Y * NUM_VOXELS_Z * COMPONENTS_PER_VERTEX];
 
 	{
-		float x, y, z;
-		int32_t colours_i = 0, vertices_i = 0;
+		int32_t x, y, z;
+		int32_t vertices_i = 0;
 
 		for (x = 0; x < NUM_VOXELS_X; x++) {
 			for (y = 0; y < NUM_VOXELS_Y; y++) {
@@ -361,74 +1356,57 @@ int32_t main(int32_t num_args, uint8_t args)
 					voxel_vertices[vertices_i++] = x;
 					voxel_vertices[vertices_i++] = y;
 					voxel_vertices[vertices_i++] = z;
-					voxel_vertices[vertices_i++] = 1.0f;
-
-					voxel_colours[colours_i++] = 1.0f;
-					voxel_colours[colours_i++] = 1.0f;
-					voxel_colours[colours_i++] = 1.0f;
-					voxel_colours[colours_i++] = 1.0f;
+					voxel_vertices[vertices_i++] = DEBUG_WHITE;
+					voxel_vertices[vertices_i++] = LIGHT_FULL;
+					voxel_vertices[vertices_i++] = 3;
+					vertices_i += 2;
 				}
 			}
 		}
 	}
 
-	GLuint voxels_vao, voxels_vbo, voxels_cbo;
+	GLuint voxels_vao, voxels_vbo;
 
 	glGenVertexArrays(1, &voxels_vao);
-	glBindVertexArray(voxels_vao);
+	gl_state_bind_vertex_array(voxels_vao);
 
-	glGenBuffers(1, &voxels_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, voxels_vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof voxel_vertices, voxel_vertices, GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+	voxels_vbo = gpu_memory_buffer_new(GPU_MEMORY_MESH, GL_ARRAY_BUFFER, sizeof voxel_vertices, voxel_vertices,
+		GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_UNSIGNED_BYTE, GL_FALSE, COMPONENTS_PER_VERTEX, 0);
 	glEnableVertexAttribArray(0);
-
-	glGenBuffers(1, &voxels_cbo);
-	glBindBuffer(GL_ARRAY_BUFFER, voxels_cbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof voxel_colours, voxel_colours, GL_STATIC_DRAW);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, 0);
+	glVertexAttribIPointer(1, 1, GL_UNSIGNED_BYTE, COMPONENTS_PER_VERTEX, (const void *) 3);
 	glEnableVertexAttribArray(1);
+	glVertexAttribIPointer(2, 1, GL_UNSIGNED_BYTE, COMPONENTS_PER_VERTEX, (const void *) 4);
+	glEnableVertexAttribArray(2);
+	glVertexAttribIPointer(3, 1, GL_UNSIGNED_BYTE, COMPONENTS_PER_VERTEX, (const void *) 5);
+	glEnableVertexAttribArray(3);
 
-	GLfloat axes[] =
+	uint8_t axes[] =
 	{
-		0.0f, 0.0f, 0.0f, 1.0f,
-		NUM_VOXELS_X - 1, 0.0f, 0.0f, 1.0f,
+		0, 0, 0, DEBUG_YELLOW, LIGHT_FULL, 3, 0, 0,
+		NUM_VOXELS_X - 1, 0, 0, DEBUG_YELLOW, LIGHT_FULL, 3, 0, 0,
 
-		0.0f, 0.0f, 0.0f, 1.0f,
-		0.0f, NUM_VOXELS_Y - 1, 0.0f, 1.0f,
+		0, 0, 0, DEBUG_BLUE, LIGHT_FULL, 3, 0, 0,
+		0, NUM_VOXELS_Y - 1, 0, DEBUG_BLUE, LIGHT_FULL, 3, 0, 0,
 
-		0.0f, 0.0f, 0.0f, 1.0f,
-		0.0f, 0.0f, NUM_VOXELS_Z - 1, 1.0f,
+		0, 0, 0, DEBUG_RED, LIGHT_FULL, 3, 0, 0,
+		0, 0, NUM_VOXELS_Z - 1, DEBUG_RED, LIGHT_FULL, 3, 0, 0,
 	};
 
-	GLfloat axis_colours[] =
-	{
-		1.0f, 1.0f, 0.0f, 1.0f,
-		1.0f, 1.0f, 0.0f, 1.0f,
-
-		0.0f, 0.0f, 1.0f, 1.0f,
-		0.0f, 0.0f, 1.0f, 1.0f,
-
-		1.0f, 0.0f, 0.0f, 1.0f,
-		1.0f, 0.0f, 0.0f, 1.0f
-	};
-
-	GLuint axes_vao, axes_vbo, axes_cbo;
+	GLuint axes_vao, axes_vbo;
 
 	glGenVertexArrays(1, &axes_vao);
-	glBindVertexArray(axes_vao);
+	gl_state_bind_vertex_array(axes_vao);
 
-	glGenBuffers(1, &axes_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, axes_vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof axes, axes, GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+	axes_vbo = gpu_memory_buffer_new(GPU_MEMORY_MESH, GL_ARRAY_BUFFER, sizeof axes, axes, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_UNSIGNED_BYTE, GL_FALSE, COMPONENTS_PER_VERTEX, 0);
 	glEnableVertexAttribArray(0);
-
-	glGenBuffers(1, &axes_cbo);
-	glBindBuffer(GL_ARRAY_BUFFER, axes_cbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof axis_colours, axis_colours, GL_STATIC_DRAW);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, 0);
+	glVertexAttribIPointer(1, 1, GL_UNSIGNED_BYTE, COMPONENTS_PER_VERTEX, (const void *) 3);
 	glEnableVertexAttribArray(1);
+	glVertexAttribIPointer(2, 1, GL_UNSIGNED_BYTE, COMPONENTS_PER_VERTEX, (const void *) 4);
+	glEnableVertexAttribArray(2);
+	glVertexAttribIPointer(3, 1, GL_UNSIGNED_BYTE, COMPONENTS_PER_VERTEX, (const void *) 5);
+	glEnableVertexAttribArray(3);
 #endif
 
 	/* Set up viewing information. */
@@ -446,237 +1424,306 @@ int32_t main(int32_t num_args, uint8_t args)
 		0.0f, 0.0f, -1.0f, 0.0f
 	};
 
-	glUniformMatrix4fv(glGetUniformLocation(program_id, "perspective_matrix"), 1, GL_TRUE, perspective_matrix);
+	gl_state_uniform_matrix4fv(program_id, "perspective_matrix", GL_TRUE, perspective_matrix);
+	gl_state_uniform1i(program_id, "palette", PALETTE_TEXTURE_UNIT);
+	gl_state_uniform1i(program_id, "wireframe", wireframe);
+	if (raymarcher) {
+		gl_state_uniform_matrix4fv(raymarcher->program, "perspective_matrix", GL_TRUE, perspective_matrix);
+		gl_state_uniform1i(raymarcher->program, "palette", PALETTE_TEXTURE_UNIT);
+	}
+	if (pulling_program) {
+		gl_state_uniform_matrix4fv(pulling_program, "perspective_matrix", GL_TRUE, perspective_matrix);
+		gl_state_uniform1i(pulling_program, "palette", PALETTE_TEXTURE_UNIT);
+		gl_state_uniform1i(pulling_program, "wireframe", wireframe);
+	}
 
 	glEnable(GL_DEPTH_TEST);
-	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);	/* The mesh fragment shader's background too. */
+	GLenum mesh_polygon_mode = wireframe == WIREFRAME_LINES ? GL_LINE : GL_FILL;
+
+	/* Everything drawn in a frame goes through here to be put in a cheap order. */
+	render_queue *draws = render_queue_new();
+	if (!draws) {
+		fprintf(stderr, "Memory allocation error.\n");
+		glfwTerminate();
+		return EXIT_FAILURE;
+	}
+
+	resolution_scaler *scaler = NULL;
+	if (resolution_budget > 0.0 && !benchmark) {
+		if (resolution_scaler_supported())
+			scaler = resolution_scaler_new(resolution_budget, 0.25f);
+		else
+			fprintf(stderr, "GPU timer queries aren't available, drawing at the window's resolution.\n");
+	}
+
+	if (benchmark) {
+		/* Let the loader finish so it doesn't compete for the CPU. */
+		pthread_join(loader_thread, NULL);
+		FILE *json = benchmark_json ? fopen(benchmark_json, "w") : NULL;
+		if (benchmark_json && !json)
+			fprintf(stderr, "Couldn't open %s for writing.\n", benchmark_json);
+		benchmark_renderers(window, program_id, raymarcher, json);
+		if (json)
+			fclose(json);
+
+		upload_queue_free(loader.uploads);
+		gpu_mesher_free(voxel_mesher);
+		voxel_raymarcher_free(raymarcher);
+		material_palette_free(palette);
+		render_queue_free(draws);
+		gl_state_delete_program(program_id);
+		glfwTerminate();
+		chunk_visibility_free(loader.visibility);
+		voxel_light_free(loader.light);
+		voxel_grid_free(loader.grid);
+		return EXIT_SUCCESS;
+	}
 
-	struct
+	camera_state camera =
 	{
-		float x, y, z;
-		float x_rotation, y_rotation, z_rotation;
-		float movement_speed, rotation_speed;
-	} Camera;
-
-	Camera.x = NUM_VOXELS_X / 2.0f;
-	Camera.y = NUM_VOXELS_Y / 2.0f;
-	Camera.z = NUM_VOXELS_Z / 2.0f;
-	Camera.x_rotation = Camera.y_rotation = Camera.z_rotation = 0;
-	Camera.movement_speed = 10.0f;
-	Camera.rotation_speed = 70.0f;
+		.x = NUM_VOXELS_X / 2.0f,
+		.y = NUM_VOXELS_Y / 2.0f,
+		.z = NUM_VOXELS_Z / 2.0f,
+		.x_rotation = 0, .y_rotation = 0, .z_rotation = 0
+	};
 
-	float camera_translation_matrix[] =
+	/* Camera movement runs on its own thread at a fixed rate. */
+	simulation *sim = simulation_start(&camera, SIMULATION_TICK_RATE);
+	if (!sim) {
+		fprintf(stderr, "The simulation thread couldn't be started. Exiting.\n");
+		glfwTerminate();
+		return EXIT_FAILURE;
+	}
+
+	/* Everything the recorded frames need once they are replayed. */
+	struct render_state state =
 	{
-		1.0f, 0.0f, 0.0f, 0.0f,
-		0.0f, 1.0f, 0.0f, 0.0f,
-		0.0f, 0.0f, 1.0f, 0.0f,
-		0.0f, 0.0f, 0.0f, 1.0f
+		.loader = &loader, .voxel_mesher = voxel_mesher, .raymarcher = raymarcher, .scaler = scaler,
+		.verify_gpu_mesher = verify_gpu_mesher, .startup_time = startup_time,
+		.glfw_phase = glfw_phase, .glew_phase = glew_phase, .shader_phase = shader_phase,
+		.streaming_phase = streaming_phase, .program = program_id, .wireframe = wireframe
 	};
+	atomic_init(&state.world_streamed, 0);
 
-	double current_frame_time = 0, delta, previous_frame_time;
+	struct chunk_draw *chunk_draws = chunk_draws_new(loader.uploads, loader.grid,
+		pulling_program ? pulling_program : program_id, state.eye);
+	if (!chunk_draws) {
+		fprintf(stderr, "Memory allocation error.\n");
+		simulation_stop(sim);
+		glfwTerminate();
+		return EXIT_FAILURE;
+	}
+
+	struct remesher remesher;
+	if (!remesher_start(&remesher, &loader)) {
+		fprintf(stderr, "The remesher thread couldn't be started. Exiting.\n");
+		simulation_stop(sim);
+		glfwTerminate();
+		return EXIT_FAILURE;
+	}
+
+#ifdef DEBUG
+	struct debug_draw axes_draw = { &state, GL_LINES, 6 };
+	struct debug_draw points_draw = { &state, GL_POINTS, NUM_VOXELS_X * NUM_VOXELS_Y * NUM_VOXELS_Z };
+#endif
+
+	/* From here on this thread only records frames; the context belongs to the render thread. */
+	render_thread *renderer = render_thread_start(window, threaded_rendering);
+	if (!renderer) {
+		fprintf(stderr, "The render thread couldn't be started. Exiting.\n");
+		remesher_stop(&remesher);
+		simulation_stop(sim);
+		glfwTerminate();
+		return EXIT_FAILURE;
+	}
 
 	uint64_t frame = 0;
+	int32_t colliding = 0;
 
 	/* The main loop. */
 	while (!glfwWindowShouldClose(window))
 	{
 		frame++;
 
-		previous_frame_time = current_frame_time;
-		current_frame_time = glfwGetTime();
-		delta = current_frame_time - previous_frame_time;
+		uint32_t input = sample_input(window);
+		simulation_set_input(sim, input);
+
+		/* The voxels don't change once loaded, so from then on the camera can collide with them. */
+		if (!colliding && atomic_load(&loader.done)) {
+			simulation_set_world(sim, loader.grid);
+			colliding = 1;
+		}
+
+		const sim_snapshot *snapshot = simulation_latest(sim);
+		sim_snapshot_interpolate(snapshot, SIMULATION_TICK_RATE, timing_now(), &camera);
+
+		command_buffer *commands = render_thread_commands(renderer);
+		int32_t recorded = 1;
 
 		if (frame >= 100 && glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS) {
 			printf("*---* Camera Details: *---*\n");
-			printf("*-* Camera.x: %f\n", Camera.x);
-			printf("*-* Camera.y: %f\n", Camera.y);
-			printf("*-* Camera.z: %f\n", Camera.z);
-			printf("*-* Camera.x_rotation: %f\n", Camera.x_rotation);
-			printf("*-* Camera.y_rotation: %f\n", Camera.y_rotation);
-			printf("*-* Camera.z_rotation: %f\n", Camera.z_rotation);
-			printf("*-------------------------*\n\n");
+			printf("*-* Camera.x: %f\n", camera.x);
+			printf("*-* Camera.y: %f\n", camera.y);
+			printf("*-* Camera.z: %f\n", camera.z);
+			printf("*-* Camera.x_rotation: %f\n", camera.x_rotation);
+			printf("*-* Camera.y_rotation: %f\n", camera.y_rotation);
+			printf("*-* Camera.z_rotation: %f\n", camera.z_rotation);
+			if (atomic_load(&loader.done)) {
+				voxel_ray ray =
+				{
+					.origin = { camera.x, camera.y, camera.z },
+					.max_distance = 1000.0f
+				};
+				voxel_hit hit;
+				camera_forward(&camera, ray.direction);
+
+				if (voxel_raycast(loader.grid, &ray, &hit))
+					printf("*-* Looking at: voxel %" PRIu8 " at (%" PRId32 ", %" PRId32 ", %" PRId32 "), %f away\n",
+						hit.voxel, hit.x, hit.y, hit.z, hit.distance);
+				else
+					printf("*-* Looking at: nothing\n");
+			}
+			printf("*-* Draws: %" PRIu32 "\n", draws->stats.draws);
+			recorded &= command_buffer_call(commands, print_render_stats, &state);
 			frame = 0;
 		}
 
-		/* Camera rotation. */
-		if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS)
-			Camera.y_rotation += delta * Camera.rotation_speed;
-		if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS)
-			Camera.x_rotation -= delta * Camera.rotation_speed;
-		if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS)
-			Camera.x_rotation += delta * Camera.rotation_speed;
-		if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS)
-			Camera.y_rotation -= delta * Camera.rotation_speed;
-
-		if (Camera.x_rotation >= 360.0f)
-			Camera.x_rotation -= 360.0f;
-		if (Camera.x_rotation <= -360.0f)
-			Camera.x_rotation += 360.0f;
-
-		if (Camera.y_rotation >= 360.0f)
-			Camera.y_rotation -= 360.0f;
-		if (Camera.y_rotation <= -360.0f)
-			Camera.y_rotation += 360.0f;
-
-		/* Compute move vector from camera orientation */
-		float x_rotation_data[] =
-		{
-			1.0f, 0.0f, 0.0f, 0.0f,
-			0.0f, cos(RAD(Camera.x_rotation)), -sin(RAD(Camera.x_rotation)), 0.0f,
-			0.0f, sin(RAD(Camera.x_rotation)), cos(RAD(Camera.x_rotation)), 0.0f,
-			0.0f, 0.0f, 0.0f, 1.0f
-		};
+		recorded &= command_buffer_call(commands, prepare_frame, &state);
 
-		float y_rotation_data[] =
-		{
-			cos(RAD(Camera.y_rotation)), 0.0f, sin(RAD(Camera.y_rotation)), 0.0f,
-			0.0f, 1.0f, 0.0f, 0.0f,
-			-sin(RAD(Camera.y_rotation)), 0.0f, cos(RAD(Camera.y_rotation)), 0.0f,
-			0.0f, 0.0f, 0.0f, 1.0f
-		};
+		int32_t window_width, window_height;
+		glfwGetFramebufferSize(window, &window_width, &window_height);
+		struct scaled_frame scaled = { scaler, window_width, window_height };
 
-		float z_rotation_data[] =
-		{
-			cos(RAD(Camera.z_rotation)), -sin(RAD(Camera.z_rotation)), 0.0f, 0.0f,
-			sin(RAD(Camera.z_rotation)), cos(RAD(Camera.z_rotation)), 0.0f, 0.0f,
-			0.0f, 0.0f, 1.0f, 0.0f,
-			0.0f, 0.0f, 0.0f, 1.0f
-		};
+		/* A minimised window has no pixels to scale to, so it's drawn to directly. */
+		int32_t scaling = scaler && window_width > 0 && window_height > 0;
+		if (scaling)
+			recorded &= command_buffer_call_copy(commands, begin_scaled_frame, &scaled, sizeof scaled);
 
-		/* A move vector for the forward direction. */
-		sc_vec4f forward_move_vector =
-		{
-			.x = 0.0f, .y = 0.0f, .z = -Camera.movement_speed, .w = 1.0f
-		};
+		recorded &= command_buffer_clear(commands, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		recorded &= record_camera_rotation(commands, program_id, &camera);
+
+		struct eye_update eye = { &state, { camera.x, camera.y, camera.z } };
+		recorded &= command_buffer_call_copy(commands, set_eye, &eye, sizeof eye);
+
+		/* Chunks are only culled once every chunk's connections are built. */
+		const uint8_t *visible = NULL;
+		if (loader.visibility && colliding) {
+			float forward[3];
+			camera_forward(&camera, forward);
+			chunk_visibility_search(loader.visibility, eye.eye, forward);
+			visible = loader.visibility->visible;
+		}
 
-		sc_vec4f left_move_vector =
+#ifdef DEBUG
+		render_packet axes_packet =
 		{
-			.x = -Camera.movement_speed, .y = 0.0f, .z = 0.0f, .w = 1.0f
+			.key = render_key(RENDER_PASS_OPAQUE, program_id, 0.0f, axes_vao),
+			.program = program_id, .vao = axes_vao, .polygon_mode = GL_FILL,
+			.draw = draw_debug, .context = &axes_draw
 		};
-
-		sc_vec4f up_move_vector =
+		render_packet points_packet =
 		{
-			.x = 0.0f, .y = Camera.movement_speed, .z = 0.0f, .w = 1.0f
+			.key = render_key(RENDER_PASS_OPAQUE, program_id, 0.0f, voxels_vao),
+			.program = program_id, .vao = voxels_vao, .polygon_mode = GL_FILL,
+			.draw = draw_debug, .context = &points_draw
 		};
+		recorded &= render_queue_push(draws, &axes_packet) && render_queue_push(draws, &points_packet);
+#endif
 
-		sc_vec4f x_result_vector, y_result_vector, z_result_vector, result_vector;
-
-		sc_mat4f *x_rotation_mat = sc_mat4f_new(x_rotation_data);
-		assert(x_rotation_mat);
-
-		sc_mat4f *y_rotation_mat = sc_mat4f_new(y_rotation_data);
-		assert(y_rotation_mat);
-
-		sc_mat4f *z_rotation_mat = sc_mat4f_new(z_rotation_data);
-		assert(z_rotation_mat);
-
-		/* Camera translation. */
-		if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-			sc_mat4f_mulv(x_rotation_mat, &forward_move_vector, &x_result_vector);
-			sc_mat4f_mulv(y_rotation_mat, &x_result_vector, &result_vector);
-
-			Camera.x += delta * result_vector.x;
-			Camera.y += delta * result_vector.y;
-			Camera.z += delta * result_vector.z;
-		}
-		if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-			sc_mat4f_mulv(x_rotation_mat, &left_move_vector, &x_result_vector);
-			sc_mat4f_mulv(y_rotation_mat, &x_result_vector, &result_vector);
-
-			Camera.x += delta * result_vector.x;
-			Camera.y += delta * result_vector.y;
-			Camera.z += delta * result_vector.z;
-		}
-		if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-			sc_mat4f_mulv(x_rotation_mat, &forward_move_vector, &x_result_vector);
-			sc_mat4f_mulv(y_rotation_mat, &x_result_vector, &result_vector);
-
-			Camera.x -= delta * result_vector.x;
-			Camera.y -= delta * result_vector.y;
-			Camera.z -= delta * result_vector.z;
-
+		/* Whether these have anything to draw yet is only known when the frame is replayed. */
+		if (raymarcher) {
+			recorded &= record_camera_uniforms(commands, raymarcher->program, &camera);
+
+			render_packet packet =
+			{
+				.key = render_key(RENDER_PASS_OPAQUE, raymarcher->program, 0.0f, raymarcher->vao),
+				.program = raymarcher->program, .vao = raymarcher->vao, .polygon_mode = GL_FILL,
+				.draw = draw_raymarcher, .context = &state
+			};
+			recorded &= render_queue_push(draws, &packet);
+		} else if (voxel_mesher) {
+			render_packet packet =
+			{
+				.key = render_key(RENDER_PASS_WIREFRAME, program_id, 0.0f, voxel_mesher->vao),
+				.program = program_id, .vao = voxel_mesher->vao, .polygon_mode = mesh_polygon_mode,
+				.draw = draw_gpu_mesh, .context = &state
+			};
+			recorded &= render_queue_push(draws, &packet);
+		} else if (pulling_program) {
+			recorded &= record_camera_rotation(commands, pulling_program, &camera);
+			recorded &= queue_chunks(draws, pulling_program, mesh_polygon_mode, chunk_draws, &remesher, visible, &camera);
+		} else {
+			recorded &= queue_chunks(draws, program_id, mesh_polygon_mode, chunk_draws, &remesher, visible, &camera);
 		}
-		if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-			sc_mat4f_mulv(x_rotation_mat, &left_move_vector, &x_result_vector);
-			sc_mat4f_mulv(y_rotation_mat, &x_result_vector, &result_vector);
 
-			Camera.x -= delta * result_vector.x;
-			Camera.y -= delta * result_vector.y;
-			Camera.z -= delta * result_vector.z;
+		recorded &= render_queue_record(draws, commands);
+		if (scaling)
+			recorded &= command_buffer_call_copy(commands, end_scaled_frame, &scaled, sizeof scaled);
+		recorded &= command_buffer_call(commands, finish_frame, &state);
+		if (!recorded)
+			atomic_store(&loader.failed, 1);
+
+		/* Replayed while the next frame is recorded. */
+		render_thread_submit(renderer);
+
+		if (pacer.mode == PACING_ON_DEMAND) {
+			/* Sleep until there is input, a resize or an exposed window. */
+			redraw_requested = 0;
+			glfwPollEvents();
+			if (!input && !camera_settling(snapshot) && atomic_load(&state.world_streamed)) {
+				while (!redraw_requested && !glfwWindowShouldClose(window))
+					glfwWaitEvents();
+			}
+		} else {
+			frame_pacer_wait(&pacer);
+			glfwPollEvents();
 		}
-		if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS) {
-			sc_mat4f_mulv(x_rotation_mat, &up_move_vector, &x_result_vector);
-			sc_mat4f_mulv(y_rotation_mat, &x_result_vector, &result_vector);
 
-			Camera.x += delta * result_vector.x;
-			Camera.y += delta * result_vector.y;
-			Camera.z += delta * result_vector.z;
+		if (atomic_load(&loader.failed)) {
+			fprintf(stderr, "Memory allocation error.\n");
+			break;
 		}
-//		if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
-//			Camera.y -= delta * Camera.movement_speed;
-
-
-		free(x_rotation_mat);
-		free(y_rotation_mat);
-		free(z_rotation_mat);
-
-		camera_translation_matrix[3] = -Camera.x;
-		camera_translation_matrix[7] = -Camera.y;
-		camera_translation_matrix[11] = -Camera.z;
-
-		float x_rotation_inverse[] =
-		{
-			1.0f, 0.0f, 0.0f, 0.0f,
-			0.0f, cos(RAD(-Camera.x_rotation)), -sin(RAD(-Camera.x_rotation)), 0.0f,
-			0.0f, sin(RAD(-Camera.x_rotation)), cos(RAD(-Camera.x_rotation)), 0.0f,
-			0.0f, 0.0f, 0.0f, 1.0f
-		};
-
-		float y_rotation_inverse[] =
-		{
-			cos(RAD(-Camera.y_rotation)), 0.0f, sin(RAD(-Camera.y_rotation)), 0.0f,
-			0.0f, 1.0f, 0.0f, 0.0f,
-			-sin(RAD(-Camera.y_rotation)), 0.0f, cos(RAD(-Camera.y_rotation)), 0.0f,
-			0.0f, 0.0f, 0.0f, 1.0f
-		};
-
-		glUniformMatrix4fv(
-			glGetUniformLocation(program_id, "camera_translation_matrix"),
-			1, GL_TRUE, camera_translation_matrix);
+	}
 
-		glUniformMatrix4fv(
-			glGetUniformLocation(program_id, "camera_x_rotation_matrix"),
-			1, GL_TRUE, x_rotation_inverse);
+	render_thread_stop(renderer);
 
-		glUniformMatrix4fv(
-			glGetUniformLocation(program_id, "camera_y_rotation_matrix"),
-			1, GL_TRUE, y_rotation_inverse);
+	printf("Exiting.\n");
 
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	simulation_stop(sim);
+	remesher_stop(&remesher);
+	pthread_join(loader_thread, NULL);
+	upload_queue_free(loader.uploads);
+	gpu_mesher_free(voxel_mesher);
+	voxel_raymarcher_free(raymarcher);
+	resolution_scaler_free(scaler);
+	material_palette_free(palette);
+	render_queue_free(draws);
+	free(chunk_draws);
 
 #ifdef DEBUG
-		glBindVertexArray(axes_vao);
-		glDrawArrays(GL_LINES, 0, 6);
-
-		glBindVertexArray(voxels_vao);
-		glDrawArrays(GL_POINTS, 0, NUM_VOXELS_X * NUM_VOXELS_Y * NUM_VOXELS_Z);
+	gl_state_delete_vertex_array(voxels_vao);
+	gl_state_delete_vertex_array(axes_vao);
+	gpu_memory_buffer_delete(voxels_vbo);
+	gpu_memory_buffer_delete(axes_vbo);
 #endif
 
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-		glBindVertexArray(voxel_vao);
-		glDrawArrays(GL_TRIANGLES, 0, num_voxel_vertices);
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-
-		glfwSwapBuffers(window);
-		glfwPollEvents();
-	}
-
-	printf("Exiting.\n");
+	gpu_memory_stats memory = gpu_memory_get_stats();
+	printf("Peak GPU buffer memory: %" PRIu64 " bytes", memory.total_peak);
+	if (memory.buffers)
+		printf(", %" PRIu32 " buffers (%" PRIu64 " bytes) never deleted", memory.buffers, memory.total);
+	printf(".\n");
 
+	gl_state_delete_program(program_id);
+	gl_state_delete_program(pulling_program);
 	glDeleteShader(fragment_shader_id);
 	glDeleteShader(vertex_shader_id);
 	glfwTerminate();
 
+	chunk_visibility_free(loader.visibility);
+	voxel_light_free(loader.light);
+	voxel_grid_free(loader.grid);
+
 	return EXIT_SUCCESS;
 }
 
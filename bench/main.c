@@ -0,0 +1,517 @@
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../collision.h"
+#include "../light.h"
+#include "../mesher.h"
+#include "../sc_mat4f.h"
+#include "../sc_vec4f.h"
+#include "../simulation.h"
+#include "../terrain.h"
+#include "../timing.h"
+#include "../visibility.h"
+#include "../voxel.h"
+
+#define RAD(x) (x * 0.0174532925)
+
+/* Voxels along each side of the worlds unless --size says otherwise. */
+#define DEFAULT_SIZE 128
+
+/* Timed runs of each kernel unless --reps says otherwise. */
+#define DEFAULT_REPS 15
+
+/* Calls per timed run of the math kernels, which take nanoseconds each. */
+#define MATH_CALLS 1000000
+
+/* Boxes moved per timed run of the collision kernel. */
+#define BOXES 4096
+
+/* Voxels changed and changed back per timed run of the light edit kernel. */
+#define LIGHT_EDITS 256
+
+/* Camera positions searched from per timed run of the visibility kernel. */
+#define SEARCHES 64
+
+/* Keeps the compiler from dropping results nobody reads. */
+static volatile float sink;
+
+/* The current world's light, which the meshing kernels bake in as Demo.c's loader does. */
+static voxel_light *light;
+
+/* The current world's chunk connections, for the visibility search. */
+static chunk_visibility *visibility;
+
+static uint32_t xorshift(uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+static void fill_solid(voxel_grid *grid)
+{
+	voxel_grid_fill_solid(grid);
+}
+
+/* Half the voxels solid, from a fixed xorshift sequence so every run meshes the same world. */
+static void fill_random(voxel_grid *grid)
+{
+	uint32_t state = 2463534242u;
+	int32_t x, y, z;
+
+	for (x = 0; x < grid->size_x; x++) {
+		for (y = 0; y < grid->size_y; y++) {
+			for (z = 0; z < grid->size_z; z++) {
+				voxel_grid_set(grid, x, y, z, xorshift(&state) & 1 ? VOXEL_STONE : VOXEL_EMPTY);
+			}
+		}
+	}
+}
+
+static void fill_terrain(voxel_grid *grid)
+{
+	terrain_params params;
+	terrain_params_default(&params, 1, grid->size_y);
+	terrain_generate(grid, &params);
+}
+
+/* Every other voxel solid: the most faces a grid can have, six for each solid voxel. */
+static void fill_checkerboard(voxel_grid *grid)
+{
+	int32_t x, y, z;
+
+	for (x = 0; x < grid->size_x; x++)
+		for (y = 0; y < grid->size_y; y++)
+			for (z = 0; z < grid->size_z; z++)
+				voxel_grid_set(grid, x, y, z, (x + y + z) & 1 ? VOXEL_STONE : VOXEL_EMPTY);
+}
+
+struct world
+{
+	const char *name;
+	void (*fill)(voxel_grid *grid);
+};
+
+static const struct world worlds[] =
+{
+	{ "solid", fill_solid },
+	{ "random", fill_random },
+	{ "terrain", fill_terrain },
+	{ "checkerboard", fill_checkerboard }
+};
+
+/*
+ * One timed run of a kernel. Returns the operations it did and adds the
+ * faces it made, if any, to faces.
+ */
+typedef uint64_t (*kernel_fn)(const voxel_grid *grid, uint64_t *faces);
+
+/* Mesh every chunk the way Demo.c's loader does, one fresh mesh per chunk, on this thread only. */
+static uint64_t mesh_chunks(const voxel_grid *grid, uint64_t *faces, int32_t records)
+{
+	uint32_t chunk, num_chunks = voxel_grid_num_chunks(grid);
+
+	for (chunk = 0; chunk < num_chunks; chunk++) {
+		chunk_mesh *mesh = chunk_mesh_new();
+		if (!mesh) {
+			fprintf(stderr, "Memory allocation error.\n");
+			exit(EXIT_FAILURE);
+		}
+
+		int32_t cx, cy, cz;
+		voxel_grid_chunk_coords(grid, chunk, &cx, &cy, &cz);
+		if (records)
+			mesher_mesh_chunk_faces(grid, light, cx, cy, cz, mesh);
+		else
+			mesher_mesh_chunk(grid, light, cx, cy, cz, mesh);
+
+		*faces += chunk_mesh_num_vertices(mesh) / 6;
+		chunk_mesh_free(mesh);
+	}
+
+	return num_chunks;
+}
+
+static uint64_t mesh_vertices(const voxel_grid *grid, uint64_t *faces)
+{
+	return mesh_chunks(grid, faces, 0);
+}
+
+static uint64_t mesh_records(const voxel_grid *grid, uint64_t *faces)
+{
+	return mesh_chunks(grid, faces, 1);
+}
+
+/* Rebuild the brick masks. This one runs on parallel.c's workers, as it does in Demo.c. */
+static uint64_t build_occupancy(const voxel_grid *grid, uint64_t *faces)
+{
+	voxel_grid_build_occupancy((voxel_grid *) grid);
+	return voxel_grid_num_chunks(grid);
+}
+
+/* Light the whole world from scratch, on parallel.c's workers as in Demo.c. */
+static uint64_t build_light(const voxel_grid *grid, uint64_t *faces)
+{
+	if (!voxel_light_build(light, grid)) {
+		fprintf(stderr, "Memory allocation error.\n");
+		exit(EXIT_FAILURE);
+	}
+	return voxel_grid_num_chunks(grid);
+}
+
+/*
+ * Put lamps at scattered voxels, updating the light after each, and then
+ * put back what was there, so every run starts from the same world.
+ */
+static uint64_t edit_light(const voxel_grid *grid, uint64_t *faces)
+{
+	voxel_grid *edited = (voxel_grid *) grid;
+	int32_t x[LIGHT_EDITS], y[LIGHT_EDITS], z[LIGHT_EDITS];
+	uint8_t previous[LIGHT_EDITS];
+	uint32_t state = 362436069u;
+	int32_t i, ok = 1;
+
+	for (i = 0; i < LIGHT_EDITS; i++) {
+		x[i] = xorshift(&state) % grid->size_x;
+		y[i] = xorshift(&state) % grid->size_y;
+		z[i] = xorshift(&state) % grid->size_z;
+		previous[i] = voxel_grid_get(grid, x[i], y[i], z[i]);
+		voxel_grid_set(edited, x[i], y[i], z[i], VOXEL_LAMP);
+		ok &= voxel_light_update(light, grid, x[i], y[i], z[i]);
+	}
+
+	for (i = LIGHT_EDITS - 1; i >= 0; i--) {
+		voxel_grid_set(edited, x[i], y[i], z[i], previous[i]);
+		ok &= voxel_light_update(light, grid, x[i], y[i], z[i]);
+	}
+
+	if (!ok) {
+		fprintf(stderr, "Memory allocation error.\n");
+		exit(EXIT_FAILURE);
+	}
+	return 2 * LIGHT_EDITS;
+}
+
+/* Work out which faces of each chunk are joined, on this thread only. */
+static uint64_t build_connectivity(const voxel_grid *grid, uint64_t *faces)
+{
+	uint32_t chunk, num_chunks = voxel_grid_num_chunks(grid);
+	for (chunk = 0; chunk < num_chunks; chunk++)
+		chunk_visibility_build_chunk(visibility, grid, chunk);
+	return num_chunks;
+}
+
+/* Search for the visible chunks from scattered positions inside the grid, looking along the diagonal. */
+static uint64_t search_visibility(const voxel_grid *grid, uint64_t *faces)
+{
+	static const float forward[3] = { 0.57735027f, 0.57735027f, 0.57735027f };
+	uint32_t state = 521288629u, i, visible = 0;
+
+	for (i = 0; i < SEARCHES; i++) {
+		double eye[3] = { xorshift(&state) % grid->size_x, xorshift(&state) % grid->size_y,
+			xorshift(&state) % grid->size_z };
+		visible += chunk_visibility_search(visibility, eye, forward);
+	}
+
+	sink = visible;
+	return SEARCHES;
+}
+
+/*
+ * One tick of entity movement: person-sized boxes scattered over the grid,
+ * each moved up to half a voxel along every axis, as simulation.c moves the
+ * camera. The time per box shouldn't grow with the grid.
+ */
+static uint64_t move_boxes(const voxel_grid *grid, uint64_t *faces)
+{
+	uint32_t state = 88675123u, i;
+	double sum = 0.0;
+
+	for (i = 0; i < BOXES; i++) {
+		voxel_box box = { .half_size = { 0.3f, 0.9f, 0.3f } };
+		double motion[3];
+		box.centre[0] = xorshift(&state) / (double) UINT32_MAX * grid->size_x;
+		box.centre[1] = xorshift(&state) / (double) UINT32_MAX * grid->size_y;
+		box.centre[2] = xorshift(&state) / (double) UINT32_MAX * grid->size_z;
+		motion[0] = xorshift(&state) / (double) UINT32_MAX - 0.5;
+		motion[1] = xorshift(&state) / (double) UINT32_MAX - 0.5;
+		motion[2] = xorshift(&state) / (double) UINT32_MAX - 0.5;
+
+		voxel_box_move(grid, &box, motion);
+		sum += box.centre[0] + box.centre[1] + box.centre[2];
+	}
+
+	sink = sum;
+	return BOXES;
+}
+
+/* simulation.c moves the camera by rotating vectors with sc_mat4f_mulv every tick. */
+static uint64_t mat4_mulv(const voxel_grid *grid, uint64_t *faces)
+{
+	float data[] =
+	{
+		0.8f, 0.0f, 0.6f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		-0.6f, 0.0f, 0.8f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f
+	};
+	sc_mat4f *matrix = sc_mat4f_new(data);
+	if (!matrix) {
+		fprintf(stderr, "Memory allocation error.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	sc_vec4f vector = { 0.0f, 0.0f, -1.0f, 0.0f }, result;
+	float sum = 0.0f;
+
+	uint32_t i;
+	for (i = 0; i < MATH_CALLS; i++) {
+		vector.x = i * 1e-6f;
+		sc_mat4f_mulv(matrix, &vector, &result);
+		sum += result.x;
+	}
+
+	sink = sum;
+	free(matrix);
+	return MATH_CALLS;
+}
+
+/* The two sin/cos matrices Demo.c builds for every mesh program every frame, and simulation.c every tick. */
+static uint64_t rotation_matrices(const voxel_grid *grid, uint64_t *faces)
+{
+	float sum = 0.0f;
+
+	uint32_t i;
+	for (i = 0; i < MATH_CALLS; i++) {
+		float x_rotation = i * 1e-4f, y_rotation = i * 2e-4f;
+
+		float x_rotation_inverse[] =
+		{
+			1.0f, 0.0f, 0.0f, 0.0f,
+			0.0f, cos(RAD(-x_rotation)), -sin(RAD(-x_rotation)), 0.0f,
+			0.0f, sin(RAD(-x_rotation)), cos(RAD(-x_rotation)), 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f
+		};
+
+		float y_rotation_inverse[] =
+		{
+			cos(RAD(-y_rotation)), 0.0f, sin(RAD(-y_rotation)), 0.0f,
+			0.0f, 1.0f, 0.0f, 0.0f,
+			-sin(RAD(-y_rotation)), 0.0f, cos(RAD(-y_rotation)), 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f
+		};
+
+		/* Every element, so none of the matrix build can be left out. */
+		uint32_t j;
+		for (j = 0; j < 16; j++)
+			sum += x_rotation_inverse[j] + y_rotation_inverse[j];
+	}
+
+	sink = sum;
+	return MATH_CALLS;
+}
+
+static uint64_t forward_vectors(const voxel_grid *grid, uint64_t *faces)
+{
+	camera_state camera = { 0 };
+	float forward[3], sum = 0.0f;
+
+	uint32_t i;
+	for (i = 0; i < MATH_CALLS; i++) {
+		camera.x_rotation = i * 1e-4f;
+		camera.y_rotation = i * 2e-4f;
+		camera_forward(&camera, forward);
+		sum += forward[0];
+	}
+
+	sink = sum;
+	return MATH_CALLS;
+}
+
+struct kernel
+{
+	const char *name;
+	kernel_fn run;
+	int32_t per_world;	/* Runs on each world rather than once. */
+	int32_t per_voxel;	/* Its time grows with the grid, so voxels a second mean something. */
+};
+
+static const struct kernel kernels[] =
+{
+	{ "mesh vertices", mesh_vertices, 1, 1 },
+	{ "mesh records", mesh_records, 1, 1 },
+	{ "occupancy", build_occupancy, 1, 1 },
+	{ "box moves", move_boxes, 1, 0 },
+	{ "light", build_light, 1, 1 },
+	{ "light edits", edit_light, 1, 0 },
+	{ "connectivity", build_connectivity, 1, 1 },
+	{ "visibility", search_visibility, 1, 0 },
+	{ "mat4 mulv", mat4_mulv, 0, 0 },
+	{ "rotation matrices", rotation_matrices, 0, 0 },
+	{ "camera forward", forward_vectors, 0, 0 }
+};
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Run the kernel once untimed to warm the caches and allocator, then reps
+ * times, and print the median time with the spread around it. Throughput
+ * is worked out from the median. If json is given, the results are written
+ * to it as well, one object per line, for perf/run.sh.
+ */
+static int32_t measure(const struct kernel *kernel, const char *world, const voxel_grid *grid, int32_t reps,
+	FILE *json)
+{
+	double *times = malloc(reps * sizeof *times);
+	if (!times)
+		return 0;
+
+	uint64_t faces = 0;
+	uint64_t ops = kernel->run(grid, &faces);
+
+	int32_t rep;
+	for (rep = 0; rep < reps; rep++) {
+		faces = 0;
+		double start = timing_now();
+		ops = kernel->run(grid, &faces);
+		times[rep] = timing_now() - start;
+	}
+
+	qsort(times, reps, sizeof *times, compare_doubles);
+	double median = times[reps / 2];
+	double p95 = times[(reps * 95 - 1) / 100];
+
+	double mean = 0.0, variance = 0.0;
+	for (rep = 0; rep < reps; rep++)
+		mean += times[rep] / reps;
+	for (rep = 0; rep < reps; rep++)
+		variance += (times[rep] - mean) * (times[rep] - mean) / reps;
+
+	double voxels = grid ? (double) grid->size_x * grid->size_y * grid->size_z : 0.0;
+
+	printf("%-13s %-18s %10.3f %10.3f %10.3f %6.1f%%", world, kernel->name, times[0] * 1e3, median * 1e3,
+		p95 * 1e3, mean > 0.0 ? sqrt(variance) / mean * 100.0 : 0.0);
+	if (grid && kernel->per_voxel)
+		printf(" %12.3e", voxels / median);
+	else
+		printf(" %12s", "-");
+	if (faces)
+		printf(" %12.3e", faces / median);
+	else
+		printf(" %12s", "-");
+	printf(" %12.1f\n", median * 1e9 / ops);
+
+	if (json) {
+		fprintf(json, "{\"name\": \"bench/%s/%s\", \"median_ms\": %.4f, \"p95_ms\": %.4f, \"ns_per_op\": %.2f",
+			world, kernel->name, median * 1e3, p95 * 1e3, median * 1e9 / ops);
+		if (grid && kernel->per_voxel)
+			fprintf(json, ", \"voxels_per_s\": %.4e", voxels / median);
+		if (faces)
+			fprintf(json, ", \"faces_per_s\": %.4e", faces / median);
+		fprintf(json, "}\n");
+	}
+
+	free(times);
+	return 1;
+}
+
+int32_t main(int32_t num_args, char **args)
+{
+	int32_t size = DEFAULT_SIZE, reps = DEFAULT_REPS;
+	const char *only = NULL;
+	FILE *json = NULL;
+
+	int32_t arg;
+	for (arg = 1; arg < num_args; arg++) {
+		if (!strncmp(args[arg], "--size=", 7)) {
+			char *end;
+			size = strtol(args[arg] + 7, &end, 10);
+			if (*end == '\0' && size > 0)
+				continue;
+		}
+
+		if (!strncmp(args[arg], "--reps=", 7)) {
+			char *end;
+			reps = strtol(args[arg] + 7, &end, 10);
+			if (*end == '\0' && reps > 0)
+				continue;
+		}
+
+		if (!strncmp(args[arg], "--world=", 8)) {
+			only = args[arg] + 8;
+			continue;
+		}
+
+		if (!strncmp(args[arg], "--json=", 7) && args[arg][7]) {
+			if (json)
+				fclose(json);
+			json = fopen(args[arg] + 7, "w");
+			if (json)
+				continue;
+			fprintf(stderr, "Couldn't open %s for writing.\n", args[arg] + 7);
+			return EXIT_FAILURE;
+		}
+
+		fprintf(stderr, "Usage: %s [--size=<voxels>] [--reps=<n>] [--world=solid|random|terrain|checkerboard]"
+			" [--json=<file>]\n", args[0]);
+		return EXIT_FAILURE;
+	}
+
+	printf("%" PRId32 "^3 voxels, %" PRId32 " runs each. Times in ms; ns/op is per chunk, box, edit, search or call.\n",
+		size, reps);
+	printf("%-13s %-18s %10s %10s %10s %7s %12s %12s %12s\n", "World", "Kernel", "Min", "Median", "p95", "Spread",
+		"Voxels/s", "Faces/s", "ns/op");
+
+	uint32_t world, kernel;
+	for (world = 0; world < sizeof worlds / sizeof *worlds; world++) {
+		if (only && strcmp(only, worlds[world].name))
+			continue;
+
+		voxel_grid *grid = voxel_grid_new(size, size, size);
+		light = grid ? voxel_light_new(grid) : NULL;
+		visibility = grid ? chunk_visibility_new(grid) : NULL;
+		if (!light || !visibility) {
+			fprintf(stderr, "Memory allocation error.\n");
+			return EXIT_FAILURE;
+		}
+
+		worlds[world].fill(grid);
+		voxel_grid_build_occupancy(grid);
+		if (!voxel_light_build(light, grid)) {
+			fprintf(stderr, "Memory allocation error.\n");
+			return EXIT_FAILURE;
+		}
+		build_connectivity(grid, NULL);
+
+		for (kernel = 0; kernel < sizeof kernels / sizeof *kernels; kernel++)
+			if (kernels[kernel].per_world && !measure(&kernels[kernel], worlds[world].name, grid, reps, json)) {
+				fprintf(stderr, "Memory allocation error.\n");
+				chunk_visibility_free(visibility);
+				voxel_light_free(light);
+				voxel_grid_free(grid);
+				return EXIT_FAILURE;
+			}
+
+		chunk_visibility_free(visibility);
+		voxel_light_free(light);
+		voxel_grid_free(grid);
+	}
+
+	for (kernel = 0; kernel < sizeof kernels / sizeof *kernels; kernel++)
+		if (!kernels[kernel].per_world && !measure(&kernels[kernel], "math", NULL, reps, json)) {
+			fprintf(stderr, "Memory allocation error.\n");
+			return EXIT_FAILURE;
+		}
+
+	if (json)
+		fclose(json);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,116 @@
+#include <math.h>
+
+#include "collision.h"
+
+/* How far short of a solid voxel a blocked box stops, so rounding can't put it inside. */
+#define SKIN 1e-4
+
+/* The first and last cells a box from low to high overlaps on an axis. Cell c spans c - 0.5 to c + 0.5. */
+static int32_t first_cell(double low)
+{
+	return (int32_t) floor(low + 0.5);
+}
+
+static int32_t last_cell(double high)
+{
+	return (int32_t) ceil(high + 0.5) - 1;
+}
+
+static int32_t max_i32(int32_t a, int32_t b)
+{
+	return a > b ? a : b;
+}
+
+static int32_t min_i32(int32_t a, int32_t b)
+{
+	return a < b ? a : b;
+}
+
+/*
+ * Whether any voxel from low to high, inclusive, is solid. The region is
+ * visited brick by brick, and a brick's voxels are only read if its chunk's
+ * mask says it has any.
+ */
+static int32_t region_solid(const voxel_grid *grid, const int32_t *low, const int32_t *high)
+{
+	int32_t size[3] = { grid->size_x, grid->size_y, grid->size_z };
+	int32_t lo[3], hi[3], i;
+
+	for (i = 0; i < 3; i++) {
+		lo[i] = max_i32(low[i], 0);
+		hi[i] = min_i32(high[i], size[i] - 1);
+		if (lo[i] > hi[i])
+			return 0;
+	}
+
+	int32_t bx, by, bz, x, y, z;
+	for (bx = lo[0] / BRICK_SIZE * BRICK_SIZE; bx <= hi[0]; bx += BRICK_SIZE) {
+		for (by = lo[1] / BRICK_SIZE * BRICK_SIZE; by <= hi[1]; by += BRICK_SIZE) {
+			for (bz = lo[2] / BRICK_SIZE * BRICK_SIZE; bz <= hi[2]; bz += BRICK_SIZE) {
+				if (!(voxel_grid_chunk_mask(grid, bx, by, bz) >> voxel_grid_brick_bit(bx, by, bz) & 1))
+					continue;
+
+				for (x = max_i32(bx, lo[0]); x <= min_i32(bx + BRICK_SIZE - 1, hi[0]); x++)
+					for (y = max_i32(by, lo[1]); y <= min_i32(by + BRICK_SIZE - 1, hi[1]); y++)
+						for (z = max_i32(bz, lo[2]); z <= min_i32(bz + BRICK_SIZE - 1, hi[2]); z++)
+							if (voxel_grid_get(grid, x, y, z))
+								return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* How far the box can go of distance along axis before its leading face meets a solid voxel. */
+static double sweep(const voxel_grid *grid, const voxel_box *box, int32_t axis, double distance)
+{
+	int32_t low[3], high[3], i;
+	for (i = 0; i < 3; i++) {
+		low[i] = first_cell(box->centre[i] - box->half_size[i]);
+		high[i] = last_cell(box->centre[i] + box->half_size[i]);
+	}
+
+	/* The layers of cells the leading face moves into, nearest first. */
+	int32_t step = distance > 0.0 ? 1 : -1;
+	double face = box->centre[axis] + step * box->half_size[axis];
+	int32_t from = step > 0 ? high[axis] + 1 : low[axis] - 1;
+	int32_t to = step > 0 ? last_cell(face + distance) : first_cell(face + distance);
+	if ((to - from) * step < 0)
+		return distance;
+
+	/* Usually all of it is empty, and often the masks alone say so. */
+	low[axis] = min_i32(from, to);
+	high[axis] = max_i32(from, to);
+	if (!region_solid(grid, low, high))
+		return distance;
+
+	int32_t layer;
+	for (layer = from; layer != to + step; layer += step) {
+		low[axis] = high[axis] = layer;
+		if (region_solid(grid, low, high)) {
+			double allowed = layer - step * (0.5 + SKIN) - face;
+			return step > 0 ? fmax(allowed, 0.0) : fmin(allowed, 0.0);
+		}
+	}
+
+	return distance;
+}
+
+uint32_t voxel_box_move(const voxel_grid *grid, voxel_box *box, const double *motion)
+{
+	uint32_t blocked = 0;
+
+	int32_t axis;
+	for (axis = 0; axis < 3; axis++) {
+		if (motion[axis] == 0.0)
+			continue;
+
+		double moved = sweep(grid, box, axis, motion[axis]);
+		if (moved != motion[axis])
+			blocked |= 1u << axis;
+		box->centre[axis] += moved;
+	}
+
+	return blocked;
+}
@@ -0,0 +1,32 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <stdint.h>
+
+#include "voxel.h"
+
+/*
+ * An axis-aligned box in the same space as rays (see raycast.h), by its
+ * centre and its half size on each axis. The centre is a double like the
+ * camera's, so boxes far from the origin move as precisely as near it.
+ */
+typedef struct
+{
+	double centre[3];
+	float half_size[3];
+} voxel_box;
+
+/*
+ * Move the box by motion, stopping it just short of solid voxels. The motion
+ * is swept one axis at a time, so a box blocked on one axis still slides
+ * along the others. Voxels the box already overlaps don't block it, so it
+ * can always get out of them, and there is nothing solid outside the grid.
+ * Returns the blocked axes as bits, 1 for x, 2 for y and 4 for z.
+ *
+ * The swept space is checked chunk by chunk and brick by brick against the
+ * brick masks, which must be up to date, before any voxel is read. The cost
+ * follows the box's size and the distance moved, not the size of the grid.
+ */
+uint32_t voxel_box_move(const voxel_grid *grid, voxel_box *box, const double *motion);
+
+#endif
@@ -0,0 +1,223 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "command_buffer.h"
+#include "gl_state.h"
+
+typedef enum
+{
+	COMMAND_CLEAR,
+	COMMAND_USE_PROGRAM,
+	COMMAND_BIND_VERTEX_ARRAY,
+	COMMAND_POLYGON_MODE,
+	COMMAND_DRAW_ARRAYS,
+	COMMAND_UNIFORM_MATRIX4FV,
+	COMMAND_CALL,
+	COMMAND_CALL_COPY
+} command_type;
+
+/* Every command starts with this; size covers the header, the payload and padding. */
+struct header
+{
+	uint32_t type;
+	uint32_t size;
+};
+
+struct draw_arrays
+{
+	GLenum primitive;
+	GLint first;
+	GLsizei count;
+};
+
+struct uniform_matrix4fv
+{
+	GLuint program;
+	GLboolean transpose;
+	const GLchar *name;
+	GLfloat value[16];
+};
+
+struct call
+{
+	void (*fn)(const void *context);
+	const void *context;
+};
+
+/* Commands are kept aligned for the largest thing a payload holds. */
+#define ALIGNMENT 8
+#define ALIGN(size) (((size) + ALIGNMENT - 1) & ~(size_t) (ALIGNMENT - 1))
+
+command_buffer *command_buffer_new(void)
+{
+	return calloc(1, sizeof(command_buffer));
+}
+
+void command_buffer_free(command_buffer *commands)
+{
+	if (!commands)
+		return;
+
+	free(commands->data);
+	free(commands);
+}
+
+void command_buffer_reset(command_buffer *commands)
+{
+	commands->size = 0;
+	commands->num_commands = 0;
+}
+
+/* Append a command with room for size bytes of payload, returning the payload or NULL. */
+static void *append(command_buffer *commands, command_type type, size_t size)
+{
+	size_t total = sizeof(struct header) + ALIGN(size);
+
+	if (commands->size + total > commands->capacity) {
+		size_t capacity = commands->capacity ? commands->capacity : 4096;
+		while (capacity < commands->size + total)
+			capacity *= 2;
+
+		uint8_t *data = realloc(commands->data, capacity);
+		if (!data)
+			return NULL;
+		commands->data = data;
+		commands->capacity = capacity;
+	}
+
+	struct header *header = (struct header *) (commands->data + commands->size);
+	header->type = type;
+	header->size = total;
+	commands->size += total;
+	commands->num_commands++;
+
+	return header + 1;
+}
+
+/* For the commands whose payload is one GL value. */
+static int32_t append_uint(command_buffer *commands, command_type type, GLuint value)
+{
+	GLuint *payload = append(commands, type, sizeof value);
+	if (!payload)
+		return 0;
+
+	*payload = value;
+	return 1;
+}
+
+int32_t command_buffer_clear(command_buffer *commands, GLbitfield mask)
+{
+	return append_uint(commands, COMMAND_CLEAR, mask);
+}
+
+int32_t command_buffer_use_program(command_buffer *commands, GLuint program)
+{
+	return append_uint(commands, COMMAND_USE_PROGRAM, program);
+}
+
+int32_t command_buffer_bind_vertex_array(command_buffer *commands, GLuint vao)
+{
+	return append_uint(commands, COMMAND_BIND_VERTEX_ARRAY, vao);
+}
+
+int32_t command_buffer_polygon_mode(command_buffer *commands, GLenum mode)
+{
+	return append_uint(commands, COMMAND_POLYGON_MODE, mode);
+}
+
+int32_t command_buffer_draw_arrays(command_buffer *commands, GLenum primitive, GLint first, GLsizei count)
+{
+	struct draw_arrays *payload = append(commands, COMMAND_DRAW_ARRAYS, sizeof *payload);
+	if (!payload)
+		return 0;
+
+	payload->primitive = primitive;
+	payload->first = first;
+	payload->count = count;
+	return 1;
+}
+
+int32_t command_buffer_uniform_matrix4fv(command_buffer *commands, GLuint program, const GLchar *name,
+	GLboolean transpose, const GLfloat *value)
+{
+	struct uniform_matrix4fv *payload = append(commands, COMMAND_UNIFORM_MATRIX4FV, sizeof *payload);
+	if (!payload)
+		return 0;
+
+	payload->program = program;
+	payload->transpose = transpose;
+	payload->name = name;
+	memcpy(payload->value, value, sizeof payload->value);
+	return 1;
+}
+
+int32_t command_buffer_call(command_buffer *commands, void (*fn)(const void *context), const void *context)
+{
+	struct call *payload = append(commands, COMMAND_CALL, sizeof *payload);
+	if (!payload)
+		return 0;
+
+	payload->fn = fn;
+	payload->context = context;
+	return 1;
+}
+
+int32_t command_buffer_call_copy(command_buffer *commands, void (*fn)(const void *data),
+	const void *data, size_t size)
+{
+	/* The copy follows the function, at the next aligned offset. */
+	struct call *payload = append(commands, COMMAND_CALL_COPY, ALIGN(sizeof *payload) + size);
+	if (!payload)
+		return 0;
+
+	payload->fn = fn;
+	payload->context = NULL;
+	memcpy((uint8_t *) payload + ALIGN(sizeof *payload), data, size);
+	return 1;
+}
+
+void command_buffer_execute(const command_buffer *commands)
+{
+	size_t offset = 0;
+
+	while (offset < commands->size) {
+		const struct header *header = (const struct header *) (commands->data + offset);
+		const void *payload = header + 1;
+		offset += header->size;
+
+		switch (header->type) {
+		case COMMAND_CLEAR:
+			glClear(*(const GLuint *) payload);
+			break;
+		case COMMAND_USE_PROGRAM:
+			gl_state_use_program(*(const GLuint *) payload);
+			break;
+		case COMMAND_BIND_VERTEX_ARRAY:
+			gl_state_bind_vertex_array(*(const GLuint *) payload);
+			break;
+		case COMMAND_POLYGON_MODE:
+			gl_state_polygon_mode(*(const GLuint *) payload);
+			break;
+		case COMMAND_DRAW_ARRAYS: {
+			const struct draw_arrays *draw = payload;
+			glDrawArrays(draw->primitive, draw->first, draw->count);
+			break;
+		}
+		case COMMAND_UNIFORM_MATRIX4FV: {
+			const struct uniform_matrix4fv *uniform = payload;
+			gl_state_uniform_matrix4fv(uniform->program, uniform->name, uniform->transpose, uniform->value);
+			break;
+		}
+		case COMMAND_CALL: {
+			const struct call *call = payload;
+			call->fn(call->context);
+			break;
+		}
+		case COMMAND_CALL_COPY: {
+			const struct call *call = payload;
+			call->fn((const uint8_t *) payload + ALIGN(sizeof *call));
+			break;
+		}
+		}
+	}
+}
@@ -0,0 +1,53 @@
+#ifndef COMMAND_BUFFER_H
+#define COMMAND_BUFFER_H
+
+#include <GL/glew.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A frame's GL work written down as a list of small commands, so one thread
+ * can prepare a frame while another replays the one before into the
+ * context. Values are copied in as they are recorded, except where noted.
+ * Replay goes through gl_state.c, so redundant binds are still skipped.
+ *
+ * The recording functions return 0 if out of memory, leaving the buffer as
+ * it was.
+ */
+typedef struct
+{
+	uint8_t *data;
+	size_t size, capacity;
+	uint32_t num_commands;
+} command_buffer;
+
+command_buffer *command_buffer_new(void);
+void command_buffer_free(command_buffer *commands);
+
+/* Drop every command, keeping the memory for the next frame. */
+void command_buffer_reset(command_buffer *commands);
+
+int32_t command_buffer_clear(command_buffer *commands, GLbitfield mask);
+int32_t command_buffer_use_program(command_buffer *commands, GLuint program);
+int32_t command_buffer_bind_vertex_array(command_buffer *commands, GLuint vao);
+int32_t command_buffer_polygon_mode(command_buffer *commands, GLenum mode);
+int32_t command_buffer_draw_arrays(command_buffer *commands, GLenum primitive, GLint first, GLsizei count);
+
+/* name is not copied and must outlive the buffer; in practice it is a string literal. */
+int32_t command_buffer_uniform_matrix4fv(command_buffer *commands, GLuint program, const GLchar *name,
+	GLboolean transpose, const GLfloat *value);
+
+/*
+ * Call fn(context) when replayed, for work that needs the context but can't
+ * be recorded ahead, such as creating objects. context is not copied.
+ */
+int32_t command_buffer_call(command_buffer *commands, void (*fn)(const void *context), const void *context);
+
+/* Call fn with a copy of the size bytes at data, for arguments that change every frame. */
+int32_t command_buffer_call_copy(command_buffer *commands, void (*fn)(const void *data),
+	const void *data, size_t size);
+
+/* Replay every command in order. Must be called with the context current. */
+void command_buffer_execute(const command_buffer *commands);
+
+#endif
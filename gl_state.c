@@ -0,0 +1,267 @@
+#include <string.h>
+
+#include "gl_state.h"
+
+/* Uniforms whose location and last value are remembered. */
+#define MAX_UNIFORMS 256
+
+/* Buffer targets with a cached binding. */
+enum { ARRAY, DRAW_INDIRECT, ATOMIC_COUNTER, SHADER_STORAGE, NUM_TARGETS };
+
+struct uniform
+{
+	GLuint program;		/* 0 for an unused slot. */
+	const GLchar *name;
+	GLint location;
+	int32_t set;		/* Whether value_hash holds a value GL has. */
+	uint64_t value_hash;
+};
+
+/* Names are GL's; known is 0 until the first call after startup or invalidation. */
+static struct
+{
+	int32_t program_known, vao_known, polygon_mode_known;
+	GLuint program, vao;
+	GLenum polygon_mode;
+	int32_t buffer_known[NUM_TARGETS];
+	GLuint buffers[NUM_TARGETS];
+	struct uniform uniforms[MAX_UNIFORMS];
+	gl_state_stats stats;
+} state;
+
+/* Count the call, and return whether it has to be made. */
+static int32_t changes(int32_t *known, GLuint *current, GLuint value)
+{
+	if (*known && *current == value) {
+		state.stats.elided++;
+		return 0;
+	}
+
+	*known = 1;
+	*current = value;
+	state.stats.issued++;
+	return 1;
+}
+
+void gl_state_use_program(GLuint program)
+{
+	if (changes(&state.program_known, &state.program, program)) {
+		glUseProgram(program);
+		state.stats.programs_used++;
+	}
+}
+
+void gl_state_bind_vertex_array(GLuint vao)
+{
+	if (changes(&state.vao_known, &state.vao, vao)) {
+		glBindVertexArray(vao);
+		state.stats.vertex_arrays_bound++;
+	}
+}
+
+static int32_t target_index(GLenum target)
+{
+	switch (target) {
+	case GL_ARRAY_BUFFER:
+		return ARRAY;
+	case GL_DRAW_INDIRECT_BUFFER:
+		return DRAW_INDIRECT;
+	case GL_ATOMIC_COUNTER_BUFFER:
+		return ATOMIC_COUNTER;
+	case GL_SHADER_STORAGE_BUFFER:
+		return SHADER_STORAGE;
+	default:
+		return -1;
+	}
+}
+
+void gl_state_bind_buffer(GLenum target, GLuint buffer)
+{
+	/* Others, such as the element array binding, belong to the vertex array or aren't used per frame. */
+	int32_t i = target_index(target);
+	if (i < 0) {
+		state.stats.issued++;
+		glBindBuffer(target, buffer);
+		return;
+	}
+
+	if (changes(&state.buffer_known[i], &state.buffers[i], buffer))
+		glBindBuffer(target, buffer);
+}
+
+void gl_state_bind_buffer_base(GLenum target, GLuint index, GLuint buffer)
+{
+	int32_t i = target_index(target);
+	if (i >= 0) {
+		state.buffer_known[i] = 1;
+		state.buffers[i] = buffer;
+	}
+
+	state.stats.issued++;
+	glBindBufferBase(target, index, buffer);
+}
+
+void gl_state_polygon_mode(GLenum mode)
+{
+	if (changes(&state.polygon_mode_known, &state.polygon_mode, mode)) {
+		glPolygonMode(GL_FRONT_AND_BACK, mode);
+		state.stats.polygon_mode_changes++;
+	}
+}
+
+/* 64-bit FNV-1a. */
+static uint64_t hash(uint64_t seed, const void *data, size_t size)
+{
+	const uint8_t *bytes = data;
+	uint64_t h = seed ^ 0xcbf29ce484222325ull;
+
+	size_t i;
+	for (i = 0; i < size; i++) {
+		h ^= bytes[i];
+		h *= 0x100000001b3ull;
+	}
+
+	return h;
+}
+
+/* The program's uniform called name, or NULL if the table is full. */
+static struct uniform *find_uniform(GLuint program, const GLchar *name)
+{
+	uint64_t h = hash(program, name, strlen(name));
+	uint32_t i, slot;
+
+	for (i = 0; i < MAX_UNIFORMS; i++) {
+		slot = (h + i) % MAX_UNIFORMS;
+		struct uniform *uniform = &state.uniforms[slot];
+
+		if (!uniform->program) {
+			uniform->program = program;
+			uniform->name = name;
+			uniform->location = glGetUniformLocation(program, name);
+			uniform->set = 0;
+			return uniform;
+		}
+
+		if (uniform->program == program && (uniform->name == name || !strcmp(uniform->name, name)))
+			return uniform;
+	}
+
+	return NULL;
+}
+
+/* Whether the uniform needs setting to a value that hashes to value_hash; also returns its location. */
+static int32_t uniform_changes(GLuint program, const GLchar *name, uint64_t value_hash, GLint *location)
+{
+	gl_state_use_program(program);
+
+	struct uniform *uniform = find_uniform(program, name);
+	if (!uniform) {
+		*location = glGetUniformLocation(program, name);
+		state.stats.issued++;
+		return 1;
+	}
+
+	*location = uniform->location;
+	if (uniform->set && uniform->value_hash == value_hash) {
+		state.stats.elided++;
+		return 0;
+	}
+
+	uniform->set = 1;
+	uniform->value_hash = value_hash;
+	state.stats.issued++;
+	return 1;
+}
+
+void gl_state_uniform_matrix4fv(GLuint program, const GLchar *name, GLboolean transpose, const GLfloat *value)
+{
+	GLint location;
+	if (uniform_changes(program, name, hash(transpose ? 1 : 2, value, 16 * sizeof *value), &location))
+		glUniformMatrix4fv(location, 1, transpose, value);
+}
+
+void gl_state_uniform1i(GLuint program, const GLchar *name, GLint value)
+{
+	GLint location;
+	if (uniform_changes(program, name, hash(3, &value, sizeof value), &location))
+		glUniform1i(location, value);
+}
+
+void gl_state_uniform3i(GLuint program, const GLchar *name, GLint x, GLint y, GLint z)
+{
+	GLint value[] = { x, y, z }, location;
+	if (uniform_changes(program, name, hash(4, value, sizeof value), &location))
+		glUniform3i(location, x, y, z);
+}
+
+void gl_state_uniform3f(GLuint program, const GLchar *name, GLfloat x, GLfloat y, GLfloat z)
+{
+	GLfloat value[] = { x, y, z };
+	GLint location;
+	if (uniform_changes(program, name, hash(5, value, sizeof value), &location))
+		glUniform3f(location, x, y, z);
+}
+
+void gl_state_delete_program(GLuint program)
+{
+	if (!program)
+		return;
+
+	/* Rebuild the table without the program's uniforms so no probe chain is broken. */
+	struct uniform kept[MAX_UNIFORMS];
+	memcpy(kept, state.uniforms, sizeof kept);
+	memset(state.uniforms, 0, sizeof state.uniforms);
+
+	uint32_t i;
+	for (i = 0; i < MAX_UNIFORMS; i++) {
+		if (!kept[i].program || kept[i].program == program)
+			continue;
+
+		uint64_t h = hash(kept[i].program, kept[i].name, strlen(kept[i].name));
+		uint32_t j = 0;
+		while (state.uniforms[(h + j) % MAX_UNIFORMS].program)
+			j++;
+		state.uniforms[(h + j) % MAX_UNIFORMS] = kept[i];
+	}
+
+	if (state.program == program)
+		state.program_known = 0;
+	glDeleteProgram(program);
+}
+
+void gl_state_delete_vertex_array(GLuint vao)
+{
+	if (state.vao == vao)
+		state.vao_known = 0;
+	glDeleteVertexArrays(1, &vao);
+}
+
+void gl_state_delete_buffer(GLuint buffer)
+{
+	int32_t i;
+	for (i = 0; i < NUM_TARGETS; i++)
+		if (state.buffers[i] == buffer)
+			state.buffer_known[i] = 0;
+	glDeleteBuffers(1, &buffer);
+}
+
+void gl_state_invalidate(void)
+{
+	gl_state_stats stats = state.stats;
+	struct uniform uniforms[MAX_UNIFORMS];
+	memcpy(uniforms, state.uniforms, sizeof uniforms);
+
+	memset(&state, 0, sizeof state);
+
+	/* Locations stay valid; only the values are forgotten. */
+	uint32_t i;
+	for (i = 0; i < MAX_UNIFORMS; i++)
+		uniforms[i].set = 0;
+	memcpy(state.uniforms, uniforms, sizeof uniforms);
+	state.stats = stats;
+}
+
+gl_state_stats gl_state_get_stats(void)
+{
+	return state.stats;
+}
@@ -0,0 +1,56 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+
+/*
+ * A shadow of the GL state the programs set every frame. Each call here
+ * goes to GL only if it would change something, so code can set what it
+ * needs without tracking what is already bound. Uniforms are compared by a
+ * hash of their value, and their locations are looked up once.
+ *
+ * Everything must be on one thread with one context. GL objects bound
+ * through here must be deleted through here too, or a new object given a
+ * freed name could be taken for one already bound. After touching any of
+ * this state directly, call gl_state_invalidate().
+ */
+
+typedef struct
+{
+	uint64_t issued;
+	uint64_t elided;
+	uint64_t programs_used, vertex_arrays_bound, polygon_mode_changes;	/* Issued ones, by kind. */
+} gl_state_stats;
+
+void gl_state_use_program(GLuint program);
+void gl_state_bind_vertex_array(GLuint vao);
+
+/* Cached for the array, indirect, atomic counter and storage buffer targets. */
+void gl_state_bind_buffer(GLenum target, GLuint buffer);
+
+/* Always issued, but it binds the target as well as the index, so it goes through here. */
+void gl_state_bind_buffer_base(GLenum target, GLuint index, GLuint buffer);
+
+void gl_state_polygon_mode(GLenum mode);
+
+/*
+ * Set a uniform of program, making it current if it isn't. name is kept, so
+ * it must stay valid; in practice it is a string literal.
+ */
+void gl_state_uniform_matrix4fv(GLuint program, const GLchar *name, GLboolean transpose, const GLfloat *value);
+void gl_state_uniform1i(GLuint program, const GLchar *name, GLint value);
+void gl_state_uniform3i(GLuint program, const GLchar *name, GLint x, GLint y, GLint z);
+void gl_state_uniform3f(GLuint program, const GLchar *name, GLfloat x, GLfloat y, GLfloat z);
+
+void gl_state_delete_program(GLuint program);
+void gl_state_delete_vertex_array(GLuint vao);
+void gl_state_delete_buffer(GLuint buffer);
+
+/* Forget everything, so the next call of each kind goes through. */
+void gl_state_invalidate(void);
+
+/* Calls passed to GL and calls skipped since startup. */
+gl_state_stats gl_state_get_stats(void);
+
+#endif
@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "gl_state.h"
+#include "gpu_memory.h"
+
+struct allocation
+{
+	uint64_t size;
+	gpu_memory_category category;
+};
+
+/* Indexed by buffer name, which GL hands out from small numbers up. */
+static struct
+{
+	struct allocation *allocations;
+	GLuint num_allocations;
+	uint64_t budget;
+	gpu_memory_stats stats;
+} memory;
+
+static void add(gpu_memory_category category, uint64_t size)
+{
+	gpu_memory_stats *stats = &memory.stats;
+
+	stats->current[category] += size;
+	if (stats->current[category] > stats->peak[category])
+		stats->peak[category] = stats->current[category];
+
+	stats->total += size;
+	if (stats->total > stats->total_peak)
+		stats->total_peak = stats->total;
+}
+
+static void subtract(gpu_memory_category category, uint64_t size)
+{
+	memory.stats.current[category] -= size;
+	memory.stats.total -= size;
+}
+
+void gpu_memory_set_budget(uint64_t budget)
+{
+	memory.budget = budget;
+}
+
+int32_t gpu_memory_fits(uint64_t size)
+{
+	return !memory.budget || memory.stats.total + size <= memory.budget;
+}
+
+uint64_t gpu_memory_available(void)
+{
+	if (!memory.budget)
+		return UINT64_MAX;
+	return memory.stats.total < memory.budget ? memory.budget - memory.stats.total : 0;
+}
+
+/* The buffer's record, growing the table to hold it; NULL if out of memory. */
+static struct allocation *allocation(GLuint buffer)
+{
+	if (buffer >= memory.num_allocations) {
+		GLuint num_allocations = memory.num_allocations ? memory.num_allocations : 256;
+		while (num_allocations <= buffer)
+			num_allocations *= 2;
+
+		struct allocation *allocations = realloc(memory.allocations, num_allocations * sizeof *allocations);
+		if (!allocations)
+			return NULL;
+
+		memset(allocations + memory.num_allocations, 0,
+			(num_allocations - memory.num_allocations) * sizeof *allocations);
+		memory.allocations = allocations;
+		memory.num_allocations = num_allocations;
+	}
+
+	return &memory.allocations[buffer];
+}
+
+GLuint gpu_memory_buffer_new(gpu_memory_category category, GLenum target, GLsizeiptr size,
+	const void *data, GLenum usage)
+{
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+
+	struct allocation *record = allocation(buffer);
+	if (!record) {
+		gl_state_delete_buffer(buffer);
+		return 0;
+	}
+
+	record->size = 0;
+	record->category = category;
+	memory.stats.buffers++;
+
+	gpu_memory_buffer_data(buffer, target, size, data, usage);
+	return buffer;
+}
+
+void gpu_memory_buffer_data(GLuint buffer, GLenum target, GLsizeiptr size, const void *data, GLenum usage)
+{
+	struct allocation *record = &memory.allocations[buffer];
+
+	gl_state_bind_buffer(target, buffer);
+	glBufferData(target, size, data, usage);
+
+	subtract(record->category, record->size);
+	record->size = size;
+	add(record->category, record->size);
+}
+
+void gpu_memory_set_category(GLuint buffer, gpu_memory_category category)
+{
+	struct allocation *record = &memory.allocations[buffer];
+
+	subtract(record->category, record->size);
+	record->category = category;
+	add(record->category, record->size);
+}
+
+void gpu_memory_buffer_delete(GLuint buffer)
+{
+	if (!buffer)
+		return;
+
+	struct allocation *record = &memory.allocations[buffer];
+	subtract(record->category, record->size);
+	record->size = 0;
+	memory.stats.buffers--;
+
+	gl_state_delete_buffer(buffer);
+}
+
+gpu_memory_stats gpu_memory_get_stats(void)
+{
+	return memory.stats;
+}
+
+const char *gpu_memory_category_name(gpu_memory_category category)
+{
+	static const char *names[GPU_MEMORY_CATEGORIES] = { "mesh", "index", "uniform", "command", "staging" };
+	return names[category];
+}
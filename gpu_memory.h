@@ -0,0 +1,64 @@
+#ifndef GPU_MEMORY_H
+#define GPU_MEMORY_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+
+/* What a buffer holds, for reporting. */
+typedef enum
+{
+	GPU_MEMORY_MESH,	/* Vertex attributes. */
+	GPU_MEMORY_INDEX,
+	GPU_MEMORY_UNIFORM,	/* Uniform buffers. */
+	GPU_MEMORY_COMMAND,	/* What GPU-driven draws are counted and issued from: atomic counters, indirect commands. */
+	GPU_MEMORY_STAGING,	/* Meshes still being uploaded. */
+	GPU_MEMORY_CATEGORIES
+} gpu_memory_category;
+
+typedef struct
+{
+	uint64_t current[GPU_MEMORY_CATEGORIES], peak[GPU_MEMORY_CATEGORIES];
+	uint64_t total, total_peak;
+	uint32_t buffers;
+} gpu_memory_stats;
+
+/*
+ * Bookkeeping for buffer objects: every buffer made through here has its
+ * size and category recorded, so the program knows how much memory its
+ * buffers take and can keep under a budget. Drivers don't say how much
+ * memory there is, so the budget is whatever the user asks for.
+ *
+ * Like gl_state.c, this is for one thread with the context current.
+ */
+
+/* Bytes all buffers together should stay under, or 0 for no limit. */
+void gpu_memory_set_budget(uint64_t budget);
+
+/* Whether size more bytes of buffers would stay within the budget. */
+int32_t gpu_memory_fits(uint64_t size);
+
+/* Bytes of buffers that would still fit within the budget; UINT64_MAX with no limit. */
+uint64_t gpu_memory_available(void);
+
+/*
+ * Create a buffer of size bytes, bound to target, filled from data unless
+ * it is NULL. Returns 0 if out of memory.
+ */
+GLuint gpu_memory_buffer_new(gpu_memory_category category, GLenum target, GLsizeiptr size,
+	const void *data, GLenum usage);
+
+/* Give an existing buffer new storage, as glBufferData does. */
+void gpu_memory_buffer_data(GLuint buffer, GLenum target, GLsizeiptr size, const void *data, GLenum usage);
+
+/* Count the buffer under another category from now on. */
+void gpu_memory_set_category(GLuint buffer, gpu_memory_category category);
+
+/* Delete a buffer made by gpu_memory_buffer_new. Does nothing for 0. */
+void gpu_memory_buffer_delete(GLuint buffer);
+
+gpu_memory_stats gpu_memory_get_stats(void);
+
+/* The category's name for reports. */
+const char *gpu_memory_category_name(gpu_memory_category category);
+
+#endif
@@ -0,0 +1,370 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gl_state.h"
+#include "gpu_memory.h"
+#include "gpu_mesher.h"
+#include "mesher.h"
+#include "shader.h"
+
+#define LOCAL_SIZE 4
+
+/* Bytes of one face's positions, and of a face for comparison: its positions followed by its materials. */
+#define FLOATS_PER_VERTEX 4
+#define POSITION_BYTES (6 * FLOATS_PER_VERTEX * sizeof(float))
+#define FACE_BYTES (POSITION_BYTES + 6)
+
+static const GLchar *mesh_shader_source =
+{
+"#version 430\n"\
+
+"layout(local_size_x = 4, local_size_y = 4, local_size_z = 4) in;\n"\
+
+"layout(binding = 0) uniform usampler3D voxels;\n"\
+"layout(binding = 0, offset = 0) uniform atomic_uint num_faces;\n"\
+"layout(std430, binding = 0) writeonly buffer Positions { vec4 positions[]; };\n"\
+"layout(std430, binding = 1) buffer Materials { uint materials[]; };\n"\
+
+"uniform ivec3 grid_size;\n"\
+"uniform bool count_only;\n"\
+
+/* The grid is x-major, so the texture's s, t and r are z, y and x. */
+"bool empty(ivec3 p)\n"\
+"{\n"\
+"	if (any(lessThan(p, ivec3(0))) || any(greaterThanEqual(p, grid_size)))\n"\
+"		return true;\n"\
+"	return texelFetch(voxels, p.zyx, 0).r == 0u;\n"\
+"}\n"\
+
+/*
+ * A byte of material per vertex, so a face's six bytes share words with its
+ * neighbours'. They are ORed into a buffer cleared to zero.
+ */
+"void add_materials(uint face, uint material)\n"\
+"{\n"\
+"	uint first = face * 6u, last = first + 6u;\n"\
+"	for (uint word = first / 4u; word * 4u < last; word++) {\n"\
+"		uint low = max(first, word * 4u) - word * 4u, high = min(last, word * 4u + 4u) - word * 4u;\n"\
+"		uint mask = high - low == 4u ? 0xffffffffu : ((1u << (high - low) * 8u) - 1u) << low * 8u;\n"\
+"		atomicOr(materials[word], material * 0x01010101u & mask);\n"\
+"	}\n"\
+"}\n"\
+
+/* Corners are given as offsets from the voxel centre, in mesher.c's order. */
+"void add_quad(vec3 c, uint material, vec3 v0, vec3 v1, vec3 v2, vec3 v3, vec3 v4, vec3 v5)\n"\
+"{\n"\
+"	uint face = atomicCounterIncrement(num_faces);\n"\
+"	if (count_only)\n"\
+"		return;\n"\
+"	uint i = face * 6u;\n"\
+"	positions[i + 0u] = vec4(c + v0, 1.0);\n"\
+"	positions[i + 1u] = vec4(c + v1, 1.0);\n"\
+"	positions[i + 2u] = vec4(c + v2, 1.0);\n"\
+"	positions[i + 3u] = vec4(c + v3, 1.0);\n"\
+"	positions[i + 4u] = vec4(c + v4, 1.0);\n"\
+"	positions[i + 5u] = vec4(c + v5, 1.0);\n"\
+"	add_materials(face, material);\n"\
+"}\n"\
+
+"void add_x_quad(vec3 c, uint m, float o)\n"\
+"{\n"\
+"	add_quad(c, m, vec3(o, -0.5, 0.5), vec3(o, 0.5, 0.5), vec3(o, 0.5, -0.5),\n"\
+"		vec3(o, 0.5, -0.5), vec3(o, -0.5, -0.5), vec3(o, -0.5, 0.5));\n"\
+"}\n"\
+
+"void add_y_quad(vec3 c, uint m, float o)\n"\
+"{\n"\
+"	add_quad(c, m, vec3(-0.5, o, 0.5), vec3(0.5, o, 0.5), vec3(0.5, o, -0.5),\n"\
+"		vec3(0.5, o, -0.5), vec3(-0.5, o, -0.5), vec3(-0.5, o, 0.5));\n"\
+"}\n"\
+
+"void add_z_quad(vec3 c, uint m, float o)\n"\
+"{\n"\
+"	add_quad(c, m, vec3(-0.5, 0.5, o), vec3(0.5, 0.5, o), vec3(0.5, -0.5, o),\n"\
+"		vec3(0.5, -0.5, o), vec3(-0.5, -0.5, o), vec3(-0.5, 0.5, o));\n"\
+"}\n"\
+
+"void main(void)\n"\
+"{\n"\
+"	ivec3 p = ivec3(gl_GlobalInvocationID);\n"\
+"	if (any(greaterThanEqual(p, grid_size)) || empty(p))\n"\
+"		return;\n"\
+"	vec3 c = vec3(p);\n"\
+"	uint m = texelFetch(voxels, p.zyx, 0).r;\n"\
+"	if (empty(p - ivec3(1, 0, 0))) add_x_quad(c, m, -0.5);\n"\
+"	if (empty(p - ivec3(0, 1, 0))) add_y_quad(c, m, -0.5);\n"\
+"	if (empty(p - ivec3(0, 0, 1))) add_z_quad(c, m, -0.5);\n"\
+"	if (empty(p + ivec3(1, 0, 0))) add_x_quad(c, m, 0.5);\n"\
+"	if (empty(p + ivec3(0, 1, 0))) add_y_quad(c, m, 0.5);\n"\
+"	if (empty(p + ivec3(0, 0, 1))) add_z_quad(c, m, 0.5);\n"\
+"}\n"\
+};
+
+/* Turns the face count into glDrawArraysIndirect arguments. */
+static const GLchar *finish_shader_source =
+{
+"#version 430\n"\
+
+"layout(local_size_x = 1) in;\n"\
+
+"layout(binding = 0, offset = 0) uniform atomic_uint num_faces;\n"\
+"layout(std430, binding = 2) writeonly buffer Draw { uint count, instance_count, first, base_instance; };\n"\
+
+"void main(void)\n"\
+"{\n"\
+"	count = atomicCounter(num_faces) * 6u;\n"\
+"	instance_count = 1u;\n"\
+"	first = 0u;\n"\
+"	base_instance = 0u;\n"\
+"}\n"\
+};
+
+int32_t gpu_mesher_supported(void)
+{
+	return GLEW_VERSION_4_3 || (GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object
+		&& GLEW_ARB_clear_buffer_object && GLEW_ARB_draw_indirect);
+}
+
+gpu_mesher *gpu_mesher_new(void)
+{
+	gpu_mesher *mesher = calloc(1, sizeof *mesher);
+	if (!mesher)
+		return NULL;
+
+	mesher->mesh_program = shader_compute_program_new(mesh_shader_source);
+	mesher->finish_program = shader_compute_program_new(finish_shader_source);
+	if (!mesher->mesh_program || !mesher->finish_program) {
+		gpu_mesher_free(mesher);
+		return NULL;
+	}
+
+	glGenTextures(1, &mesher->voxel_texture);
+	glBindTexture(GL_TEXTURE_3D, mesher->voxel_texture);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	mesher->counter_buffer = gpu_memory_buffer_new(GPU_MEMORY_COMMAND, GL_ATOMIC_COUNTER_BUFFER,
+		sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+	mesher->indirect_buffer = gpu_memory_buffer_new(GPU_MEMORY_COMMAND, GL_DRAW_INDIRECT_BUFFER,
+		4 * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+	mesher->vertex_buffer = gpu_memory_buffer_new(GPU_MEMORY_MESH, GL_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW);
+	mesher->material_buffer = gpu_memory_buffer_new(GPU_MEMORY_MESH, GL_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW);
+	if (!mesher->counter_buffer || !mesher->indirect_buffer || !mesher->vertex_buffer || !mesher->material_buffer) {
+		gpu_mesher_free(mesher);
+		return NULL;
+	}
+
+	glGenVertexArrays(1, &mesher->vao);
+	gl_state_bind_vertex_array(mesher->vao);
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, mesher->vertex_buffer);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+	glEnableVertexAttribArray(0);
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, mesher->material_buffer);
+	glVertexAttribIPointer(1, 1, GL_UNSIGNED_BYTE, 0, 0);
+	glEnableVertexAttribArray(1);
+	gl_state_bind_vertex_array(0);
+
+	return mesher;
+}
+
+void gpu_mesher_free(gpu_mesher *mesher)
+{
+	if (!mesher)
+		return;
+
+	gl_state_delete_program(mesher->mesh_program);
+	gl_state_delete_program(mesher->finish_program);
+	glDeleteTextures(1, &mesher->voxel_texture);
+	gpu_memory_buffer_delete(mesher->counter_buffer);
+	gpu_memory_buffer_delete(mesher->indirect_buffer);
+	gpu_memory_buffer_delete(mesher->vertex_buffer);
+	gpu_memory_buffer_delete(mesher->material_buffer);
+	gl_state_delete_vertex_array(mesher->vao);
+	free(mesher);
+}
+
+static void reset_counter(gpu_mesher *mesher)
+{
+	GLuint zero = 0;
+	gl_state_bind_buffer(GL_ATOMIC_COUNTER_BUFFER, mesher->counter_buffer);
+	glBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof zero, &zero);
+}
+
+static void dispatch(gpu_mesher *mesher, GLboolean count_only)
+{
+	gl_state_uniform1i(mesher->mesh_program, "count_only", count_only);
+	glDispatchCompute((mesher->size_x + LOCAL_SIZE - 1) / LOCAL_SIZE,
+		(mesher->size_y + LOCAL_SIZE - 1) / LOCAL_SIZE,
+		(mesher->size_z + LOCAL_SIZE - 1) / LOCAL_SIZE);
+}
+
+void gpu_mesher_mesh(gpu_mesher *mesher, const voxel_grid *grid)
+{
+	mesher->size_x = grid->size_x;
+	mesher->size_y = grid->size_y;
+	mesher->size_z = grid->size_z;
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_3D, mesher->voxel_texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage3D(GL_TEXTURE_3D, 0, GL_R8UI, grid->size_z, grid->size_y, grid->size_x, 0,
+		GL_RED_INTEGER, GL_UNSIGNED_BYTE, grid->voxels);
+
+	gl_state_uniform3i(mesher->mesh_program, "grid_size", grid->size_x, grid->size_y, grid->size_z);
+	gl_state_bind_buffer_base(GL_ATOMIC_COUNTER_BUFFER, 0, mesher->counter_buffer);
+
+	/* Count the faces first so the vertex buffers can be grown to fit. */
+	reset_counter(mesher);
+	dispatch(mesher, GL_TRUE);
+	glMemoryBarrier(GL_ATOMIC_COUNTER_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	GLuint num_faces;
+	gl_state_bind_buffer(GL_ATOMIC_COUNTER_BUFFER, mesher->counter_buffer);
+	glGetBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof num_faces, &num_faces);
+
+	if (num_faces > mesher->capacity || !mesher->capacity) {
+		mesher->capacity = num_faces ? num_faces : 1;
+		gpu_memory_buffer_data(mesher->vertex_buffer, GL_ARRAY_BUFFER,
+			(GLsizeiptr) mesher->capacity * POSITION_BYTES, NULL, GL_STATIC_DRAW);
+		gpu_memory_buffer_data(mesher->material_buffer, GL_ARRAY_BUFFER,
+			((GLsizeiptr) mesher->capacity * 6 + 3) / 4 * 4, NULL, GL_STATIC_DRAW);
+	}
+
+	/* The materials are ORed in, so they start from zero. */
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, mesher->material_buffer);
+	glClearBufferData(GL_ARRAY_BUFFER, GL_R8UI, GL_RED_INTEGER, GL_UNSIGNED_BYTE, NULL);
+
+	reset_counter(mesher);
+	gl_state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, 0, mesher->vertex_buffer);
+	gl_state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, 1, mesher->material_buffer);
+	dispatch(mesher, GL_FALSE);
+	glMemoryBarrier(GL_ATOMIC_COUNTER_BARRIER_BIT);
+
+	gl_state_use_program(mesher->finish_program);
+	gl_state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, 2, mesher->indirect_buffer);
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+		| GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+void gpu_mesher_draw(const gpu_mesher *mesher)
+{
+	gl_state_bind_vertex_array(mesher->vao);
+	gl_state_bind_buffer(GL_DRAW_INDIRECT_BUFFER, mesher->indirect_buffer);
+	glDrawArraysIndirect(GL_TRIANGLES, 0);
+}
+
+static int compare_faces(const void *a, const void *b)
+{
+	return memcmp(a, b, FACE_BYTES);
+}
+
+/* Put a face's positions and materials together in one record so faces can be sorted. */
+static void pack_face(uint8_t *face, const float *positions, const uint8_t *materials)
+{
+	memcpy(face, positions, POSITION_BYTES);
+	memcpy(face + POSITION_BYTES, materials, 6);
+}
+
+/* The same for a face of chunk (cx, cy, cz) from mesher.c, moving its positions into the grid's space. */
+static void pack_chunk_face(uint8_t *face, const uint8_t *vertices, int32_t cx, int32_t cy, int32_t cz)
+{
+	float positions[6 * FLOATS_PER_VERTEX];
+	uint8_t materials[6];
+	uint32_t vertex;
+
+	for (vertex = 0; vertex < 6; vertex++) {
+		const uint8_t *v = vertices + vertex * COMPONENTS_PER_VERTEX;
+		positions[vertex * FLOATS_PER_VERTEX + 0] = cx * CHUNK_SIZE + v[0] - 0.5f;
+		positions[vertex * FLOATS_PER_VERTEX + 1] = cy * CHUNK_SIZE + v[1] - 0.5f;
+		positions[vertex * FLOATS_PER_VERTEX + 2] = cz * CHUNK_SIZE + v[2] - 0.5f;
+		positions[vertex * FLOATS_PER_VERTEX + 3] = 1.0f;
+		materials[vertex] = v[3];
+	}
+
+	pack_face(face, positions, materials);
+}
+
+int32_t gpu_mesher_verify(const gpu_mesher *mesher, const voxel_grid *grid)
+{
+	GLuint draw[4];
+	gl_state_bind_buffer(GL_DRAW_INDIRECT_BUFFER, mesher->indirect_buffer);
+	glGetBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof draw, draw);
+	uint32_t num_gpu_faces = draw[0] / 6;
+
+	/* Mesh the grid on the CPU, chunk by chunk, for comparison. */
+	uint32_t chunk, num_chunks = voxel_grid_num_chunks(grid), num_cpu_faces = 0;
+	chunk_mesh **meshes = calloc(num_chunks, sizeof *meshes);
+	if (!meshes)
+		return 0;
+	for (chunk = 0; chunk < num_chunks; chunk++) {
+		int32_t cx, cy, cz;
+		meshes[chunk] = chunk_mesh_new();
+		if (!meshes[chunk])
+			break;
+		voxel_grid_chunk_coords(grid, chunk, &cx, &cy, &cz);
+		mesher_mesh_chunk(grid, NULL, cx, cy, cz, meshes[chunk]);
+		num_cpu_faces += chunk_mesh_num_vertices(meshes[chunk]) / 6;
+	}
+
+	int32_t identical = 0;
+	uint8_t *gpu_faces = NULL, *cpu_faces = NULL, *materials = NULL;
+	float *positions = NULL;
+
+	if (chunk < num_chunks) {
+		fprintf(stderr, "Memory allocation error.\n");
+		goto done;
+	}
+
+	if (num_gpu_faces != num_cpu_faces || num_gpu_faces > mesher->capacity) {
+		printf("GPU mesher made %" PRIu32 " faces, the CPU mesher %" PRIu32 ".\n",
+			num_gpu_faces, num_cpu_faces);
+		goto done;
+	}
+
+	gpu_faces = malloc(num_gpu_faces * FACE_BYTES + 1);
+	cpu_faces = malloc(num_cpu_faces * FACE_BYTES + 1);
+	positions = malloc(num_gpu_faces * POSITION_BYTES + 1);
+	materials = malloc(num_gpu_faces * 6 + 1);
+	if (!gpu_faces || !cpu_faces || !positions || !materials) {
+		fprintf(stderr, "Memory allocation error.\n");
+		goto done;
+	}
+
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, mesher->vertex_buffer);
+	glGetBufferSubData(GL_ARRAY_BUFFER, 0, num_gpu_faces * POSITION_BYTES, positions);
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, mesher->material_buffer);
+	glGetBufferSubData(GL_ARRAY_BUFFER, 0, num_gpu_faces * 6, materials);
+
+	uint32_t face;
+	for (face = 0; face < num_gpu_faces; face++)
+		pack_face(gpu_faces + face * FACE_BYTES, positions + face * 6 * FLOATS_PER_VERTEX, materials + face * 6);
+
+	uint8_t *next = cpu_faces;
+	for (chunk = 0; chunk < num_chunks; chunk++) {
+		int32_t cx, cy, cz;
+		uint32_t chunk_faces = chunk_mesh_num_vertices(meshes[chunk]) / 6;
+		voxel_grid_chunk_coords(grid, chunk, &cx, &cy, &cz);
+		for (face = 0; face < chunk_faces; face++) {
+			pack_chunk_face(next, meshes[chunk]->vertices + face * 6 * COMPONENTS_PER_VERTEX, cx, cy, cz);
+			next += FACE_BYTES;
+		}
+	}
+
+	qsort(gpu_faces, num_gpu_faces, FACE_BYTES, compare_faces);
+	qsort(cpu_faces, num_cpu_faces, FACE_BYTES, compare_faces);
+	identical = !memcmp(gpu_faces, cpu_faces, num_gpu_faces * FACE_BYTES);
+
+done:
+	for (chunk = 0; chunk < num_chunks; chunk++)
+		chunk_mesh_free(meshes[chunk]);
+	free(meshes);
+	free(gpu_faces);
+	free(cpu_faces);
+	free(positions);
+	free(materials);
+
+	return identical;
+}
@@ -0,0 +1,50 @@
+#ifndef GPU_MESHER_H
+#define GPU_MESHER_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+
+#include "voxel.h"
+
+/*
+ * Meshes the voxel grid with OpenGL 4.3 compute shaders instead of on the CPU.
+ * The grid is uploaded as an unsigned integer 3D texture, one invocation per
+ * voxel appends its visible faces to the vertex buffers through an atomic
+ * counter, and the face count is turned into indirect draw arguments on the
+ * GPU, so no geometry passes through the CPU. The faces are the same as
+ * mesher.c produces, only in a different order, and with positions in the
+ * grid's space as floats rather than relative to their chunks.
+ */
+typedef struct
+{
+	GLuint mesh_program, finish_program;
+	GLuint voxel_texture;
+	GLuint counter_buffer, indirect_buffer;
+	GLuint vertex_buffer, material_buffer, vao;
+	uint32_t capacity;	/* Faces the vertex buffers have room for. */
+	int32_t size_x, size_y, size_z;
+} gpu_mesher;
+
+/* Whether the context has compute shaders, storage buffers, buffer clears and indirect draws. */
+int32_t gpu_mesher_supported(void);
+
+/* Compile the shaders. Returns NULL if that fails. */
+gpu_mesher *gpu_mesher_new(void);
+void gpu_mesher_free(gpu_mesher *mesher);
+
+/*
+ * Upload the grid and mesh it. The only read back is the face count from a
+ * counting pass, four bytes, to grow the vertex buffers when needed.
+ */
+void gpu_mesher_mesh(gpu_mesher *mesher, const voxel_grid *grid);
+
+/* Draw the mesh with the currently bound program. */
+void gpu_mesher_draw(const gpu_mesher *mesher);
+
+/*
+ * Read the mesh back and check that it holds exactly the faces mesher.c makes
+ * for the grid. For testing only: it stalls the pipeline.
+ */
+int32_t gpu_mesher_verify(const gpu_mesher *mesher, const voxel_grid *grid);
+
+#endif
@@ -0,0 +1,145 @@
+#include <stdlib.h>
+
+#include "indexed_mesh.h"
+
+/* The most vertices one range may span with 16-bit indices. */
+#define MAX_RANGE_VERTICES 65536
+
+static void add_range(index_range *ranges, uint32_t num_ranges, uint32_t first, uint32_t last,
+	uint32_t low, uint32_t high, uint32_t max_vertices)
+{
+	if (!ranges)
+		return;
+
+	/* Leave out the base vertex where the indices reach without one. */
+	ranges[num_ranges] = (index_range) { first, last - first, high < max_vertices ? 0 : low };
+}
+
+/*
+ * Split the triangles into runs that each span fewer than max_vertices, and
+ * fill in ranges if given. Returns the number of runs, or 0 if a triangle
+ * on its own spans too many.
+ */
+static uint32_t split(const uint32_t *indices, uint32_t num_indices, uint32_t max_vertices, index_range *ranges)
+{
+	uint32_t i, j, num_ranges = 0, first = 0, low = UINT32_MAX, high = 0;
+
+	for (i = 0; i + 2 < num_indices; i += 3) {
+		uint32_t triangle_low = indices[i], triangle_high = indices[i];
+		for (j = 1; j < 3; j++) {
+			if (indices[i + j] < triangle_low)
+				triangle_low = indices[i + j];
+			if (indices[i + j] > triangle_high)
+				triangle_high = indices[i + j];
+		}
+		if (triangle_high - triangle_low >= max_vertices)
+			return 0;
+
+		uint32_t new_low = triangle_low < low ? triangle_low : low;
+		uint32_t new_high = triangle_high > high ? triangle_high : high;
+		if (new_high - new_low >= max_vertices) {
+			add_range(ranges, num_ranges++, first, i, low, high, max_vertices);
+			first = i;
+			new_low = triangle_low;
+			new_high = triangle_high;
+		}
+
+		low = new_low;
+		high = new_high;
+	}
+
+	if (first < i)
+		add_range(ranges, num_ranges++, first, i, low, high, max_vertices);
+
+	return num_ranges;
+}
+
+indexed_mesh *indexed_mesh_new(const uint32_t *indices, uint32_t num_indices)
+{
+	indexed_mesh *mesh = calloc(1, sizeof *mesh);
+	if (!mesh)
+		return NULL;
+
+	/*
+	 * Bytes if the whole mesh fits in one range of them, otherwise shorts
+	 * in as many ranges as it takes. Only a single triangle spanning more
+	 * than 16 bits forces 32-bit indices.
+	 */
+	uint32_t max_vertices = 256;
+	mesh->index_type = GL_UNSIGNED_BYTE;
+	mesh->index_size = 1;
+	mesh->num_ranges = split(indices, num_indices, max_vertices, NULL);
+
+	if (mesh->num_ranges != 1) {
+		max_vertices = MAX_RANGE_VERTICES;
+		mesh->index_type = GL_UNSIGNED_SHORT;
+		mesh->index_size = 2;
+		mesh->num_ranges = split(indices, num_indices, max_vertices, NULL);
+	}
+
+	if (!mesh->num_ranges) {
+		max_vertices = 0;
+		mesh->index_type = GL_UNSIGNED_INT;
+		mesh->index_size = 4;
+		mesh->num_ranges = 1;
+	}
+
+	mesh->num_indices = num_indices;
+	mesh->indices = malloc((size_t) num_indices * mesh->index_size + 1);
+	mesh->ranges = malloc(mesh->num_ranges * sizeof *mesh->ranges);
+	if (!mesh->indices || !mesh->ranges) {
+		indexed_mesh_free(mesh);
+		return NULL;
+	}
+
+	if (max_vertices)
+		split(indices, num_indices, max_vertices, mesh->ranges);
+	else
+		mesh->ranges[0] = (index_range) { 0, num_indices, 0 };
+
+	uint32_t r, i;
+	for (r = 0; r < mesh->num_ranges; r++) {
+		const index_range *range = &mesh->ranges[r];
+		for (i = range->first_index; i < range->first_index + range->num_indices; i++) {
+			uint32_t index = indices[i] - range->base_vertex;
+			if (mesh->index_size == 1)
+				((uint8_t *) mesh->indices)[i] = index;
+			else if (mesh->index_size == 2)
+				((uint16_t *) mesh->indices)[i] = index;
+			else
+				((uint32_t *) mesh->indices)[i] = index;
+		}
+	}
+
+	return mesh;
+}
+
+void indexed_mesh_free(indexed_mesh *mesh)
+{
+	if (!mesh)
+		return;
+
+	free(mesh->indices);
+	free(mesh->ranges);
+	free(mesh);
+}
+
+uint32_t indexed_mesh_size(const indexed_mesh *mesh)
+{
+	return mesh->num_indices * mesh->index_size;
+}
+
+void indexed_mesh_draw(const indexed_mesh *mesh)
+{
+	uint32_t r;
+	for (r = 0; r < mesh->num_ranges; r++) {
+		const index_range *range = &mesh->ranges[r];
+		GLvoid *offset = (GLvoid *) ((uintptr_t) range->first_index * mesh->index_size);
+
+		if (range->base_vertex)
+			glDrawElementsBaseVertex(GL_TRIANGLES, range->num_indices, mesh->index_type,
+				offset, range->base_vertex);
+		else
+			glDrawElements(GL_TRIANGLES, range->num_indices, mesh->index_type, offset);
+	}
+}
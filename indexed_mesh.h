@@ -0,0 +1,41 @@
+#ifndef INDEXED_MESH_H
+#define INDEXED_MESH_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+
+/* A run of triangles whose indices are relative to base_vertex. */
+typedef struct
+{
+	uint32_t first_index;
+	uint32_t num_indices;
+	int32_t base_vertex;
+} index_range;
+
+/*
+ * Indices packed into the narrowest type that fits. Meshes with more
+ * vertices than 16 bits can address are split into ranges that each span
+ * fewer, drawn with a base vertex. Ranges are longest when the vertices are
+ * in first-use order, as meshopt_optimize_vertex_fetch leaves them.
+ */
+typedef struct
+{
+	GLenum index_type;
+	uint32_t index_size;
+	void *indices;
+	uint32_t num_indices;
+	index_range *ranges;
+	uint32_t num_ranges;
+} indexed_mesh;
+
+/* Returns NULL if out of memory. The caller's indices are not kept. */
+indexed_mesh *indexed_mesh_new(const uint32_t *indices, uint32_t num_indices);
+void indexed_mesh_free(indexed_mesh *mesh);
+
+/* Bytes to upload from mesh->indices to the element array buffer. */
+uint32_t indexed_mesh_size(const indexed_mesh *mesh);
+
+/* Draw triangles from the bound element array buffer holding mesh->indices. */
+void indexed_mesh_draw(const indexed_mesh *mesh);
+
+#endif
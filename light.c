@@ -0,0 +1,416 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "light.h"
+#include "parallel.h"
+
+/* Neighbours in the order left, down, back, right, up, front, as mesher.h's face directions. */
+#define DOWN 1
+
+static const int32_t neighbours[6][3] =
+{
+	{ -1, 0, 0 }, { 0, -1, 0 }, { 0, 0, -1 }, { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 }
+};
+
+struct light_node
+{
+	int32_t x, y, z;
+	uint8_t level;		/* What the voxel held when it was queued for removal. */
+};
+
+/* A FIFO of voxels to spread light from, or to take it back out of. */
+struct light_queue
+{
+	struct light_node *nodes;
+	size_t head, tail, capacity;
+	int32_t failed;		/* A push ran out of memory. */
+};
+
+static void queue_init(light_queue *queue)
+{
+	memset(queue, 0, sizeof *queue);
+}
+
+static void queue_push(light_queue *queue, int32_t x, int32_t y, int32_t z, uint8_t level)
+{
+	if (queue->tail == queue->capacity) {
+		/* Slide the live nodes down over the popped ones if that frees enough, otherwise grow. */
+		if (queue->head >= queue->capacity / 2 && queue->head) {
+			memmove(queue->nodes, queue->nodes + queue->head, (queue->tail - queue->head) * sizeof *queue->nodes);
+			queue->tail -= queue->head;
+			queue->head = 0;
+		} else {
+			size_t capacity = queue->capacity ? 2 * queue->capacity : 1024;
+			struct light_node *nodes = realloc(queue->nodes, capacity * sizeof *nodes);
+			if (!nodes) {
+				queue->failed = 1;
+				return;
+			}
+			queue->nodes = nodes;
+			queue->capacity = capacity;
+		}
+	}
+
+	struct light_node *node = &queue->nodes[queue->tail++];
+	node->x = x;
+	node->y = y;
+	node->z = z;
+	node->level = level;
+}
+
+/* Empty the queue for reuse, keeping its memory. Returns 0 if a push failed since the last reset. */
+static int32_t queue_reset(light_queue *queue)
+{
+	int32_t ok = !queue->failed;
+	queue->head = queue->tail = 0;
+	queue->failed = 0;
+	return ok;
+}
+
+static int64_t light_index(const voxel_light *light, int32_t x, int32_t y, int32_t z)
+{
+	return ((int64_t) x * light->size_y + y) * light->size_z + z;
+}
+
+static uint8_t get_level(const voxel_light *light, int32_t x, int32_t y, int32_t z, uint32_t shift)
+{
+	return light->levels[light_index(light, x, y, z)] >> shift & LIGHT_MAX;
+}
+
+static void set_level(voxel_light *light, int32_t x, int32_t y, int32_t z, uint32_t shift, uint8_t level)
+{
+	uint8_t *levels = &light->levels[light_index(light, x, y, z)];
+	*levels = (*levels & ~(LIGHT_MAX << shift)) | level << shift;
+}
+
+/* Whether (x, y, z) is within [low, high) on every axis. */
+static int32_t inside(const int32_t *low, const int32_t *high, int32_t x, int32_t y, int32_t z)
+{
+	return x >= low[0] && y >= low[1] && z >= low[2] && x < high[0] && y < high[1] && z < high[2];
+}
+
+static void mark_chunk(voxel_light *light, int32_t x, int32_t y, int32_t z)
+{
+	int32_t chunks_y = (light->size_y + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	int32_t chunks_z = (light->size_z + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+	light->changed[(x / CHUNK_SIZE * chunks_y + y / CHUNK_SIZE) * chunks_z + z / CHUNK_SIZE] = 1;
+}
+
+/*
+ * Mark the chunks whose faces show voxel (x, y, z)'s light: its own, and
+ * those next to it if it is on the chunk's edge.
+ */
+static void mark_changed(voxel_light *light, int32_t x, int32_t y, int32_t z)
+{
+	mark_chunk(light, x, y, z);
+
+	if (x % CHUNK_SIZE == 0 && x > 0)
+		mark_chunk(light, x - 1, y, z);
+	if (x % CHUNK_SIZE == CHUNK_SIZE - 1 && x < light->size_x - 1)
+		mark_chunk(light, x + 1, y, z);
+	if (y % CHUNK_SIZE == 0 && y > 0)
+		mark_chunk(light, x, y - 1, z);
+	if (y % CHUNK_SIZE == CHUNK_SIZE - 1 && y < light->size_y - 1)
+		mark_chunk(light, x, y + 1, z);
+	if (z % CHUNK_SIZE == 0 && z > 0)
+		mark_chunk(light, x, y, z - 1);
+	if (z % CHUNK_SIZE == CHUNK_SIZE - 1 && z < light->size_z - 1)
+		mark_chunk(light, x, y, z + 1);
+}
+
+/*
+ * Mark the chunks whose faces touch voxel (x, y, z): any of those of the
+ * voxels around it, since a face's corners are darkened by the voxels
+ * diagonally in front of it as well as the one it looks into.
+ */
+static void mark_around(voxel_light *light, int32_t x, int32_t y, int32_t z)
+{
+	int32_t low[3] = { 0, 0, 0 }, high[3] = { light->size_x, light->size_y, light->size_z };
+	int32_t dx, dy, dz;
+	for (dx = -1; dx <= 1; dx++)
+		for (dy = -1; dy <= 1; dy++)
+			for (dz = -1; dz <= 1; dz++)
+				if (inside(low, high, x + dx, y + dy, z + dz))
+					mark_chunk(light, x + dx, y + dy, z + dz);
+}
+
+/*
+ * Spread the light of the queued voxels through empty voxels within
+ * [low, high), a level dimmer with every step, except full sunlight going
+ * down. A voxel only takes light brighter than its own, so light from
+ * several sources comes out as the brightest of them wherever they meet.
+ */
+static void spread(voxel_light *light, const voxel_grid *grid, light_queue *queue, uint32_t shift,
+	const int32_t *low, const int32_t *high, int32_t mark)
+{
+	while (queue->head < queue->tail) {
+		struct light_node node = queue->nodes[queue->head++];
+		uint8_t level = get_level(light, node.x, node.y, node.z, shift);
+		if (level <= 1)
+			continue;
+
+		int32_t i;
+		for (i = 0; i < 6; i++) {
+			int32_t x = node.x + neighbours[i][0], y = node.y + neighbours[i][1], z = node.z + neighbours[i][2];
+			if (!inside(low, high, x, y, z) || voxel_grid_get(grid, x, y, z) != VOXEL_EMPTY)
+				continue;
+
+			uint8_t next = shift == LIGHT_SUN_SHIFT && level == LIGHT_MAX && i == DOWN ? LIGHT_MAX : level - 1;
+			if (get_level(light, x, y, z, shift) >= next)
+				continue;
+
+			set_level(light, x, y, z, shift, next);
+			if (mark)
+				mark_changed(light, x, y, z);
+			queue_push(queue, x, y, z, 0);
+		}
+	}
+}
+
+/*
+ * Take the light of the queued voxels, already darkened, back out of every
+ * voxel it reached. A neighbour at least as bright as the light it could
+ * have had from the voxel is lit some other way, so it goes on the additions
+ * queue to spread back into the darkened region.
+ */
+static void unspread(voxel_light *light, const voxel_grid *grid, uint32_t shift)
+{
+	light_queue *queue = light->removals;
+	int32_t low[3] = { 0, 0, 0 }, high[3] = { light->size_x, light->size_y, light->size_z };
+
+	while (queue->head < queue->tail) {
+		struct light_node node = queue->nodes[queue->head++];
+
+		int32_t i;
+		for (i = 0; i < 6; i++) {
+			int32_t x = node.x + neighbours[i][0], y = node.y + neighbours[i][1], z = node.z + neighbours[i][2];
+			if (!inside(low, high, x, y, z))
+				continue;
+
+			uint8_t level = get_level(light, x, y, z, shift);
+			if (!level)
+				continue;
+
+			int32_t source = shift == LIGHT_BLOCK_SHIFT && voxel_emission(voxel_grid_get(grid, x, y, z));
+			int32_t from_node = level < node.level
+				|| (shift == LIGHT_SUN_SHIFT && i == DOWN && node.level == LIGHT_MAX);
+			if (from_node && !source) {
+				set_level(light, x, y, z, shift, 0);
+				mark_changed(light, x, y, z);
+				queue_push(queue, x, y, z, level);
+			} else {
+				queue_push(light->additions, x, y, z, 0);
+			}
+		}
+	}
+}
+
+voxel_light *voxel_light_new(const voxel_grid *grid)
+{
+	voxel_light *light = calloc(1, sizeof *light);
+	if (!light)
+		return NULL;
+
+	light->size_x = grid->size_x;
+	light->size_y = grid->size_y;
+	light->size_z = grid->size_z;
+	light->num_chunks = voxel_grid_num_chunks(grid);
+
+	light->levels = calloc((size_t) grid->size_x * grid->size_y * grid->size_z, 1);
+	light->changed = calloc(light->num_chunks, 1);
+	light->removals = calloc(1, sizeof *light->removals);
+	light->additions = calloc(1, sizeof *light->additions);
+	if (!light->levels || !light->changed || !light->removals || !light->additions) {
+		voxel_light_free(light);
+		return NULL;
+	}
+
+	return light;
+}
+
+void voxel_light_free(voxel_light *light)
+{
+	if (!light)
+		return;
+
+	if (light->removals)
+		free(light->removals->nodes);
+	if (light->additions)
+		free(light->additions->nodes);
+	free(light->removals);
+	free(light->additions);
+	free(light->levels);
+	free(light->changed);
+	free(light);
+}
+
+struct light_build
+{
+	voxel_light *light;
+	const voxel_grid *grid;
+	uint32_t *chunks;	/* The chunks of the pass being run. */
+	atomic_int failed;
+};
+
+/* Full sunlight down every column of an x slab as far as the first solid voxel. */
+static void light_sky(void *context, uint32_t x)
+{
+	struct light_build *build = context;
+	int32_t y, z;
+
+	for (z = 0; z < build->grid->size_z; z++)
+		for (y = build->grid->size_y - 1; y >= 0 && voxel_grid_get(build->grid, x, y, z) == VOXEL_EMPTY; y--)
+			set_level(build->light, x, y, z, LIGHT_SUN_SHIFT, LIGHT_MAX);
+}
+
+/*
+ * Spread the light of one chunk's emitters and the edges of its sky. It
+ * reaches at most LIGHT_MAX - 1 voxels from the chunk, under CHUNK_SIZE, so
+ * stays within the chunks around it.
+ */
+static void light_chunk(void *context, uint32_t index)
+{
+	struct light_build *build = context;
+	voxel_light *light = build->light;
+	const voxel_grid *grid = build->grid;
+
+	int32_t cx, cy, cz;
+	voxel_grid_chunk_coords(grid, build->chunks[index], &cx, &cy, &cz);
+
+	int32_t grid_low[3] = { 0, 0, 0 }, grid_high[3] = { grid->size_x, grid->size_y, grid->size_z };
+	int32_t chunk[3] = { cx, cy, cz }, low[3], high[3], around_low[3], around_high[3], i;
+	for (i = 0; i < 3; i++) {
+		low[i] = chunk[i] * CHUNK_SIZE;
+		high[i] = low[i] + CHUNK_SIZE < grid_high[i] ? low[i] + CHUNK_SIZE : grid_high[i];
+		around_low[i] = low[i] >= CHUNK_SIZE ? low[i] - CHUNK_SIZE : 0;
+		around_high[i] = high[i] + CHUNK_SIZE < grid_high[i] ? high[i] + CHUNK_SIZE : grid_high[i];
+	}
+
+	light_queue sun, block;
+	queue_init(&sun);
+	queue_init(&block);
+
+	int32_t x, y, z;
+	for (x = low[0]; x < high[0]; x++) {
+		for (y = low[1]; y < high[1]; y++) {
+			for (z = low[2]; z < high[2]; z++) {
+				uint8_t voxel = voxel_grid_get(grid, x, y, z), emission = voxel_emission(voxel);
+				if (emission) {
+					set_level(light, x, y, z, LIGHT_BLOCK_SHIFT, emission);
+					queue_push(&block, x, y, z, 0);
+					continue;
+				}
+
+				/* Sky only needs spreading where it borders something darker than its spread would make it. */
+				if (get_level(light, x, y, z, LIGHT_SUN_SHIFT) != LIGHT_MAX)
+					continue;
+				for (i = 0; i < 6; i++) {
+					int32_t nx = x + neighbours[i][0], ny = y + neighbours[i][1], nz = z + neighbours[i][2];
+					if (inside(grid_low, grid_high, nx, ny, nz) && voxel_grid_get(grid, nx, ny, nz) == VOXEL_EMPTY
+						&& get_level(light, nx, ny, nz, LIGHT_SUN_SHIFT) < LIGHT_MAX - 1) {
+						queue_push(&sun, x, y, z, 0);
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	spread(light, grid, &block, LIGHT_BLOCK_SHIFT, around_low, around_high, 0);
+	spread(light, grid, &sun, LIGHT_SUN_SHIFT, around_low, around_high, 0);
+
+	if (block.failed || sun.failed)
+		atomic_store(&build->failed, 1);
+	free(block.nodes);
+	free(sun.nodes);
+}
+
+int32_t voxel_light_build(voxel_light *light, const voxel_grid *grid)
+{
+	uint32_t num_chunks = voxel_grid_num_chunks(grid);
+	struct light_build build;
+	build.light = light;
+	build.grid = grid;
+	build.chunks = malloc(num_chunks * sizeof *build.chunks);
+	if (!build.chunks)
+		return 0;
+	atomic_init(&build.failed, 0);
+
+	memset(light->levels, 0, (size_t) grid->size_x * grid->size_y * grid->size_z);
+	parallel_for(grid->size_x, light_sky, &build);
+
+	/*
+	 * A chunk's light only reaches the chunks next to it, so chunks three
+	 * apart on some axis never touch the same voxels. Each of the 27 passes
+	 * runs one such set in parallel. Light spreads into voxels another pass
+	 * lit only where it is brighter, so the passes can go in any order.
+	 */
+	int32_t pass;
+	for (pass = 0; pass < 27; pass++) {
+		uint32_t chunk, count = 0;
+		for (chunk = 0; chunk < num_chunks; chunk++) {
+			int32_t cx, cy, cz;
+			voxel_grid_chunk_coords(grid, chunk, &cx, &cy, &cz);
+			if ((cx % 3 * 3 + cy % 3) * 3 + cz % 3 == pass)
+				build.chunks[count++] = chunk;
+		}
+		parallel_for(count, light_chunk, &build);
+	}
+
+	free(build.chunks);
+	return !atomic_load(&build.failed);
+}
+
+/* Take one channel's light out around voxel (x, y, z), then spread back whatever still reaches it. */
+static void update_channel(voxel_light *light, const voxel_grid *grid, int32_t x, int32_t y, int32_t z,
+	uint32_t shift)
+{
+	int32_t low[3] = { 0, 0, 0 }, high[3] = { light->size_x, light->size_y, light->size_z };
+	uint8_t voxel = voxel_grid_get(grid, x, y, z);
+
+	uint8_t level = get_level(light, x, y, z, shift);
+	if (level) {
+		set_level(light, x, y, z, shift, 0);
+		queue_push(light->removals, x, y, z, level);
+		unspread(light, grid, shift);
+	}
+
+	if (shift == LIGHT_BLOCK_SHIFT && voxel_emission(voxel)) {
+		set_level(light, x, y, z, shift, voxel_emission(voxel));
+		queue_push(light->additions, x, y, z, 0);
+	}
+
+	/* An empty voxel takes light from its neighbours, or straight from the sky at the top. */
+	if (voxel == VOXEL_EMPTY) {
+		if (shift == LIGHT_SUN_SHIFT && y == light->size_y - 1) {
+			set_level(light, x, y, z, shift, LIGHT_MAX);
+			queue_push(light->additions, x, y, z, 0);
+		}
+
+		int32_t i;
+		for (i = 0; i < 6; i++) {
+			int32_t nx = x + neighbours[i][0], ny = y + neighbours[i][1], nz = z + neighbours[i][2];
+			if (inside(low, high, nx, ny, nz) && get_level(light, nx, ny, nz, shift))
+				queue_push(light->additions, nx, ny, nz, 0);
+		}
+	}
+
+	spread(light, grid, light->additions, shift, low, high, 1);
+}
+
+int32_t voxel_light_update(voxel_light *light, const voxel_grid *grid, int32_t x, int32_t y, int32_t z)
+{
+	mark_around(light, x, y, z);
+
+	update_channel(light, grid, x, y, z, LIGHT_SUN_SHIFT);
+	int32_t ok = queue_reset(light->removals);
+	ok &= queue_reset(light->additions);
+
+	update_channel(light, grid, x, y, z, LIGHT_BLOCK_SHIFT);
+	ok &= queue_reset(light->removals);
+	ok &= queue_reset(light->additions);
+
+	return ok;
+}
@@ -0,0 +1,79 @@
+#ifndef LIGHT_H
+#define LIGHT_H
+
+#include <stdint.h>
+
+#include "voxel.h"
+
+/* Light levels go from 0, dark, to LIGHT_MAX, losing one per voxel travelled. */
+#define LIGHT_MAX 15
+
+/*
+ * Each voxel's light is a byte: sunlight in the high four bits and block
+ * light, from emitting voxels such as VOXEL_LAMP, in the low four.
+ */
+#define LIGHT_SUN_SHIFT 4
+#define LIGHT_BLOCK_SHIFT 0
+
+/* Full sunlight and no block light: what is outside the grid. */
+#define LIGHT_FULL (LIGHT_MAX << LIGHT_SUN_SHIFT)
+
+typedef struct light_queue light_queue;
+
+/*
+ * Light for every voxel of a grid, flood-filled through empty voxels.
+ * Sunlight comes in at the top of the grid and goes straight down at full
+ * strength until something solid is in the way; from there, like block
+ * light, it spreads out a level dimmer with every step. Solid voxels are
+ * dark apart from those that emit light.
+ *
+ * Storage is x-major like voxel_grid's.
+ */
+typedef struct
+{
+	int32_t size_x, size_y, size_z;
+	uint8_t *levels;
+
+	/*
+	 * Per chunk, set by voxel_light_update for the chunks whose meshes it
+	 * changed the light of; whoever remeshes them clears them.
+	 */
+	uint8_t *changed;
+	uint32_t num_chunks;
+
+	light_queue *removals, *additions;
+} voxel_light;
+
+/* Light for grid, all dark until voxel_light_build. Returns NULL on failure. */
+voxel_light *voxel_light_new(const voxel_grid *grid);
+void voxel_light_free(voxel_light *light);
+
+static inline uint8_t voxel_light_get(const voxel_light *light, int32_t x, int32_t y, int32_t z)
+{
+	return light->levels[((int64_t) x * light->size_y + y) * light->size_z + z];
+}
+
+/* The block light a voxel gives off. */
+static inline uint8_t voxel_emission(uint8_t voxel)
+{
+	return voxel == VOXEL_LAMP ? LIGHT_MAX - 1 : 0;
+}
+
+/*
+ * Light the whole grid from scratch. The sky is filled in column by column,
+ * then the chunks spread their own light on the workers in parallel.
+ * Returns 0 if out of memory, leaving the light incomplete.
+ */
+int32_t voxel_light_build(voxel_light *light, const voxel_grid *grid);
+
+/*
+ * Bring the light up to date after voxel (x, y, z) was changed. The light
+ * the voxel held is taken back out as far as it had spread and whatever
+ * still shines into that region is spread back in, so the work follows the
+ * size of the change rather than of the grid. The chunks whose meshes need
+ * rebuilding, including those showing the voxel itself or its ambient
+ * occlusion, are marked in changed. Returns 0 if out of memory, leaving the light incomplete.
+ */
+int32_t voxel_light_update(voxel_light *light, const voxel_grid *grid, int32_t x, int32_t y, int32_t z);
+
+#endif
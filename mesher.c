@@ -0,0 +1,282 @@
+#include <stdlib.h>
+
+#include "mesher.h"
+
+chunk_mesh *chunk_mesh_new(void)
+{
+	chunk_mesh *mesh = calloc(1, sizeof *mesh);
+	if (!mesh)
+		return NULL;
+
+	mesh->vertices_capacity = 64;
+	mesh->vertices = malloc(mesh->vertices_capacity * COMPONENTS_PER_VERTEX);
+	if (!mesh->vertices) {
+		free(mesh);
+		return NULL;
+	}
+
+	return mesh;
+}
+
+void chunk_mesh_free(chunk_mesh *mesh)
+{
+	if (!mesh)
+		return;
+
+	free(mesh->vertices);
+	free(mesh->faces);
+	free(mesh);
+}
+
+/* Make room for a quad's six vertices. Returns 0 if out of memory. */
+static int32_t reserve_quad(chunk_mesh *mesh)
+{
+	if (mesh->num_vertices + 6 <= mesh->vertices_capacity)
+		return 1;
+
+	uint8_t *vertices = realloc(mesh->vertices, 2 * mesh->vertices_capacity * COMPONENTS_PER_VERTEX);
+	if (!vertices)
+		return 0;
+
+	mesh->vertices = vertices;
+	mesh->vertices_capacity *= 2;
+	return 1;
+}
+
+/*
+ * A quad's corners, indexed by 2 * u + v for steps u and v along its two
+ * axes, in drawing order: two triangles split along the (0, 1)-(1, 0)
+ * diagonal, or flipped, along the (0, 0)-(1, 1) one.
+ */
+static const uint8_t quad_corners[2][6] =
+{
+	{ 1, 3, 2, 2, 0, 1 },
+	{ 0, 1, 3, 3, 2, 0 }
+};
+
+/*
+ * Whether to flip a quad with the corner occlusion given: the diagonal goes
+ * between the brighter pair of corners, so a dark corner shades its own
+ * triangle rather than a streak across the quad.
+ */
+static int32_t flip_quad(const uint8_t *occlusion)
+{
+	return occlusion[0] + occlusion[3] > occlusion[1] + occlusion[2];
+}
+
+/* A corner, (x, y, z) from the chunk's low corner, which is half a voxel below its first voxel's centre. */
+static void add_vertex(chunk_mesh *mesh, int32_t x, int32_t y, int32_t z, uint8_t material, uint8_t light,
+	uint8_t occlusion)
+{
+	uint8_t *vertex = mesh->vertices + mesh->num_vertices++ * COMPONENTS_PER_VERTEX;
+	vertex[0] = x;
+	vertex[1] = y;
+	vertex[2] = z;
+	vertex[3] = material;
+	vertex[4] = light;
+	vertex[5] = occlusion;
+	vertex[6] = vertex[7] = 0;
+}
+
+/*
+ * Quads of voxel (x, y, z) within the chunk, on its low side if side is 0 and its high side if 1.
+ * A quad's axes are the other two in order, x before y before z.
+ */
+static void add_x_quad(chunk_mesh *mesh, int32_t x, int32_t y, int32_t z, int32_t side,
+	uint8_t material, uint8_t light, const uint8_t *occlusion)
+{
+	const uint8_t *order = quad_corners[flip_quad(occlusion)];
+	int32_t i;
+	for (i = 0; i < 6; i++)
+		add_vertex(mesh, x + side, y + (order[i] >> 1), z + (order[i] & 1), material, light, occlusion[order[i]]);
+}
+
+static void add_y_quad(chunk_mesh *mesh, int32_t x, int32_t y, int32_t z, int32_t side,
+	uint8_t material, uint8_t light, const uint8_t *occlusion)
+{
+	const uint8_t *order = quad_corners[flip_quad(occlusion)];
+	int32_t i;
+	for (i = 0; i < 6; i++)
+		add_vertex(mesh, x + (order[i] >> 1), y + side, z + (order[i] & 1), material, light, occlusion[order[i]]);
+}
+
+static void add_z_quad(chunk_mesh *mesh, int32_t x, int32_t y, int32_t z, int32_t side,
+	uint8_t material, uint8_t light, const uint8_t *occlusion)
+{
+	const uint8_t *order = quad_corners[flip_quad(occlusion)];
+	int32_t i;
+	for (i = 0; i < 6; i++)
+		add_vertex(mesh, x + (order[i] >> 1), y + (order[i] & 1), z + side, material, light, occlusion[order[i]]);
+}
+
+/* A face record, left out if there is no room for it. */
+static void add_face_record(chunk_mesh *mesh, int32_t x, int32_t y, int32_t z, uint32_t direction,
+	uint8_t material, uint8_t light)
+{
+	if (mesh->num_faces == mesh->faces_capacity) {
+		uint32_t capacity = mesh->faces_capacity ? 2 * mesh->faces_capacity : 64;
+		uint32_t *faces = realloc(mesh->faces, capacity * sizeof *faces);
+		if (!faces)
+			return;
+		mesh->faces = faces;
+		mesh->faces_capacity = capacity;
+	}
+
+	mesh->faces[mesh->num_faces++] = face_record(x, y, z, direction, material, light);
+}
+
+/* What mesh_chunk is working on, for add_face. */
+typedef struct
+{
+	chunk_mesh *mesh;
+	const voxel_grid *grid;
+	const voxel_light *light;
+	int32_t low[3];	/* The chunk's low voxel. */
+	int64_t strides[3];	/* Between the indices of neighbouring voxels along each axis. */
+	int32_t records;	/* Whether to add face records rather than quads. */
+	int32_t occlusion;	/* Whether quads get ambient occlusion. */
+} chunk_meshing;
+
+/*
+ * The ambient occlusion of the four corners of a face, indexed like
+ * flip_quad's, from the voxels around the one in front of it, at index
+ * front. Each corner is darkened by the three voxels that touch it there,
+ * the two beside it and the one diagonally across; with both sides solid,
+ * the corner is closed in and fully dark whatever the diagonal is. The
+ * voxel in front is at position along the face's axes u and v.
+ */
+static void face_occlusion(const chunk_meshing *meshing, int64_t front, const int32_t *position, int32_t u,
+	int32_t v, uint8_t *occlusion)
+{
+	const voxel_grid *grid = meshing->grid;
+	const uint8_t *voxel = grid->voxels + front;
+	int64_t step_u = meshing->strides[u], step_v = meshing->strides[v];
+	int32_t size[3] = { grid->size_x, grid->size_y, grid->size_z };
+
+	/*
+	 * Which neighbours along u and v are in the grid; nothing outside it is
+	 * solid. Steps that would leave it stay on the voxel in front, which is
+	 * empty since the face shows, so the reads need no branches.
+	 */
+	int32_t in_u[2] = { position[u] > 0, position[u] < size[u] - 1 };
+	int32_t in_v[2] = { position[v] > 0, position[v] < size[v] - 1 };
+	int64_t steps_u[2] = { in_u[0] ? -step_u : 0, in_u[1] ? step_u : 0 };
+	int64_t steps_v[2] = { in_v[0] ? -step_v : 0, in_v[1] ? step_v : 0 };
+
+	int32_t i, j;
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < 2; j++) {
+			int32_t side_u = voxel[steps_u[i]] != 0, side_v = voxel[steps_v[j]] != 0;
+			int32_t corner = (voxel[steps_u[i] + steps_v[j]] != 0) & in_u[i] & in_v[j];
+			occlusion[2 * i + j] = 3 - side_u - side_v - (corner | (side_u & side_v));
+		}
+	}
+}
+
+/*
+ * A face of voxel (x, y, z) of the grid, looking into the voxel at index
+ * front, or out of the grid if inside is 0. It takes its light from that voxel.
+ */
+static void add_face(const chunk_meshing *meshing, int32_t x, int32_t y, int32_t z, uint32_t direction,
+	uint8_t material, int64_t front, int32_t inside)
+{
+	chunk_mesh *mesh = meshing->mesh;
+	uint8_t light = meshing->light && inside ? meshing->light->levels[front] : LIGHT_FULL;
+	int32_t cx = x - meshing->low[0], cy = y - meshing->low[1], cz = z - meshing->low[2];
+
+	if (meshing->records) {
+		add_face_record(mesh, cx, cy, cz, direction, material, light);
+		return;
+	}
+
+	if (!reserve_quad(mesh))
+		return;
+
+	/* The negative directions double as the axes; the quad's own are the other two in order. */
+	int32_t axis = direction % 3, side = direction >= FACE_RIGHT;
+	uint8_t occlusion[4] = { 3, 3, 3, 3 };
+	if (meshing->occlusion && inside) {
+		int32_t position[3] = { x, y, z };
+		face_occlusion(meshing, front, position, axis == 0, axis == 2 ? 1 : 2, occlusion);
+	}
+
+	switch (axis) {
+	case FACE_LEFT:
+		add_x_quad(mesh, cx, cy, cz, side, material, light, occlusion);
+		break;
+	case FACE_BOTTOM:
+		add_y_quad(mesh, cx, cy, cz, side, material, light, occlusion);
+		break;
+	case FACE_BACK:
+		add_z_quad(mesh, cx, cy, cz, side, material, light, occlusion);
+		break;
+	}
+}
+
+static void mesh_chunk(const voxel_grid *grid, const voxel_light *light, int32_t cx, int32_t cy, int32_t cz,
+	chunk_mesh *mesh, int32_t records)
+{
+	int32_t x0 = cx * CHUNK_SIZE, x1 = x0 + CHUNK_SIZE;
+	int32_t y0 = cy * CHUNK_SIZE, y1 = y0 + CHUNK_SIZE;
+	int32_t z0 = cz * CHUNK_SIZE, z1 = z0 + CHUNK_SIZE;
+
+	if (x1 > grid->size_x)
+		x1 = grid->size_x;
+	if (y1 > grid->size_y)
+		y1 = grid->size_y;
+	if (z1 > grid->size_z)
+		z1 = grid->size_z;
+
+	/* Neighbours, and their light, are found by stepping from the voxel's index. */
+	int64_t stride_x = (int64_t) grid->size_y * grid->size_z, stride_y = grid->size_z;
+	const uint8_t *voxels = grid->voxels;
+
+	/* Only quads of shaded meshes get ambient occlusion; face records have no room left for it. */
+	chunk_meshing meshing = { mesh, grid, light, { x0, y0, z0 }, { stride_x, stride_y, 1 }, records,
+		light && !records };
+
+	int32_t x, y, z;
+	for (x = x0; x < x1; x++) {
+		for (y = y0; y < y1; y++) {
+			int64_t index = x * stride_x + y * stride_y + z0;
+			for (z = z0; z < z1; z++, index++) {
+				uint8_t voxel = voxels[index];
+				if (!voxel)
+					continue;
+
+				int32_t left = x > 0, bottom = y > 0, back = z > 0;
+				int32_t right = x < grid->size_x - 1, top = y < grid->size_y - 1, front = z < grid->size_z - 1;
+
+				if (!left || !voxels[index - stride_x]) /* Do left. */
+					add_face(&meshing, x, y, z, FACE_LEFT, voxel, index - stride_x, left);
+
+				if (!bottom || !voxels[index - stride_y]) /* Do bottom. */
+					add_face(&meshing, x, y, z, FACE_BOTTOM, voxel, index - stride_y, bottom);
+
+				if (!back || !voxels[index - 1]) /* Do back. */
+					add_face(&meshing, x, y, z, FACE_BACK, voxel, index - 1, back);
+
+				if (!right || !voxels[index + stride_x]) /* Do right. */
+					add_face(&meshing, x, y, z, FACE_RIGHT, voxel, index + stride_x, right);
+
+				if (!top || !voxels[index + stride_y]) /* Do top. */
+					add_face(&meshing, x, y, z, FACE_TOP, voxel, index + stride_y, top);
+
+				if (!front || !voxels[index + 1]) /* Do front. */
+					add_face(&meshing, x, y, z, FACE_FRONT, voxel, index + 1, front);
+			}
+		}
+	}
+}
+
+void mesher_mesh_chunk(const voxel_grid *grid, const voxel_light *light, int32_t cx, int32_t cy, int32_t cz,
+	chunk_mesh *mesh)
+{
+	mesh_chunk(grid, light, cx, cy, cz, mesh, 0);
+}
+
+void mesher_mesh_chunk_faces(const voxel_grid *grid, const voxel_light *light, int32_t cx, int32_t cy,
+	int32_t cz, chunk_mesh *mesh)
+{
+	mesh_chunk(grid, light, cx, cy, cz, mesh, 1);
+}
@@ -0,0 +1,83 @@
+#ifndef MESHER_H
+#define MESHER_H
+
+#include <stdint.h>
+
+#include "light.h"
+#include "voxel.h"
+
+#define COMPONENTS_PER_VERTEX 8
+
+/* Which way a face looks, in face records. The positive directions are 3 more than the negative. */
+#define FACE_LEFT 0	/* -x */
+#define FACE_BOTTOM 1	/* -y */
+#define FACE_BACK 2	/* -z */
+#define FACE_RIGHT 3	/* +x */
+#define FACE_TOP 4	/* +y */
+#define FACE_FRONT 5	/* +z */
+
+/*
+ * One chunk's visible faces, in one of two forms. As triangle soup, each
+ * face is six vertices of eight bytes: an x, y, z position, a material,
+ * the voxel's value, coloured by palette.c, the light of the voxel the face
+ * looks into, as light.h keeps it, the corner's ambient occlusion, from 0,
+ * darkest, to 3 in the low two bits of the next byte, and two bytes of
+ * padding. The occlusion has a byte of its own because the material and
+ * light use all their bits, and packing it into the positions' spare ones
+ * would save nothing: the vertex is padded to eight bytes either way. As
+ * face records, each face is a single uint32_t from face_record, and the
+ * vertex shader makes the quad itself; there is no room in them for
+ * occlusion. A mesh holds one form or the other.
+ *
+ * Positions are relative to the chunk, so they stay small and exact
+ * however far the chunk is from the world's origin; the renderer adds the
+ * chunk's position relative to the camera. Vertex positions count from the
+ * chunk's low corner, half a voxel below its first voxel's centre, so they
+ * are whole numbers from 0 to CHUNK_SIZE.
+ */
+typedef struct
+{
+	uint8_t *vertices;
+	uint32_t num_vertices, vertices_capacity;
+
+	uint32_t *faces;
+	uint32_t num_faces, faces_capacity;
+} chunk_mesh;
+
+chunk_mesh *chunk_mesh_new(void);
+void chunk_mesh_free(chunk_mesh *mesh);
+
+/* Vertices to draw for the mesh, in either form. */
+static inline uint32_t chunk_mesh_num_vertices(const chunk_mesh *mesh)
+{
+	return mesh->num_vertices + 6 * mesh->num_faces;
+}
+
+/*
+ * Pack a face of the voxel at (x, y, z) within its chunk: the position in
+ * bits 0-11, four bits an axis, the direction in bits 12-14, the material
+ * in bits 16-23 and the light in bits 24-31.
+ */
+static inline uint32_t face_record(int32_t x, int32_t y, int32_t z, uint32_t direction, uint8_t material,
+	uint8_t light)
+{
+	return (uint32_t) x | (uint32_t) y << 4 | (uint32_t) z << 8 | direction << 12 | (uint32_t) material << 16
+		| (uint32_t) light << 24;
+}
+
+/*
+ * Append a quad for every visible face of the solid voxels in chunk (cx, cy, cz).
+ * A face is visible if it lies on the edge of the grid or borders empty space.
+ * Faces take their light from light, and their corners are darkened by the
+ * solid voxels around them, with each quad split along the diagonal that
+ * shades it most evenly. If light is NULL, faces are fully lit and not
+ * darkened at all.
+ */
+void mesher_mesh_chunk(const voxel_grid *grid, const voxel_light *light, int32_t cx, int32_t cy, int32_t cz,
+	chunk_mesh *mesh);
+
+/* The same faces as face records. */
+void mesher_mesh_chunk_faces(const voxel_grid *grid, const voxel_light *light, int32_t cx, int32_t cy,
+	int32_t cz, chunk_mesh *mesh);
+
+#endif
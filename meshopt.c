@@ -0,0 +1,203 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "meshopt.h"
+
+/* The LRU cache Forsyth's scores are tuned for. */
+#define CACHE_SIZE 32
+
+#define CACHE_DECAY_POWER 1.5f
+#define LAST_TRIANGLE_SCORE 0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+
+float meshopt_acmr(const uint32_t *indices, uint32_t num_indices, uint32_t cache_size)
+{
+	if (num_indices < 3)
+		return 0.0f;
+
+	uint32_t cache[cache_size];
+	uint32_t i, j, size = 0, head = 0, misses = 0;
+
+	for (i = 0; i < num_indices; i++) {
+		for (j = 0; j < size && cache[j] != indices[i]; j++)
+			;
+		if (j < size)
+			continue;
+
+		misses++;
+		if (size < cache_size) {
+			cache[size++] = indices[i];
+		} else {
+			cache[head] = indices[i];
+			head = (head + 1) % cache_size;
+		}
+	}
+
+	return (float) misses / (num_indices / 3);
+}
+
+struct vertex
+{
+	float score;
+	int32_t cache_position;		/* -1 when not in the cache. */
+	uint32_t first_triangle;	/* Into triangle_lists. */
+	uint32_t num_triangles;		/* Triangles not yet output. */
+};
+
+static float vertex_score(const struct vertex *vertex)
+{
+	if (!vertex->num_triangles)
+		return -1.0f;
+
+	float score = 0.0f;
+	if (vertex->cache_position >= 0) {
+		if (vertex->cache_position < 3) {
+			score = LAST_TRIANGLE_SCORE;
+		} else {
+			float scale = 1.0f / (CACHE_SIZE - 3);
+			score = powf(1.0f - (vertex->cache_position - 3) * scale, CACHE_DECAY_POWER);
+		}
+	}
+
+	return score + VALENCE_BOOST_SCALE * powf(vertex->num_triangles, -VALENCE_BOOST_POWER);
+}
+
+void meshopt_optimize_vertex_cache(uint32_t *indices, uint32_t num_indices, uint32_t num_vertices)
+{
+	uint32_t num_triangles = num_indices / 3;
+	if (!num_triangles)
+		return;
+
+	struct vertex *vertices = calloc(num_vertices, sizeof *vertices);
+	uint32_t *triangle_lists = malloc(num_indices * sizeof *triangle_lists);
+	float *triangle_scores = malloc(num_triangles * sizeof *triangle_scores);
+	uint8_t *emitted = calloc(num_triangles, 1);
+	uint32_t *output = malloc(num_indices * sizeof *output);
+	if (!vertices || !triangle_lists || !triangle_scores || !emitted || !output)
+		goto done;
+
+	/* Each vertex's triangles, packed one vertex after another. */
+	uint32_t i, j, k, offset = 0;
+	for (i = 0; i < num_indices; i++)
+		vertices[indices[i]].num_triangles++;
+	for (i = 0; i < num_vertices; i++) {
+		vertices[i].first_triangle = offset;
+		offset += vertices[i].num_triangles;
+		vertices[i].num_triangles = 0;
+		vertices[i].cache_position = -1;
+	}
+	for (i = 0; i < num_indices; i++) {
+		struct vertex *vertex = &vertices[indices[i]];
+		triangle_lists[vertex->first_triangle + vertex->num_triangles++] = i / 3;
+	}
+
+	for (i = 0; i < num_vertices; i++)
+		vertices[i].score = vertex_score(&vertices[i]);
+	for (i = 0; i < num_triangles; i++)
+		triangle_scores[i] = vertices[indices[3 * i]].score + vertices[indices[3 * i + 1]].score
+			+ vertices[indices[3 * i + 2]].score;
+
+	/* One spare slot per corner of the triangle being added. */
+	uint32_t cache[CACHE_SIZE + 3], cache_used = 0, new_cache[CACHE_SIZE + 3];
+	uint32_t num_emitted = 0, next_unemitted = 0;
+	int64_t best = -1;
+
+	while (num_emitted < num_triangles) {
+		/* Nothing in the cache has triangles left, so take the next one in order. */
+		if (best < 0) {
+			while (emitted[next_unemitted])
+				next_unemitted++;
+			best = next_unemitted;
+		}
+
+		const uint32_t *triangle = &indices[3 * best];
+		memcpy(&output[3 * num_emitted++], triangle, 3 * sizeof *triangle);
+		emitted[best] = 1;
+
+		/* Drop the triangle from its vertices' lists of remaining triangles. */
+		for (j = 0; j < 3; j++) {
+			struct vertex *vertex = &vertices[triangle[j]];
+			uint32_t *list = &triangle_lists[vertex->first_triangle];
+			for (k = 0; list[k] != best; k++)
+				;
+			list[k] = list[--vertex->num_triangles];
+		}
+
+		/* Move the triangle's vertices to the front of the LRU cache. */
+		uint32_t new_used = 0;
+		for (j = 0; j < 3; j++)
+			new_cache[new_used++] = triangle[j];
+		for (j = 0; j < cache_used; j++)
+			if (cache[j] != triangle[0] && cache[j] != triangle[1] && cache[j] != triangle[2])
+				new_cache[new_used++] = cache[j];
+
+		/* Rescore everything that was in the cache, including what fell out of it. */
+		for (j = 0; j < new_used; j++) {
+			struct vertex *vertex = &vertices[new_cache[j]];
+			vertex->cache_position = j < CACHE_SIZE ? (int32_t) j : -1;
+			float delta = -vertex->score;
+			vertex->score = vertex_score(vertex);
+			delta += vertex->score;
+			for (k = 0; k < vertex->num_triangles; k++)
+				triangle_scores[triangle_lists[vertex->first_triangle + k]] += delta;
+		}
+
+		cache_used = new_used < CACHE_SIZE ? new_used : CACHE_SIZE;
+		memcpy(cache, new_cache, cache_used * sizeof *cache);
+
+		/* The next triangle is the best one touching the cache. */
+		float best_score = -1.0f;
+		best = -1;
+		for (j = 0; j < cache_used; j++) {
+			const struct vertex *vertex = &vertices[cache[j]];
+			for (k = 0; k < vertex->num_triangles; k++) {
+				uint32_t t = triangle_lists[vertex->first_triangle + k];
+				if (triangle_scores[t] > best_score) {
+					best_score = triangle_scores[t];
+					best = t;
+				}
+			}
+		}
+	}
+
+	memcpy(indices, output, num_indices * sizeof *indices);
+
+done:
+	free(vertices);
+	free(triangle_lists);
+	free(triangle_scores);
+	free(emitted);
+	free(output);
+}
+
+uint32_t meshopt_optimize_vertex_fetch(void *vertices, size_t vertex_size, uint32_t num_vertices,
+	uint32_t *indices, uint32_t num_indices)
+{
+	uint32_t *remap = malloc(num_vertices * sizeof *remap);
+	uint8_t *reordered = malloc(num_vertices * vertex_size);
+	if (!remap || !reordered) {
+		free(remap);
+		free(reordered);
+		return num_vertices;
+	}
+
+	uint32_t i, used = 0;
+	memset(remap, 0xff, num_vertices * sizeof *remap);
+	for (i = 0; i < num_indices; i++) {
+		uint32_t vertex = indices[i];
+		if (remap[vertex] == UINT32_MAX) {
+			remap[vertex] = used;
+			memcpy(reordered + used * vertex_size, (uint8_t *) vertices + vertex * vertex_size, vertex_size);
+			used++;
+		}
+		indices[i] = remap[vertex];
+	}
+
+	memcpy(vertices, reordered, used * vertex_size);
+	free(remap);
+	free(reordered);
+
+	return used;
+}
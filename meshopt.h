@@ -0,0 +1,36 @@
+#ifndef MESHOPT_H
+#define MESHOPT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Offline reordering of indexed triangle lists. Neither pass changes what is
+ * drawn, only the order it is drawn in, so they cost nothing at run time.
+ */
+
+/* Entries in the FIFO post-transform cache meshopt_acmr simulates. */
+#define MESHOPT_ACMR_CACHE_SIZE 16
+
+/*
+ * Average cache miss ratio: vertices transformed per triangle with a FIFO
+ * cache of cache_size entries. 3 is the worst; a closed mesh approaches 0.5.
+ */
+float meshopt_acmr(const uint32_t *indices, uint32_t num_indices, uint32_t cache_size);
+
+/*
+ * Reorder the triangles for the post-transform cache using Tom Forsyth's
+ * linear-speed algorithm. Left as is if out of memory.
+ */
+void meshopt_optimize_vertex_cache(uint32_t *indices, uint32_t num_indices, uint32_t num_vertices);
+
+/*
+ * Reorder the vertices into the order the indices first use them and rewrite
+ * the indices to match, so vertex fetches walk forward through memory.
+ * Unused vertices are dropped. Returns the number of vertices left, or
+ * num_vertices with nothing changed if out of memory.
+ */
+uint32_t meshopt_optimize_vertex_fetch(void *vertices, size_t vertex_size, uint32_t num_vertices,
+	uint32_t *indices, uint32_t num_indices);
+
+#endif
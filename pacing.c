@@ -0,0 +1,129 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pacing.h"
+#include "timing.h"
+
+/* How long before a deadline to stop sleeping and start spinning. */
+#define SPIN_WINDOW 0.0015
+
+/* The longest frame_pacer_poll sleeps before going back to its caller. */
+#define POLL_SLEEP 0.004
+
+void frame_pacer_init(frame_pacer *pacer, pacing_mode mode, double target_fps)
+{
+	pacer->mode = mode;
+	pacer->target_fps = target_fps;
+	pacer->next_frame = 0;
+}
+
+int32_t frame_pacer_parse(frame_pacer *pacer, const char *value)
+{
+	if (!strcmp(value, "uncapped")) {
+		pacer->mode = PACING_UNCAPPED;
+		return 1;
+	}
+
+	if (!strcmp(value, "ondemand")) {
+		pacer->mode = PACING_ON_DEMAND;
+		return 1;
+	}
+
+	char *end;
+	double target_fps = strtod(value, &end);
+	if (end == value || *end || target_fps <= 0)
+		return 0;
+
+	pacer->mode = PACING_TARGET_FPS;
+	pacer->target_fps = target_fps;
+	return 1;
+}
+
+int32_t frame_pacer_parse_args(frame_pacer *pacer, int argc, char **argv)
+{
+	int i;
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-uncapped")) {
+			pacer->mode = PACING_UNCAPPED;
+			continue;
+		}
+
+		if (!strcmp(argv[i], "-ondemand")) {
+			pacer->mode = PACING_ON_DEMAND;
+			continue;
+		}
+
+		/* frame_pacer_parse would take "uncapped" and "ondemand" as well. */
+		if (!strcmp(argv[i], "-fps") && i + 1 < argc && strcmp(argv[i + 1], "uncapped")
+			&& strcmp(argv[i + 1], "ondemand") && frame_pacer_parse(pacer, argv[i + 1])) {
+			i++;
+			continue;
+		}
+
+		fprintf(stderr, "Usage: %s [-uncapped | -fps <n> | -ondemand]\n", argv[0]);
+		return 0;
+	}
+
+	return 1;
+}
+
+void frame_pacer_wait(frame_pacer *pacer)
+{
+	if (pacer->mode != PACING_TARGET_FPS)
+		return;
+
+	double period = 1.0 / pacer->target_fps;
+	double now = timing_now();
+
+	/* After a stall, start a fresh schedule rather than rushing to catch up. */
+	if (pacer->next_frame + period < now)
+		pacer->next_frame = now;
+
+	pacer->next_frame += period;
+	pacing_wait_until(pacer->next_frame);
+}
+
+int32_t frame_pacer_poll(frame_pacer *pacer)
+{
+	if (pacer->mode != PACING_TARGET_FPS)
+		return 1;
+
+	double period = 1.0 / pacer->target_fps;
+	double now = timing_now();
+
+	if (pacer->next_frame + period < now)
+		pacer->next_frame = now;
+
+	double deadline = pacer->next_frame + period;
+	if (deadline - now > SPIN_WINDOW) {
+		pacing_sleep_until(deadline - SPIN_WINDOW < now + POLL_SLEEP ? deadline - SPIN_WINDOW : now + POLL_SLEEP);
+		return 0;
+	}
+
+	pacing_wait_until(deadline);
+	pacer->next_frame = deadline;
+	return 1;
+}
+
+void pacing_sleep_until(double deadline)
+{
+	if (timing_now() >= deadline)
+		return;
+
+	struct timespec wake;
+	wake.tv_sec = (time_t) deadline;
+	wake.tv_nsec = (long) ((deadline - wake.tv_sec) * 1e9);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR)
+		;
+}
+
+void pacing_wait_until(double deadline)
+{
+	pacing_sleep_until(deadline - SPIN_WINDOW);
+
+	while (timing_now() < deadline)
+		;
+}
@@ -0,0 +1,56 @@
+#ifndef PACING_H
+#define PACING_H
+
+#include <stdint.h>
+
+typedef enum
+{
+	PACING_UNCAPPED,	/* Draw as fast as possible, for benchmarking. */
+	PACING_TARGET_FPS,	/* Draw at a fixed rate, sleeping between frames. */
+	PACING_ON_DEMAND	/* Draw only after input, a resize or while animating. */
+} pacing_mode;
+
+typedef struct
+{
+	pacing_mode mode;
+	double target_fps;
+	double next_frame;
+} frame_pacer;
+
+void frame_pacer_init(frame_pacer *pacer, pacing_mode mode, double target_fps);
+
+/*
+ * Set the mode from a command-line value: "uncapped", "ondemand" or a target
+ * framerate such as "60". Returns 0 if the value isn't recognised.
+ */
+int32_t frame_pacer_parse(frame_pacer *pacer, const char *value);
+
+/*
+ * Set the mode from the GLUT demos' command line, what glutInit leaves of
+ * it: -uncapped, -fps N or -ondemand. Anything else, or an -fps without a
+ * framerate, prints the usage and returns 0.
+ */
+int32_t frame_pacer_parse_args(frame_pacer *pacer, int argc, char **argv);
+
+/* In target framerate mode, block until the next frame is due. */
+void frame_pacer_wait(frame_pacer *pacer);
+
+/*
+ * Like frame_pacer_wait, but for event loops that mustn't block for a whole
+ * frame: sleeps for at most a few milliseconds and returns 0 if the next
+ * frame isn't due yet, or waits out the last stretch and returns 1 if it is.
+ * Always 1 outside target framerate mode.
+ */
+int32_t frame_pacer_poll(frame_pacer *pacer);
+
+/*
+ * Block until timing_now() reaches deadline. Most of the wait is slept; the
+ * last stretch is spun because sleeps routinely overshoot by a millisecond or
+ * more.
+ */
+void pacing_wait_until(double deadline);
+
+/* Sleep until roughly deadline, for threads that can tolerate some overshoot. */
+void pacing_sleep_until(double deadline);
+
+#endif
@@ -0,0 +1,55 @@
+#include <stdlib.h>
+
+#include "palette.h"
+#include "voxel.h"
+
+material_palette *material_palette_new(void)
+{
+	material_palette *palette = calloc(1, sizeof *palette);
+	if (!palette)
+		return NULL;
+
+	material_palette_set(palette, VOXEL_GRASS, 0, 255, 0, 255);
+	material_palette_set(palette, VOXEL_DIRT, 134, 96, 67, 255);
+	material_palette_set(palette, VOXEL_STONE, 128, 128, 128, 255);
+	material_palette_set(palette, VOXEL_LAMP, 255, 224, 160, 255);
+
+	glGenTextures(1, &palette->texture);
+	glActiveTexture(GL_TEXTURE0 + PALETTE_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_1D, palette->texture);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA8, PALETTE_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, palette->colours);
+
+	/* Everything else expects unit 0 to be active. */
+	glActiveTexture(GL_TEXTURE0);
+
+	return palette;
+}
+
+void material_palette_free(material_palette *palette)
+{
+	if (!palette)
+		return;
+
+	glDeleteTextures(1, &palette->texture);
+	free(palette);
+}
+
+void material_palette_set(material_palette *palette, uint8_t material,
+	uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+	palette->colours[material][0] = r;
+	palette->colours[material][1] = g;
+	palette->colours[material][2] = b;
+	palette->colours[material][3] = a;
+}
+
+void material_palette_upload(const material_palette *palette)
+{
+	glActiveTexture(GL_TEXTURE0 + PALETTE_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_1D, palette->texture);
+	glTexSubImage1D(GL_TEXTURE_1D, 0, 0, PALETTE_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, palette->colours);
+	glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,39 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+
+/* One entry per possible voxel value. */
+#define PALETTE_SIZE 256
+
+/* The texture unit the palette stays bound to. */
+#define PALETTE_TEXTURE_UNIT 1
+
+/*
+ * Colours for voxel materials. Meshes carry each vertex's voxel value
+ * instead of a colour, and shaders look the value up in this palette, a
+ * 256-texel 1D texture. Recolouring the world is then a 1 KB upload rather
+ * than a remesh.
+ */
+typedef struct
+{
+	GLuint texture;
+	uint8_t colours[PALETTE_SIZE][4];
+} material_palette;
+
+/*
+ * Make the texture with colours for voxel.h's materials, upload it
+ * and bind it to PALETTE_TEXTURE_UNIT. Returns NULL if out of memory.
+ */
+material_palette *material_palette_new(void);
+void material_palette_free(material_palette *palette);
+
+/* Change a material's RGBA colour. Takes effect on the next upload. */
+void material_palette_set(material_palette *palette, uint8_t material,
+	uint8_t r, uint8_t g, uint8_t b, uint8_t a);
+
+/* Send the colours to the texture. Must be called with the context current. */
+void material_palette_upload(const material_palette *palette);
+
+#endif
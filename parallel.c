@@ -0,0 +1,61 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "parallel.h"
+
+#define MAX_THREADS 64
+
+struct parallel_job
+{
+	parallel_fn fn;
+	void *context;
+	uint32_t count;
+	atomic_uint next;
+};
+
+static void *worker(void *arg)
+{
+	struct parallel_job *job = arg;
+	uint32_t i;
+
+	while ((i = atomic_fetch_add(&job->next, 1)) < job->count)
+		job->fn(job->context, i);
+
+	return NULL;
+}
+
+uint32_t parallel_thread_count(void)
+{
+	long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (online < 1)
+		return 1;
+	if (online > MAX_THREADS)
+		return MAX_THREADS;
+	return online;
+}
+
+void parallel_for(uint32_t count, parallel_fn fn, void *context)
+{
+	struct parallel_job job = { .fn = fn, .context = context, .count = count };
+	atomic_init(&job.next, 0);
+
+	uint32_t num_threads = parallel_thread_count();
+	if (num_threads > count)
+		num_threads = count;
+
+	/* The calling thread is one of the workers. */
+	pthread_t threads[MAX_THREADS];
+	uint32_t i, started = 0;
+	for (i = 1; i < num_threads; i++) {
+		if (pthread_create(&threads[started], NULL, worker, &job))
+			break;
+		started++;
+	}
+
+	worker(&job);
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+}
@@ -0,0 +1,18 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdint.h>
+
+typedef void (*parallel_fn)(void *context, uint32_t index);
+
+/* Number of worker threads parallel_for will use (one per online CPU). */
+uint32_t parallel_thread_count(void);
+
+/*
+ * Call fn(context, i) for every i in [0, count) spread over worker threads and
+ * return once all calls have finished. Indices are handed out dynamically, so
+ * uneven work items balance themselves.
+ */
+void parallel_for(uint32_t count, parallel_fn fn, void *context);
+
+#endif
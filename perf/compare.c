@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Compares results written by bench/main.c's --json and Demo.c's
+ * --benchmark-json against a baseline in the same format and exits with 1 if
+ * anything got slower than the thresholds allow. The files hold one flat
+ * JSON object per line, a "name" and numbers; that is all this reads.
+ *
+ * Two kinds of number are checked: p95_ms, a time that may grow by at most
+ * --time-threshold percent, and anything ending in _per_s, a throughput that
+ * may shrink by at most --throughput-threshold percent. The rest are only
+ * there for people reading the files.
+ *
+ * Given several runs, each number is taken from the run where it is best,
+ * which filters out most of the noise of a busy machine. --best prints that
+ * combination of the runs instead of comparing it, to make a baseline.
+ */
+
+#define DEFAULT_THRESHOLD 5.0
+
+#define MAX_RUNS 16
+
+#define MAX_NAME 128
+#define MAX_METRICS 8
+#define MAX_LINE 1024
+
+struct metric
+{
+	char key[32];
+	double value;
+};
+
+struct result
+{
+	char name[MAX_NAME];
+	struct metric metrics[MAX_METRICS];
+	int num_metrics;
+};
+
+struct results
+{
+	struct result *results;
+	int num_results;
+};
+
+/* Copy the string starting at text, just past its opening quote, into out. Returns what follows it, or NULL. */
+static const char *read_string(const char *text, char *out, size_t size)
+{
+	const char *end = strchr(text, '"');
+	if (!end || (size_t) (end - text) >= size)
+		return NULL;
+
+	memcpy(out, text, end - text);
+	out[end - text] = '\0';
+	return end + 1;
+}
+
+/* Fill result from a line like {"name": "...", "key": 1.5, ...}. Returns 0 if it isn't one. */
+static int parse_line(const char *line, struct result *result)
+{
+	result->num_metrics = 0;
+	result->name[0] = '\0';
+
+	const char *next = line;
+	while ((next = strchr(next, '"'))) {
+		char key[32];
+		next = read_string(next + 1, key, sizeof key);
+		if (!next)
+			return 0;
+
+		next += strspn(next, " \t:");
+		if (*next == '"') {
+			if (strcmp(key, "name"))
+				return 0;
+			next = read_string(next + 1, result->name, sizeof result->name);
+			if (!next)
+				return 0;
+			continue;
+		}
+
+		char *end;
+		double value = strtod(next, &end);
+		if (end == next || result->num_metrics == MAX_METRICS)
+			return 0;
+
+		struct metric *metric = &result->metrics[result->num_metrics++];
+		strcpy(metric->key, key);
+		metric->value = value;
+		next = end;
+	}
+
+	return result->name[0] != '\0';
+}
+
+static int load(const char *path, struct results *results)
+{
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		fprintf(stderr, "Couldn't open %s.\n", path);
+		return 0;
+	}
+
+	char line[MAX_LINE];
+	int capacity = 0, number = 0;
+	results->results = NULL;
+	results->num_results = 0;
+
+	while (fgets(line, sizeof line, file)) {
+		number++;
+		if (strspn(line, " \t\r\n") == strlen(line))
+			continue;
+
+		if (results->num_results == capacity) {
+			capacity = capacity ? 2 * capacity : 64;
+			struct result *grown = realloc(results->results, capacity * sizeof *grown);
+			if (!grown) {
+				fprintf(stderr, "Memory allocation error.\n");
+				fclose(file);
+				return 0;
+			}
+			results->results = grown;
+		}
+
+		if (!parse_line(line, &results->results[results->num_results])) {
+			fprintf(stderr, "%s:%d: not a result line.\n", path, number);
+			fclose(file);
+			return 0;
+		}
+		results->num_results++;
+	}
+
+	fclose(file);
+	return 1;
+}
+
+static const struct result *find(const struct results *results, const char *name)
+{
+	int i;
+	for (i = 0; i < results->num_results; i++)
+		if (!strcmp(results->results[i].name, name))
+			return &results->results[i];
+	return NULL;
+}
+
+static const struct metric *find_metric(const struct result *result, const char *key)
+{
+	int i;
+	for (i = 0; i < result->num_metrics; i++)
+		if (!strcmp(result->metrics[i].key, key))
+			return &result->metrics[i];
+	return NULL;
+}
+
+static int ends_with(const char *text, const char *suffix)
+{
+	size_t length = strlen(text), suffix_length = strlen(suffix);
+	return length >= suffix_length && !strcmp(text + length - suffix_length, suffix);
+}
+
+/* Which way is better for a number: 1 if higher, -1 if lower, 0 if it is neither. */
+static int better(const char *key)
+{
+	if (ends_with(key, "_per_s"))
+		return 1;
+	if (ends_with(key, "_ms") || !strcmp(key, "ns_per_op"))
+		return -1;
+	return 0;
+}
+
+/* Fold run into best, keeping each number's best value. Results only in run are left out. */
+static void keep_best(struct results *best, const struct results *run)
+{
+	int i, j;
+	for (i = 0; i < best->num_results; i++) {
+		struct result *kept = &best->results[i];
+		const struct result *other = find(run, kept->name);
+		if (!other)
+			continue;
+
+		for (j = 0; j < kept->num_metrics; j++) {
+			struct metric *metric = &kept->metrics[j];
+			const struct metric *value = find_metric(other, metric->key);
+			if (value && better(metric->key) * (value->value - metric->value) > 0.0)
+				metric->value = value->value;
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	double time_threshold = DEFAULT_THRESHOLD, throughput_threshold = DEFAULT_THRESHOLD;
+	const char *paths[MAX_RUNS + 1];
+	int num_paths = 0, print_best = 0;
+
+	int arg, i, j;
+	for (arg = 1; arg < argc; arg++) {
+		char *end;
+
+		if (!strncmp(argv[arg], "--time-threshold=", 17)) {
+			time_threshold = strtod(argv[arg] + 17, &end);
+			if (end != argv[arg] + 17 && *end == '\0' && time_threshold >= 0.0)
+				continue;
+		} else if (!strncmp(argv[arg], "--throughput-threshold=", 23)) {
+			throughput_threshold = strtod(argv[arg] + 23, &end);
+			if (end != argv[arg] + 23 && *end == '\0' && throughput_threshold >= 0.0)
+				continue;
+		} else if (!strcmp(argv[arg], "--best")) {
+			print_best = 1;
+			continue;
+		} else if (argv[arg][0] != '-' && num_paths < MAX_RUNS + 1) {
+			paths[num_paths++] = argv[arg];
+			continue;
+		}
+
+		num_paths = 0;
+		break;
+	}
+
+	if (num_paths < (print_best ? 1 : 2)) {
+		fprintf(stderr, "Usage: %s [--time-threshold=<percent>] [--throughput-threshold=<percent>]"
+			" <baseline> <run>...\n       %s --best <run>...\n", argv[0], argv[0]);
+		return 2;
+	}
+
+	/* The runs go into current, the first one's results with the best numbers of all of them. */
+	const char **runs = print_best ? paths : paths + 1;
+	int num_runs = print_best ? num_paths : num_paths - 1;
+	struct results baseline = { NULL, 0 }, current, run;
+	if (!load(runs[0], &current))
+		return 2;
+	for (i = 1; i < num_runs; i++) {
+		if (!load(runs[i], &run))
+			return 2;
+		keep_best(&current, &run);
+		free(run.results);
+	}
+
+	if (print_best) {
+		for (i = 0; i < current.num_results; i++) {
+			const struct result *result = &current.results[i];
+			printf("{\"name\": \"%s\"", result->name);
+			for (j = 0; j < result->num_metrics; j++)
+				printf(", \"%s\": %.6g", result->metrics[j].key, result->metrics[j].value);
+			printf("}\n");
+		}
+		free(current.results);
+		return 0;
+	}
+
+	if (!load(paths[0], &baseline))
+		return 2;
+
+	int regressions = 0, checked = 0;
+	for (i = 0; i < baseline.num_results; i++) {
+		const struct result *before = &baseline.results[i];
+		const struct result *after = find(&current, before->name);
+		if (!after) {
+			printf("MISSING  %s\n", before->name);
+			regressions++;
+			continue;
+		}
+
+		for (j = 0; j < before->num_metrics; j++) {
+			const struct metric *old = &before->metrics[j];
+			int is_time = !strcmp(old->key, "p95_ms"), is_throughput = ends_with(old->key, "_per_s");
+			if (!is_time && !is_throughput)
+				continue;
+
+			const struct metric *new = find_metric(after, old->key);
+			if (!new) {
+				printf("MISSING  %s %s\n", before->name, old->key);
+				regressions++;
+				continue;
+			}
+
+			/* Positive is worse for both kinds. */
+			double change = old->value > 0.0 ? (new->value - old->value) / old->value * 100.0 : 0.0;
+			if (is_throughput)
+				change = -change;
+			int slower = change > (is_time ? time_threshold : throughput_threshold);
+
+			printf("%-8s %-40s %-13s %12.4g -> %12.4g  %+6.1f%%\n", slower ? "SLOWER" : "ok",
+				before->name, old->key, old->value, new->value, is_throughput ? -change : change);
+			regressions += slower;
+			checked++;
+		}
+	}
+
+	for (i = 0; i < current.num_results; i++)
+		if (!find(&baseline, current.results[i].name))
+			printf("NEW      %s (no baseline)\n", current.results[i].name);
+
+	printf("%d checked, %d worse than %.1f%% slower or %.1f%% less throughput.\n", checked, regressions,
+		time_threshold, throughput_threshold);
+
+	free(baseline.results);
+	free(current.results);
+	return regressions ? 1 : 0;
+}
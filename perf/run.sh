@@ -0,0 +1,96 @@
+#!/bin/sh
+# Build the benchmarks, run them and compare the results with perf/baseline.json.
+# See perf/readme.txt. Exits with 1 if anything got slower than the thresholds.
+
+set -e
+
+usage()
+{
+	echo "Usage: $0 [--update] [--cpu-only] [--runs=<n>] [--time-threshold=<percent>]" \
+		"[--throughput-threshold=<percent>]" >&2
+	exit 2
+}
+
+# Run a GL program on the display, or on a virtual X server if there is none.
+run_gl()
+{
+	if [ -n "$DISPLAY" ]; then
+		"$@"
+	else
+		xvfb-run -a -s "-screen 0 1024x768x24" "$@"
+	fi
+}
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+build=${PERF_BUILD:-$root/perf/build}
+baseline=$root/perf/baseline.json
+update=0
+render=1
+runs=3
+thresholds=
+
+for arg in "$@"; do
+	case $arg in
+	--update) update=1 ;;
+	--cpu-only) render=0 ;;
+	--runs=*)
+		runs=${arg#--runs=}
+		case $runs in
+		''|*[!0-9]*) usage ;;
+		esac
+		[ "$runs" -ge 1 ] && [ "$runs" -le 16 ] || usage
+		;;
+	--time-threshold=*|--throughput-threshold=*) thresholds="$thresholds $arg" ;;
+	*) usage ;;
+	esac
+done
+
+if [ $render = 1 ] && [ -z "$DISPLAY" ] && ! command -v xvfb-run > /dev/null; then
+	echo "There is no display and no xvfb-run to make one; rerun with --cpu-only." >&2
+	exit 2
+fi
+
+CC=${CC:-cc}
+mkdir -p "$build"
+rm -f "$build"/run*.json
+
+echo "Building in $build"
+$CC -O2 -o "$build/compare" "$root/perf/compare.c"
+(cd "$root/bench" && $CC -O2 -o "$build/bench" main.c ../collision.c ../light.c ../mesher.c ../voxel.c ../terrain.c ../parallel.c \
+	../timing.c ../simulation.c ../pacing.c ../visibility.c ../sc_*.c -lm -lpthread)
+if [ $render = 1 ]; then
+	(cd "$root" && $CC -O2 -o "$build/demo" *.c -lGLEW -lglfw -lGL -lm -lpthread)
+fi
+
+# Mesa's software rasteriser, so the numbers don't depend on whichever GPU is around.
+LIBGL_ALWAYS_SOFTWARE=1
+export LIBGL_ALWAYS_SOFTWARE
+
+run=1
+while [ $run -le "$runs" ]; do
+	echo "Run $run of $runs: CPU microbenchmarks"
+	"$build/bench" --json="$build/bench.json"
+	cat "$build/bench.json" > "$build/run$run.json"
+
+	if [ $render = 1 ]; then
+		echo "Run $run of $runs: renderer benchmark"
+		run_gl "$build/demo" --benchmark-json="$build/demo.json"
+		cat "$build/demo.json" >> "$build/run$run.json"
+	fi
+
+	run=$((run + 1))
+done
+
+if [ $update = 1 ]; then
+	"$build/compare" --best "$build"/run*.json > "$baseline"
+	echo "Baseline updated: $baseline"
+	exit 0
+fi
+
+if [ ! -f "$baseline" ]; then
+	echo "There is no baseline yet; make one with --update." >&2
+	exit 2
+fi
+
+echo "Comparing the best of $runs runs with $baseline"
+"$build/compare" $thresholds "$baseline" "$build"/run*.json
@@ -0,0 +1,215 @@
+#include <float.h>
+#include <math.h>
+
+#include "parallel.h"
+#include "raycast.h"
+
+/* Rays handed to a worker at a time by voxel_raycast_batch. */
+#define BATCH_SIZE 64
+
+struct walk
+{
+	float origin[3], direction[3], inverse[3];
+	int32_t cell[3], step[3];
+	float next[3];		/* Ray parameter at the next boundary on each axis. */
+	int32_t axis;		/* Axis of the last boundary crossed, or -1. */
+	float t;
+};
+
+static void next_boundaries(struct walk *walk)
+{
+	int32_t i;
+	for (i = 0; i < 3; i++) {
+		if (!walk->step[i])
+			walk->next[i] = FLT_MAX;
+		else
+			walk->next[i] = (walk->cell[i] + (walk->step[i] > 0) - walk->origin[i])
+				* walk->inverse[i];
+	}
+}
+
+/*
+ * Jump to the first cell past the size^3 aligned block holding the current
+ * cell. The axes not being crossed are clamped to the block so rounding can
+ * never move the walk backwards.
+ */
+static void skip_block(struct walk *walk, int32_t size)
+{
+	int32_t low[3], i, axis = -1;
+	float t = FLT_MAX;
+
+	for (i = 0; i < 3; i++) {
+		low[i] = walk->cell[i] - walk->cell[i] % size;
+		if (!walk->step[i])
+			continue;
+
+		int32_t boundary = walk->step[i] > 0 ? low[i] + size : low[i];
+		float t_boundary = (boundary - walk->origin[i]) * walk->inverse[i];
+		if (t_boundary < t) {
+			t = t_boundary;
+			axis = i;
+		}
+	}
+
+	for (i = 0; i < 3; i++) {
+		if (i == axis) {
+			walk->cell[i] = walk->step[i] > 0 ? low[i] + size : low[i] - 1;
+			continue;
+		}
+
+		int32_t cell = (int32_t) floorf(walk->origin[i] + walk->direction[i] * t);
+		if (cell < low[i])
+			cell = low[i];
+		if (cell > low[i] + size - 1)
+			cell = low[i] + size - 1;
+		walk->cell[i] = cell;
+	}
+
+	walk->t = t;
+	walk->axis = axis;
+	next_boundaries(walk);
+}
+
+int32_t voxel_raycast(const voxel_grid *grid, const voxel_ray *ray, voxel_hit *hit)
+{
+	int32_t size[3] = { grid->size_x, grid->size_y, grid->size_z };
+	struct walk walk;
+	float t_enter = 0.0f, t_exit = ray->max_distance;
+	int32_t i;
+
+	hit->hit = 0;
+
+	/* Move to grid space, where voxel i spans [i, i + 1), and clip to the grid. */
+	for (i = 0; i < 3; i++) {
+		walk.origin[i] = ray->origin[i] + 0.5f;
+		walk.direction[i] = ray->direction[i];
+
+		if (ray->direction[i] == 0.0f) {
+			walk.inverse[i] = 0.0f;
+			walk.step[i] = 0;
+			if (walk.origin[i] < 0.0f || walk.origin[i] >= size[i])
+				return 0;
+			continue;
+		}
+
+		walk.inverse[i] = 1.0f / ray->direction[i];
+		walk.step[i] = ray->direction[i] > 0.0f ? 1 : -1;
+
+		float t0 = -walk.origin[i] * walk.inverse[i];
+		float t1 = (size[i] - walk.origin[i]) * walk.inverse[i];
+		if (t0 > t1) {
+			float swap = t0;
+			t0 = t1;
+			t1 = swap;
+		}
+		if (t0 > t_enter)
+			t_enter = t0;
+		if (t1 < t_exit)
+			t_exit = t1;
+	}
+
+	if (t_enter > t_exit)
+		return 0;
+
+	walk.t = t_enter;
+	walk.axis = -1;
+	for (i = 0; i < 3; i++) {
+		int32_t cell = (int32_t) floorf(walk.origin[i] + ray->direction[i] * t_enter);
+		if (cell < 0)
+			cell = 0;
+		if (cell >= size[i])
+			cell = size[i] - 1;
+		walk.cell[i] = cell;
+
+		/* Entering through a grid face counts as crossing it. */
+		if (t_enter > 0.0f && walk.step[i]
+			&& fabsf((walk.step[i] > 0 ? 0 : size[i]) - walk.origin[i] - ray->direction[i] * t_enter) < 1e-4f)
+			walk.axis = i;
+	}
+	next_boundaries(&walk);
+
+	while (walk.t <= t_exit) {
+		int32_t x = walk.cell[0], y = walk.cell[1], z = walk.cell[2];
+		if (x < 0 || y < 0 || z < 0 || x >= size[0] || y >= size[1] || z >= size[2])
+			return 0;
+
+		uint64_t mask = voxel_grid_chunk_mask(grid, x, y, z);
+		if (!mask) {
+			skip_block(&walk, CHUNK_SIZE);
+			continue;
+		}
+
+		if (!(mask >> voxel_grid_brick_bit(x, y, z) & 1)) {
+			skip_block(&walk, BRICK_SIZE);
+			continue;
+		}
+
+		uint8_t voxel = voxel_grid_get(grid, x, y, z);
+		if (voxel) {
+			hit->hit = 1;
+			hit->x = x;
+			hit->y = y;
+			hit->z = z;
+			hit->voxel = voxel;
+			hit->distance = walk.t;
+			for (i = 0; i < 3; i++)
+				hit->normal[i] = i == walk.axis ? -walk.step[i] : 0;
+			return 1;
+		}
+
+		/* Step into the neighbouring voxel across the nearest boundary. */
+		int32_t axis = 0;
+		if (walk.next[1] < walk.next[axis])
+			axis = 1;
+		if (walk.next[2] < walk.next[axis])
+			axis = 2;
+
+		walk.t = walk.next[axis];
+		walk.cell[axis] += walk.step[axis];
+		walk.next[axis] += fabsf(walk.inverse[axis]);
+		walk.axis = axis;
+	}
+
+	return 0;
+}
+
+struct batch
+{
+	const voxel_grid *grid;
+	const voxel_ray *rays;
+	voxel_hit *hits;
+	uint32_t count;
+};
+
+static void cast_batch(void *context, uint32_t index)
+{
+	const struct batch *batch = context;
+	uint32_t i = index * BATCH_SIZE, end = i + BATCH_SIZE;
+
+	if (end > batch->count)
+		end = batch->count;
+
+	for (; i < end; i++)
+		voxel_raycast(batch->grid, &batch->rays[i], &batch->hits[i]);
+}
+
+void voxel_raycast_batch(const voxel_grid *grid, const voxel_ray *rays, voxel_hit *hits,
+	uint32_t count)
+{
+	struct batch batch = { .grid = grid, .rays = rays, .hits = hits, .count = count };
+
+	parallel_for((count + BATCH_SIZE - 1) / BATCH_SIZE, cast_batch, &batch);
+}
+
+int32_t voxel_line_of_sight(const voxel_grid *grid, const float *a, const float *b)
+{
+	voxel_ray ray =
+	{
+		.origin = { a[0], a[1], a[2] },
+		.direction = { b[0] - a[0], b[1] - a[1], b[2] - a[2] },
+		.max_distance = 1.0f
+	};
+	voxel_hit hit;
+
+	return !voxel_raycast(grid, &ray, &hit);
+}
@@ -0,0 +1,43 @@
+#ifndef RAYCAST_H
+#define RAYCAST_H
+
+#include <stdint.h>
+
+#include "voxel.h"
+
+/*
+ * Rays are in world space, where voxel (x, y, z) is the unit cube centred on
+ * (x, y, z) as drawn by the mesher. The direction need not be normalised;
+ * distances are measured in multiples of its length.
+ */
+typedef struct
+{
+	float origin[3];
+	float direction[3];
+	float max_distance;
+} voxel_ray;
+
+typedef struct
+{
+	int32_t hit;
+	int32_t x, y, z;
+	int32_t normal[3];	/* Of the face the ray entered through; zero if it started inside. */
+	float distance;
+	uint8_t voxel;
+} voxel_hit;
+
+/*
+ * Find the first solid voxel along a ray with an Amanatides-Woo grid walk.
+ * Empty chunks and bricks are crossed in one step using the grid's brick
+ * masks, which must be up to date. Returns hit->hit.
+ */
+int32_t voxel_raycast(const voxel_grid *grid, const voxel_ray *ray, voxel_hit *hit);
+
+/* Cast count rays at once, spread over the worker threads. */
+void voxel_raycast_batch(const voxel_grid *grid, const voxel_ray *rays, voxel_hit *hits,
+	uint32_t count);
+
+/* Whether the segment from a to b passes through no solid voxel. */
+int32_t voxel_line_of_sight(const voxel_grid *grid, const float *a, const float *b);
+
+#endif
@@ -0,0 +1,219 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "gl_state.h"
+#include "raymarch.h"
+#include "shader.h"
+
+/* Levels in the texture. The coarsest cell is a whole chunk. */
+#define NUM_LEVELS 5
+#define TOP_CELL (1 << (NUM_LEVELS - 1))
+
+/* The vertex shader makes a triangle covering the screen from gl_VertexID alone. */
+static const GLchar *vertex_shader_source =
+{
+"#version 130\n"\
+
+"out vec2 ndc;\n"\
+
+"void main(void)\n"\
+"{\n"\
+"	ndc = vec2((gl_VertexID & 1) * 4 - 1, (gl_VertexID >> 1) * 4 - 1);\n"\
+"	gl_Position = vec4(ndc, 0.0, 1.0);\n"\
+"}\n"\
+};
+
+static const GLchar *fragment_shader_source =
+{
+"#version 130\n"\
+
+"in vec2 ndc;\n"\
+
+"uniform usampler3D voxels;\n"\
+"uniform sampler1D palette;\n"\
+"uniform ivec3 grid_size;\n"\
+"uniform int top_level;\n"\
+
+"uniform mat4 camera_translation_matrix;\n"\
+"uniform mat4 camera_x_rotation_matrix;\n"\
+"uniform mat4 camera_y_rotation_matrix;\n"\
+"uniform mat4 perspective_matrix;\n"\
+
+/* Levels above 0 are padded to whole cells, so fetches never leave the texture. */
+"uint fetch(ivec3 cell, int level)\n"\
+"{\n"\
+"	return texelFetch(voxels, cell.zyx, level).r;\n"\
+"}\n"\
+
+"void main(void)\n"\
+"{\n"\
+"	mat3 rotation = mat3(camera_x_rotation_matrix * camera_y_rotation_matrix);\n"\
+"	vec3 view_direction = vec3((ndc.x + perspective_matrix[2][0]) / perspective_matrix[0][0],\n"\
+"		(ndc.y + perspective_matrix[2][1]) / perspective_matrix[1][1], -1.0);\n"\
+"	vec3 direction = normalize(transpose(rotation) * view_direction);\n"\
+"	vec3 camera = -camera_translation_matrix[3].xyz;\n"\
+
+	/* Voxel centres are on integers, so the grid's cells start half a voxel lower. */
+"	vec3 origin = camera + 0.5;\n"\
+"	vec3 inverse = 1.0 / direction;\n"\
+"	vec3 t0 = -origin * inverse, t1 = (vec3(grid_size) - origin) * inverse;\n"\
+"	vec3 t_near = min(t0, t1), t_far = max(t0, t1);\n"\
+"	float t = max(max(t_near.x, t_near.y), max(t_near.z, 0.0));\n"\
+"	float t_end = min(min(t_far.x, t_far.y), t_far.z);\n"\
+"	if (t >= t_end)\n"\
+"		discard;\n"\
+
+"	vec3 normal = -sign(direction) * step(t_near.yzx, t_near) * step(t_near.zxy, t_near);\n"\
+"	int level = top_level;\n"\
+"	uint voxel = 0u;\n"\
+"	for (int i = 0; i < 512 && t < t_end; i++) {\n"\
+"		vec3 p = clamp(origin + direction * t, vec3(0.0), vec3(grid_size) - 0.001);\n"\
+"		ivec3 cell = ivec3(floor(p)) >> level;\n"\
+"		voxel = fetch(cell, level);\n"\
+"		if (voxel != 0u && level == 0)\n"\
+"			break;\n"\
+"		if (voxel != 0u) {\n"\
+"			level--;\n"\
+"			continue;\n"\
+"		}\n"\
+
+		/* Step out of the empty cell and try the coarser level next. */
+"		vec3 low = vec3(cell << level), high = low + float(1 << level);\n"\
+"		vec3 t_exit = (mix(low, high, step(0.0, direction)) - origin) * inverse;\n"\
+"		float t_next = min(min(t_exit.x, t_exit.y), t_exit.z);\n"\
+"		normal = -sign(direction) * step(t_exit, t_exit.yzx) * step(t_exit, t_exit.zxy);\n"\
+"		t = t_next + 1e-4 * (1.0 + t_next);\n"\
+"		level = min(level + 1, top_level);\n"\
+"	}\n"\
+"	if (voxel == 0u || level != 0)\n"\
+"		discard;\n"\
+
+"	vec3 hit = camera + direction * t;\n"\
+"	vec4 clip = perspective_matrix * camera_x_rotation_matrix * camera_y_rotation_matrix\n"\
+"		* camera_translation_matrix * vec4(hit, 1.0);\n"\
+"	gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;\n"\
+
+"	float shade = 0.55 + 0.3 * abs(normal.y) + 0.15 * abs(normal.x);\n"\
+"	gl_FragColor = vec4(texelFetch(palette, int(voxel), 0).rgb * shade, 1.0);\n"\
+"}\n"\
+};
+
+voxel_raymarcher *voxel_raymarcher_new(void)
+{
+	voxel_raymarcher *raymarcher = calloc(1, sizeof *raymarcher);
+	if (!raymarcher)
+		return NULL;
+
+	raymarcher->program = shader_program_new(vertex_shader_source, fragment_shader_source);
+	if (!raymarcher->program) {
+		free(raymarcher);
+		return NULL;
+	}
+
+	/* Core profiles need a vertex array bound even with no attributes. */
+	glGenVertexArrays(1, &raymarcher->vao);
+
+	glGenTextures(1, &raymarcher->voxel_texture);
+	glBindTexture(GL_TEXTURE_3D, raymarcher->voxel_texture);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, NUM_LEVELS - 1);
+
+	return raymarcher;
+}
+
+void voxel_raymarcher_free(voxel_raymarcher *raymarcher)
+{
+	if (!raymarcher)
+		return;
+
+	gl_state_delete_program(raymarcher->program);
+	gl_state_delete_vertex_array(raymarcher->vao);
+	glDeleteTextures(1, &raymarcher->voxel_texture);
+	free(raymarcher);
+}
+
+static int32_t round_up(int32_t size)
+{
+	return (size + TOP_CELL - 1) / TOP_CELL * TOP_CELL;
+}
+
+int32_t voxel_raymarcher_upload(voxel_raymarcher *raymarcher, const voxel_grid *grid)
+{
+	/*
+	 * The texture is padded to whole top-level cells so every level halves
+	 * exactly. Like the grid it is x-major, so its width runs along z.
+	 */
+	int32_t width = round_up(grid->size_z), height = round_up(grid->size_y), depth = round_up(grid->size_x);
+	uint8_t *level = calloc((size_t) width * height * depth, 1);
+	uint8_t *coarser = malloc((size_t) (width / 2) * (height / 2) * (depth / 2) + 1);
+	if (!level || !coarser) {
+		free(level);
+		free(coarser);
+		return 0;
+	}
+
+	int32_t x, y, z;
+	for (x = 0; x < grid->size_x; x++)
+		for (y = 0; y < grid->size_y; y++)
+			memcpy(level + ((size_t) x * height + y) * width,
+				grid->voxels + ((size_t) x * grid->size_y + y) * grid->size_z, grid->size_z);
+
+	glBindTexture(GL_TEXTURE_3D, raymarcher->voxel_texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	int32_t i;
+	for (i = 0; i < NUM_LEVELS; i++) {
+		glTexImage3D(GL_TEXTURE_3D, i, GL_R8UI, width, height, depth, 0,
+			GL_RED_INTEGER, GL_UNSIGNED_BYTE, level);
+		if (i == NUM_LEVELS - 1)
+			break;
+
+		/* A coarser cell is solid if any of the eight below it is. */
+		int32_t w = width / 2, h = height / 2, d = depth / 2;
+		for (x = 0; x < d; x++) {
+			for (y = 0; y < h; y++) {
+				for (z = 0; z < w; z++) {
+					uint8_t solid = 0;
+					int32_t dx, dy, dz;
+					for (dx = 0; dx < 2; dx++)
+						for (dy = 0; dy < 2; dy++)
+							for (dz = 0; dz < 2; dz++)
+								solid |= level[((size_t) (2 * x + dx) * height + 2 * y + dy) * width + 2 * z + dz];
+					coarser[((size_t) x * h + y) * w + z] = solid != 0;
+				}
+			}
+		}
+
+		uint8_t *swap = level;
+		level = coarser;
+		coarser = swap;
+		width = w;
+		height = h;
+		depth = d;
+	}
+
+	free(level);
+	free(coarser);
+
+	raymarcher->size_x = grid->size_x;
+	raymarcher->size_y = grid->size_y;
+	raymarcher->size_z = grid->size_z;
+
+	return 1;
+}
+
+void voxel_raymarcher_draw(const voxel_raymarcher *raymarcher)
+{
+	GLuint program = raymarcher->program;
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_3D, raymarcher->voxel_texture);
+	gl_state_uniform1i(program, "voxels", 0);
+	gl_state_uniform3i(program, "grid_size", raymarcher->size_x, raymarcher->size_y, raymarcher->size_z);
+	gl_state_uniform1i(program, "top_level", NUM_LEVELS - 1);
+
+	gl_state_bind_vertex_array(raymarcher->vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+}
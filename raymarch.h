@@ -0,0 +1,37 @@
+#ifndef RAYMARCH_H
+#define RAYMARCH_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+
+#include "voxel.h"
+
+/*
+ * Draws the voxel grid without meshing it: a full-screen triangle's fragment
+ * shader marches each pixel's ray through a 3D texture of the grid. Level 0
+ * holds the voxels and every coarser level whether any voxel in its 2x2x2
+ * block is solid, so empty space is crossed a whole mip cell at a time. The
+ * cost follows the number of pixels rather than the amount of surface.
+ *
+ * The program takes Demo.c's camera rotation, perspective and palette
+ * uniforms, and the camera's position as camera_translation_matrix rather
+ * than per-chunk offsets. It writes depth, so other geometry can be drawn
+ * with it.
+ */
+typedef struct
+{
+	GLuint program, vao, voxel_texture;
+	int32_t size_x, size_y, size_z;
+} voxel_raymarcher;
+
+/* Compile the shader. Returns NULL if that fails. */
+voxel_raymarcher *voxel_raymarcher_new(void);
+void voxel_raymarcher_free(voxel_raymarcher *raymarcher);
+
+/* (Re)build the texture and its occupancy levels from the grid. Returns 0 if out of memory. */
+int32_t voxel_raymarcher_upload(voxel_raymarcher *raymarcher, const voxel_grid *grid);
+
+/* Draw with the raymarcher's program, making it current. */
+void voxel_raymarcher_draw(const voxel_raymarcher *raymarcher);
+
+#endif
@@ -0,0 +1,159 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "render_queue.h"
+
+/* Key layout from the top: pass, program, depth, vertex array. */
+#define PASS_BITS 4
+#define PROGRAM_BITS 8
+#define DEPTH_BITS 16
+#define VAO_BITS 12
+
+#define KEY_BITS (PASS_BITS + PROGRAM_BITS + DEPTH_BITS + VAO_BITS)
+
+/* The rest of each sort entry is the packet's index. */
+#define INDEX_BITS (64 - KEY_BITS)
+
+#define FIELD(value, bits) ((uint64_t) (value) & ((1ull << (bits)) - 1))
+
+uint64_t render_key(render_pass pass, GLuint program, float depth, GLuint vao)
+{
+	uint64_t depth_bucket = depth > 0.0f ? (uint64_t) depth : 0;
+	if (depth_bucket >= 1ull << DEPTH_BITS)
+		depth_bucket = (1ull << DEPTH_BITS) - 1;
+
+	uint64_t key = FIELD(pass, PASS_BITS);
+	key = key << PROGRAM_BITS | FIELD(program, PROGRAM_BITS);
+	key = key << DEPTH_BITS | depth_bucket;
+	key = key << VAO_BITS | FIELD(vao, VAO_BITS);
+
+	return key;
+}
+
+render_queue *render_queue_new(void)
+{
+	return calloc(1, sizeof(render_queue));
+}
+
+void render_queue_free(render_queue *queue)
+{
+	if (!queue)
+		return;
+
+	free(queue->packets);
+	free(queue->keys);
+	free(queue->scratch);
+	free(queue);
+}
+
+int32_t render_queue_push(render_queue *queue, const render_packet *packet)
+{
+	if (queue->num_packets == queue->capacity) {
+		uint32_t capacity = queue->capacity ? queue->capacity * 2 : 256;
+		if (capacity > 1ull << INDEX_BITS)
+			return 0;
+
+		render_packet *packets = realloc(queue->packets, capacity * sizeof *packets);
+		if (!packets)
+			return 0;
+		queue->packets = packets;
+
+		uint64_t *keys = realloc(queue->keys, capacity * sizeof *keys);
+		if (!keys)
+			return 0;
+		queue->keys = keys;
+
+		uint64_t *scratch = realloc(queue->scratch, capacity * sizeof *scratch);
+		if (!scratch)
+			return 0;
+		queue->scratch = scratch;
+
+		queue->capacity = capacity;
+	}
+
+	queue->keys[queue->num_packets] = packet->key << INDEX_BITS | queue->num_packets;
+	queue->packets[queue->num_packets++] = *packet;
+	return 1;
+}
+
+/*
+ * Least significant digit first radix sort, a byte at a time. Bytes that are
+ * the same in every entry are skipped, which is most of them: the index
+ * bytes below the key only matter for order between equal keys, and the
+ * entries are already in submission order.
+ */
+static void radix_sort(uint64_t *keys, uint64_t *scratch, uint32_t count)
+{
+	uint32_t counts[8][256] = { { 0 } };
+	uint32_t i, digit;
+
+	for (i = 0; i < count; i++)
+		for (digit = 0; digit < 8; digit++)
+			counts[digit][(keys[i] >> (8 * digit)) & 0xff]++;
+
+	for (digit = INDEX_BITS / 8; digit < 8; digit++) {
+		uint32_t *histogram = counts[digit];
+		if (histogram[(keys[0] >> (8 * digit)) & 0xff] == count)
+			continue;
+
+		uint32_t bucket, offset = 0;
+		for (bucket = 0; bucket < 256; bucket++) {
+			uint32_t n = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += n;
+		}
+
+		for (i = 0; i < count; i++)
+			scratch[histogram[(keys[i] >> (8 * digit)) & 0xff]++] = keys[i];
+		memcpy(keys, scratch, count * sizeof *keys);
+	}
+}
+
+int32_t render_queue_record(render_queue *queue, command_buffer *commands)
+{
+	memset(&queue->stats, 0, sizeof queue->stats);
+	if (!queue->num_packets)
+		return 1;
+
+	radix_sort(queue->keys, queue->scratch, queue->num_packets);
+
+	/* Nothing is known to be bound when the frame starts. */
+	GLuint program = 0, vao = 0;
+	GLenum polygon_mode = 0;
+	int32_t first = 1, recorded = 1;
+
+	uint32_t i;
+	for (i = 0; i < queue->num_packets; i++) {
+		const render_packet *packet = &queue->packets[queue->keys[i] & ((1ull << INDEX_BITS) - 1)];
+
+		if (first || packet->program != program) {
+			recorded &= command_buffer_use_program(commands, packet->program);
+			program = packet->program;
+			queue->stats.program_changes++;
+		}
+		if (first || packet->vao != vao) {
+			recorded &= command_buffer_bind_vertex_array(commands, packet->vao);
+			vao = packet->vao;
+			queue->stats.vao_changes++;
+		}
+		if (first || packet->polygon_mode != polygon_mode) {
+			recorded &= command_buffer_polygon_mode(commands, packet->polygon_mode);
+			polygon_mode = packet->polygon_mode;
+			queue->stats.polygon_mode_changes++;
+		}
+		first = 0;
+
+		if (packet->draw)
+			recorded &= command_buffer_call(commands, packet->draw, packet->context);
+		else
+			recorded &= command_buffer_draw_arrays(commands, packet->primitive, packet->first, packet->count);
+		queue->stats.draws++;
+	}
+
+	/* Leave the polygon mode as everything else expects it. */
+	if (polygon_mode != GL_FILL)
+		recorded &= command_buffer_polygon_mode(commands, GL_FILL);
+
+	queue->num_packets = 0;
+	return recorded;
+}
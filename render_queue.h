@@ -0,0 +1,77 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+
+#include "command_buffer.h"
+
+/* Passes run in this order. */
+typedef enum
+{
+	RENDER_PASS_OPAQUE,
+	RENDER_PASS_WIREFRAME,
+	RENDER_PASS_OVERLAY
+} render_pass;
+
+/*
+ * One draw. Unless draw is set it is glDrawArrays(primitive, first, count);
+ * otherwise draw is called once the program, vertex array and polygon mode
+ * are bound, for draws that need more than that.
+ */
+typedef struct
+{
+	uint64_t key;
+	GLuint program, vao;
+	GLenum polygon_mode;
+	GLenum primitive;
+	GLint first;
+	GLsizei count;
+	void (*draw)(const void *context);
+	const void *context;
+} render_packet;
+
+typedef struct
+{
+	uint32_t draws;
+	uint32_t program_changes;
+	uint32_t vao_changes;
+	uint32_t polygon_mode_changes;
+} render_stats;
+
+/*
+ * Draws are collected over a frame, sorted by key and then recorded, binding
+ * only what differs from the draw before. Last frame's counts are in stats;
+ * they leave out whatever draw callbacks bind themselves.
+ */
+typedef struct
+{
+	render_packet *packets;
+	uint64_t *keys, *scratch;	/* Sort key in the high bits, packet in the low. */
+	uint32_t num_packets, capacity;
+	render_stats stats;
+} render_queue;
+
+/*
+ * The key orders by pass, then program, then depth, then vertex array.
+ * Depth ranks above the vertex array because chunks bind their own in their
+ * draw callbacks, so front-to-back order costs no extra binds. depth is in
+ * voxels; anything farther than the key holds sorts last.
+ */
+uint64_t render_key(render_pass pass, GLuint program, float depth, GLuint vao);
+
+render_queue *render_queue_new(void);
+void render_queue_free(render_queue *queue);
+
+/* Queue a draw for this frame. Returns 0 if out of memory. */
+int32_t render_queue_push(render_queue *queue, const render_packet *packet);
+
+/*
+ * Sort the frame's draws and record them into commands, then empty the
+ * queue. Returns 0 if commands ran out of memory, in which case some draws
+ * are missing. A draw callback and its context are called on replay, so
+ * the context must still be valid then.
+ */
+int32_t render_queue_record(render_queue *queue, command_buffer *commands);
+
+#endif
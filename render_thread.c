@@ -0,0 +1,136 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "render_thread.h"
+
+struct render_thread
+{
+	GLFWwindow *window;
+	command_buffer *buffers[2];
+	uint32_t recording;		/* Index of the buffer the caller records into. */
+	int32_t threaded;
+
+	pthread_mutex_t lock;
+	pthread_cond_t submitted_changed;
+	command_buffer *submitted;	/* Waiting for or being replayed, NULL once done. */
+	int32_t stopping;
+	pthread_t thread;
+};
+
+static void replay(render_thread *thread, command_buffer *commands)
+{
+	command_buffer_execute(commands);
+	glfwSwapBuffers(thread->window);
+}
+
+static void *run(void *arg)
+{
+	render_thread *thread = arg;
+	glfwMakeContextCurrent(thread->window);
+
+	pthread_mutex_lock(&thread->lock);
+	for (;;) {
+		while (!thread->submitted && !thread->stopping)
+			pthread_cond_wait(&thread->submitted_changed, &thread->lock);
+		if (!thread->submitted)
+			break;
+
+		pthread_mutex_unlock(&thread->lock);
+		replay(thread, thread->submitted);
+		pthread_mutex_lock(&thread->lock);
+
+		thread->submitted = NULL;
+		pthread_cond_broadcast(&thread->submitted_changed);
+	}
+	pthread_mutex_unlock(&thread->lock);
+
+	glfwMakeContextCurrent(NULL);
+	return NULL;
+}
+
+render_thread *render_thread_start(GLFWwindow *window, int32_t threaded)
+{
+	render_thread *thread = calloc(1, sizeof *thread);
+	if (!thread)
+		return NULL;
+
+	thread->buffers[0] = command_buffer_new();
+	thread->buffers[1] = command_buffer_new();
+	if (!thread->buffers[0] || !thread->buffers[1]) {
+		command_buffer_free(thread->buffers[0]);
+		command_buffer_free(thread->buffers[1]);
+		free(thread);
+		return NULL;
+	}
+
+	thread->window = window;
+	thread->threaded = threaded;
+	if (!threaded)
+		return thread;
+
+	pthread_mutex_init(&thread->lock, NULL);
+	pthread_cond_init(&thread->submitted_changed, NULL);
+
+	/* A context can only be current on one thread at a time. */
+	glfwMakeContextCurrent(NULL);
+	if (pthread_create(&thread->thread, NULL, run, thread)) {
+		glfwMakeContextCurrent(window);
+		pthread_cond_destroy(&thread->submitted_changed);
+		pthread_mutex_destroy(&thread->lock);
+		command_buffer_free(thread->buffers[0]);
+		command_buffer_free(thread->buffers[1]);
+		free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+command_buffer *render_thread_commands(render_thread *thread)
+{
+	return thread->buffers[thread->recording];
+}
+
+void render_thread_submit(render_thread *thread)
+{
+	command_buffer *commands = thread->buffers[thread->recording];
+
+	if (!thread->threaded) {
+		replay(thread, commands);
+		command_buffer_reset(commands);
+		return;
+	}
+
+	pthread_mutex_lock(&thread->lock);
+	while (thread->submitted)
+		pthread_cond_wait(&thread->submitted_changed, &thread->lock);
+	thread->submitted = commands;
+	pthread_cond_broadcast(&thread->submitted_changed);
+	pthread_mutex_unlock(&thread->lock);
+
+	/* The other buffer's frame has been replayed, so it is free to record into. */
+	thread->recording ^= 1;
+	command_buffer_reset(thread->buffers[thread->recording]);
+}
+
+void render_thread_stop(render_thread *thread)
+{
+	if (!thread)
+		return;
+
+	if (thread->threaded) {
+		pthread_mutex_lock(&thread->lock);
+		thread->stopping = 1;
+		pthread_cond_broadcast(&thread->submitted_changed);
+		pthread_mutex_unlock(&thread->lock);
+
+		pthread_join(thread->thread, NULL);
+		pthread_cond_destroy(&thread->submitted_changed);
+		pthread_mutex_destroy(&thread->lock);
+		glfwMakeContextCurrent(thread->window);
+	}
+
+	command_buffer_free(thread->buffers[0]);
+	command_buffer_free(thread->buffers[1]);
+	free(thread);
+}
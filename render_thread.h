@@ -0,0 +1,37 @@
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <stdint.h>
+
+#include "command_buffer.h"
+
+typedef struct render_thread render_thread;
+
+/*
+ * A thread that owns the window's context and replays each frame's command
+ * buffer into it, swapping once it is done. There are two buffers: while one
+ * frame is being replayed the next is being recorded, so the CPU work of
+ * preparing a frame overlaps the GL calls of the one before, at the cost of
+ * a frame of latency.
+ *
+ * The context must be current on the calling thread. Unless threaded is set,
+ * no thread is started and frames are replayed on the caller as they are
+ * submitted. Returns NULL on failure, with the context still current.
+ */
+render_thread *render_thread_start(GLFWwindow *window, int32_t threaded);
+
+/* The empty buffer to record the next frame into. */
+command_buffer *render_thread_commands(render_thread *thread);
+
+/*
+ * Hand over the recorded frame. Waits for the frame before it to be replayed
+ * first, which is what keeps recording at most a frame ahead.
+ */
+void render_thread_submit(render_thread *thread);
+
+/* Replay whatever is left, stop the thread and make the context current on the caller again. */
+void render_thread_stop(render_thread *thread);
+
+#endif
@@ -0,0 +1,173 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "resolution.h"
+#include "timing.h"
+
+/* Weight of the newest frame in the smoothed GPU time. */
+#define SMOOTHING 0.2
+
+/* No change while the GPU time is this close to the budget, to stop the scale hunting. */
+#define DEADBAND 0.05
+
+/* The most the scale moves in a frame, as a factor. */
+#define MAX_STEP 1.1f
+
+int32_t resolution_scaler_supported(void)
+{
+	return GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+}
+
+/*
+ * Software rasterisers draw on their own threads after the timer queries
+ * around a frame have already ended, so the queries read next to nothing.
+ */
+static int32_t software_renderer(void)
+{
+	static const char *names[] = { "llvmpipe", "softpipe", "SwiftShader", "Software Rasterizer" };
+	const char *renderer = (const char *) glGetString(GL_RENDERER);
+
+	uint32_t i;
+	for (i = 0; renderer && i < sizeof names / sizeof *names; i++)
+		if (strstr(renderer, names[i]))
+			return 1;
+
+	return 0;
+}
+
+resolution_scaler *resolution_scaler_new(double budget_ms, float min_scale)
+{
+	resolution_scaler *scaler = calloc(1, sizeof *scaler);
+	if (!scaler)
+		return NULL;
+
+	scaler->scale = 1.0f;
+	scaler->min_scale = min_scale;
+	scaler->budget = budget_ms * 1e-3;
+	scaler->software = software_renderer();
+
+	glGenFramebuffers(1, &scaler->framebuffer);
+	glGenRenderbuffers(1, &scaler->colour);
+	glGenRenderbuffers(1, &scaler->depth);
+	glGenQueries(RESOLUTION_QUERIES, scaler->queries);
+
+	return scaler;
+}
+
+void resolution_scaler_free(resolution_scaler *scaler)
+{
+	if (!scaler)
+		return;
+
+	glDeleteFramebuffers(1, &scaler->framebuffer);
+	glDeleteRenderbuffers(1, &scaler->colour);
+	glDeleteRenderbuffers(1, &scaler->depth);
+	glDeleteQueries(RESOLUTION_QUERIES, scaler->queries);
+	free(scaler);
+}
+
+static void add_timing(resolution_scaler *scaler, double seconds)
+{
+	/* The first frame includes compiling shaders on first use, so it is left out. */
+	if (scaler->timings++ == 0)
+		return;
+	if (scaler->timings == 2)
+		scaler->gpu_time = seconds;
+	else
+		scaler->gpu_time += SMOOTHING * (seconds - scaler->gpu_time);
+
+	/*
+	 * Fill cost goes with the area, so the scale moves by the square root
+	 * of how far off the budget the GPU is.
+	 */
+	double ratio = scaler->budget / scaler->gpu_time;
+	if (fabs(ratio - 1.0) > DEADBAND) {
+		float step = sqrtf(ratio);
+		if (step > MAX_STEP)
+			step = MAX_STEP;
+		if (step < 1.0f / MAX_STEP)
+			step = 1.0f / MAX_STEP;
+		scaler->scale *= step;
+		if (scaler->scale > 1.0f)
+			scaler->scale = 1.0f;
+		if (scaler->scale < scaler->min_scale)
+			scaler->scale = scaler->min_scale;
+	}
+}
+
+/* Fold in every finished timing without waiting on any. */
+static void read_queries(resolution_scaler *scaler)
+{
+	while (scaler->queries_read < scaler->queries_issued) {
+		GLuint query = scaler->queries[scaler->queries_read % RESOLUTION_QUERIES];
+		GLint available = 0;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			break;
+
+		GLuint64 elapsed;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+		add_timing(scaler, elapsed * 1e-9);
+		scaler->queries_read++;
+	}
+}
+
+void resolution_scaler_begin(resolution_scaler *scaler, int32_t window_width, int32_t window_height)
+{
+	read_queries(scaler);
+
+	if (window_width != scaler->allocated_width || window_height != scaler->allocated_height) {
+		scaler->allocated_width = window_width;
+		scaler->allocated_height = window_height;
+
+		glBindRenderbuffer(GL_RENDERBUFFER, scaler->colour);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, window_width, window_height);
+		glBindRenderbuffer(GL_RENDERBUFFER, scaler->depth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, window_width, window_height);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, scaler->framebuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, scaler->colour);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, scaler->depth);
+	}
+
+	scaler->width = (int32_t) (window_width * scaler->scale + 0.5f);
+	scaler->height = (int32_t) (window_height * scaler->scale + 0.5f);
+	if (scaler->width < 1)
+		scaler->width = 1;
+	if (scaler->height < 1)
+		scaler->height = 1;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, scaler->framebuffer);
+	glViewport(0, 0, scaler->width, scaler->height);
+
+	/* With every query still in flight this frame goes untimed. */
+	if (scaler->software) {
+		scaler->timing = 1;
+		scaler->frame_start = timing_now();
+	} else {
+		scaler->timing = scaler->queries_issued - scaler->queries_read < RESOLUTION_QUERIES;
+		if (scaler->timing)
+			glBeginQuery(GL_TIME_ELAPSED, scaler->queries[scaler->queries_issued % RESOLUTION_QUERIES]);
+	}
+}
+
+void resolution_scaler_end(resolution_scaler *scaler, int32_t window_width, int32_t window_height)
+{
+	/* The upscale is part of the frame's cost, so it is timed too. */
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, scaler->framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, scaler->width, scaler->height, 0, 0, window_width, window_height,
+		GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, window_width, window_height);
+
+	/* The "GPU" of a software renderer is the CPU, so waiting for it costs little. */
+	if (scaler->software) {
+		glFinish();
+		add_timing(scaler, timing_now() - scaler->frame_start);
+	} else if (scaler->timing) {
+		glEndQuery(GL_TIME_ELAPSED);
+		scaler->queries_issued++;
+	}
+}
@@ -0,0 +1,51 @@
+#ifndef RESOLUTION_H
+#define RESOLUTION_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+
+/* Frames of GPU timer queries in flight, so reading one never stalls. */
+#define RESOLUTION_QUERIES 4
+
+/*
+ * Dynamic resolution: frames are drawn into an offscreen target at a
+ * fraction of the window size and scaled up to the window. The fraction
+ * follows the GPU time of recent frames so that it stays near a budget,
+ * which keeps fill-rate bound renderers at a steady frame time.
+ *
+ * The target is allocated at the full window size and only a corner of it
+ * is drawn to, so changing the scale costs nothing.
+ */
+typedef struct
+{
+	GLuint framebuffer, colour, depth;
+	int32_t allocated_width, allocated_height;
+	int32_t width, height;		/* This frame's resolution. */
+	float scale, min_scale;
+	double budget;			/* Seconds of GPU time per frame. */
+	double gpu_time;		/* Smoothed GPU seconds per frame. */
+	GLuint queries[RESOLUTION_QUERIES];
+	uint32_t queries_issued, queries_read, timings;
+	int32_t timing;			/* Whether this frame is being timed. */
+	int32_t software;		/* Timed on the CPU; see resolution.c. */
+	double frame_start;
+} resolution_scaler;
+
+/* Whether the context can time frames on the GPU. */
+int32_t resolution_scaler_supported(void);
+
+/* Hold GPU time near budget_ms, never going below min_scale of the window. */
+resolution_scaler *resolution_scaler_new(double budget_ms, float min_scale);
+void resolution_scaler_free(resolution_scaler *scaler);
+
+/*
+ * Pick this frame's resolution from the timings that have come in, then
+ * bind the offscreen target with a matching viewport. The window must be
+ * at least a pixel wide and high, or the target can't be complete.
+ */
+void resolution_scaler_begin(resolution_scaler *scaler, int32_t window_width, int32_t window_height);
+
+/* Scale the frame up into the default framebuffer. Call before swapping. */
+void resolution_scaler_end(resolution_scaler *scaler, int32_t window_width, int32_t window_height);
+
+#endif
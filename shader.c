@@ -0,0 +1,89 @@
+#include <stdio.h>
+
+#include "shader.h"
+
+static GLuint compile(GLenum type, const GLchar *source, const char *name)
+{
+	GLuint shader_id = glCreateShader(type);
+	glShaderSource(shader_id, 1, &source, NULL);
+	glCompileShader(shader_id);
+
+	GLint compilation_status;
+	glGetShaderiv(shader_id, GL_COMPILE_STATUS, &compilation_status);
+
+	if (compilation_status == GL_FALSE) {
+		fprintf(stderr, "The %s shader did not compile successfully.\n", name);
+
+		GLint error_log_max_length;
+		glGetShaderiv(shader_id, GL_INFO_LOG_LENGTH, &error_log_max_length);
+		GLchar error_log[error_log_max_length + 1];
+		glGetShaderInfoLog(shader_id, error_log_max_length + 1, NULL, error_log);
+		printf("%s\n", error_log);
+
+		glDeleteShader(shader_id);
+		return 0;
+	}
+
+	return shader_id;
+}
+
+static GLuint link(GLuint program_id)
+{
+	glLinkProgram(program_id);
+
+	GLint link_status;
+	glGetProgramiv(program_id, GL_LINK_STATUS, &link_status);
+
+	if (link_status == GL_FALSE) {
+		fprintf(stderr, "The shader program was not linked successfully.\n");
+
+		GLint error_log_max_length;
+		glGetProgramiv(program_id, GL_INFO_LOG_LENGTH, &error_log_max_length);
+		GLchar error_log[error_log_max_length + 1];
+		glGetProgramInfoLog(program_id, error_log_max_length + 1, NULL, error_log);
+		printf("%s\n", error_log);
+
+		glDeleteProgram(program_id);
+		return 0;
+	}
+
+	return program_id;
+}
+
+GLuint shader_program_new(const GLchar *vertex_source, const GLchar *fragment_source)
+{
+	GLuint vertex_shader_id = compile(GL_VERTEX_SHADER, vertex_source, "vertex");
+	if (!vertex_shader_id)
+		return 0;
+
+	GLuint fragment_shader_id = compile(GL_FRAGMENT_SHADER, fragment_source, "fragment");
+	if (!fragment_shader_id) {
+		glDeleteShader(vertex_shader_id);
+		return 0;
+	}
+
+	GLuint program_id = glCreateProgram();
+	glAttachShader(program_id, vertex_shader_id);
+	glAttachShader(program_id, fragment_shader_id);
+	program_id = link(program_id);
+
+	/* The program keeps what it needs; the shaders go once it is linked. */
+	glDeleteShader(vertex_shader_id);
+	glDeleteShader(fragment_shader_id);
+
+	return program_id;
+}
+
+GLuint shader_compute_program_new(const GLchar *compute_source)
+{
+	GLuint compute_shader_id = compile(GL_COMPUTE_SHADER, compute_source, "compute");
+	if (!compute_shader_id)
+		return 0;
+
+	GLuint program_id = glCreateProgram();
+	glAttachShader(program_id, compute_shader_id);
+	program_id = link(program_id);
+	glDeleteShader(compute_shader_id);
+
+	return program_id;
+}
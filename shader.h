@@ -0,0 +1,16 @@
+#ifndef SHADER_H
+#define SHADER_H
+
+#include <GL/glew.h>
+
+/*
+ * Compile and link a program from vertex and fragment shader sources. On
+ * failure the info log is printed and 0 is returned. Attribute locations
+ * should be fixed in the sources with layout qualifiers.
+ */
+GLuint shader_program_new(const GLchar *vertex_source, const GLchar *fragment_source);
+
+/* The same for a single compute shader. */
+GLuint shader_compute_program_new(const GLchar *compute_source);
+
+#endif
@@ -0,0 +1,282 @@
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "collision.h"
+#include "pacing.h"
+#include "sc_mat4f.h"
+#include "sc_vec4f.h"
+#include "simulation.h"
+#include "timing.h"
+
+#define RAD(x) (x * 0.0174532925)
+
+#define MOVEMENT_SPEED 10.0f
+#define ROTATION_SPEED 70.0f
+
+/* Half the size of the box the camera collides as. */
+#define CAMERA_HALF_SIZE 0.25f
+
+/* Set in the shared index once the writer has published a snapshot the reader hasn't seen. */
+#define FRESH 4u
+
+/*
+ * Snapshots pass from the simulation to the main thread through a triple
+ * buffer. The writer owns one slot, the reader owns another and the third is
+ * swapped between them with a single atomic exchange, so neither side ever
+ * waits for the other.
+ */
+struct simulation
+{
+	sim_snapshot slots[3];
+	atomic_uint shared;
+	uint32_t write_slot, read_slot;
+
+	atomic_uint input;
+	_Atomic(const voxel_grid *) world;
+	atomic_int running;
+	double tick_rate;
+	pthread_t thread;
+};
+
+static void publish(simulation *sim)
+{
+	sim->write_slot = atomic_exchange(&sim->shared, sim->write_slot | FRESH) & ~FRESH;
+}
+
+const sim_snapshot *simulation_latest(simulation *sim)
+{
+	if (atomic_load(&sim->shared) & FRESH)
+		sim->read_slot = atomic_exchange(&sim->shared, sim->read_slot) & ~FRESH;
+
+	return &sim->slots[sim->read_slot];
+}
+
+static void move(double *motion, sc_mat4f *x_rotation_mat, sc_mat4f *y_rotation_mat,
+	sc_vec4f *move_vector, float scale)
+{
+	sc_vec4f x_result_vector, result_vector;
+
+	sc_mat4f_mulv(x_rotation_mat, move_vector, &x_result_vector);
+	sc_mat4f_mulv(y_rotation_mat, &x_result_vector, &result_vector);
+
+	motion[0] += scale * result_vector.x;
+	motion[1] += scale * result_vector.y;
+	motion[2] += scale * result_vector.z;
+}
+
+static void step(camera_state *camera, uint32_t input, float delta, const voxel_grid *world)
+{
+	/* Camera rotation. */
+	if (input & INPUT_TURN_LEFT)
+		camera->y_rotation += delta * ROTATION_SPEED;
+	if (input & INPUT_LOOK_DOWN)
+		camera->x_rotation -= delta * ROTATION_SPEED;
+	if (input & INPUT_LOOK_UP)
+		camera->x_rotation += delta * ROTATION_SPEED;
+	if (input & INPUT_TURN_RIGHT)
+		camera->y_rotation -= delta * ROTATION_SPEED;
+
+	if (camera->x_rotation >= 360.0f)
+		camera->x_rotation -= 360.0f;
+	if (camera->x_rotation <= -360.0f)
+		camera->x_rotation += 360.0f;
+
+	if (camera->y_rotation >= 360.0f)
+		camera->y_rotation -= 360.0f;
+	if (camera->y_rotation <= -360.0f)
+		camera->y_rotation += 360.0f;
+
+	if (!(input & (INPUT_FORWARD | INPUT_BACKWARD | INPUT_LEFT | INPUT_RIGHT | INPUT_UP)))
+		return;
+
+	/* Compute move vector from camera orientation */
+	float x_rotation_data[] =
+	{
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, cos(RAD(camera->x_rotation)), -sin(RAD(camera->x_rotation)), 0.0f,
+		0.0f, sin(RAD(camera->x_rotation)), cos(RAD(camera->x_rotation)), 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f
+	};
+
+	float y_rotation_data[] =
+	{
+		cos(RAD(camera->y_rotation)), 0.0f, sin(RAD(camera->y_rotation)), 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		-sin(RAD(camera->y_rotation)), 0.0f, cos(RAD(camera->y_rotation)), 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f
+	};
+
+	sc_vec4f forward_move_vector =
+	{
+		.x = 0.0f, .y = 0.0f, .z = -MOVEMENT_SPEED, .w = 1.0f
+	};
+
+	sc_vec4f left_move_vector =
+	{
+		.x = -MOVEMENT_SPEED, .y = 0.0f, .z = 0.0f, .w = 1.0f
+	};
+
+	sc_vec4f up_move_vector =
+	{
+		.x = 0.0f, .y = MOVEMENT_SPEED, .z = 0.0f, .w = 1.0f
+	};
+
+	sc_mat4f *x_rotation_mat = sc_mat4f_new(x_rotation_data);
+	assert(x_rotation_mat);
+
+	sc_mat4f *y_rotation_mat = sc_mat4f_new(y_rotation_data);
+	assert(y_rotation_mat);
+
+	/* Camera translation. */
+	double motion[3] = { 0.0, 0.0, 0.0 };
+	if (input & INPUT_FORWARD)
+		move(motion, x_rotation_mat, y_rotation_mat, &forward_move_vector, delta);
+	if (input & INPUT_LEFT)
+		move(motion, x_rotation_mat, y_rotation_mat, &left_move_vector, delta);
+	if (input & INPUT_BACKWARD)
+		move(motion, x_rotation_mat, y_rotation_mat, &forward_move_vector, -delta);
+	if (input & INPUT_RIGHT)
+		move(motion, x_rotation_mat, y_rotation_mat, &left_move_vector, -delta);
+	if (input & INPUT_UP)
+		move(motion, x_rotation_mat, y_rotation_mat, &up_move_vector, delta);
+
+	free(x_rotation_mat);
+	free(y_rotation_mat);
+
+	if (world) {
+		voxel_box box =
+		{
+			.centre = { camera->x, camera->y, camera->z },
+			.half_size = { CAMERA_HALF_SIZE, CAMERA_HALF_SIZE, CAMERA_HALF_SIZE }
+		};
+		voxel_box_move(world, &box, motion);
+		camera->x = box.centre[0];
+		camera->y = box.centre[1];
+		camera->z = box.centre[2];
+	} else {
+		camera->x += motion[0];
+		camera->y += motion[1];
+		camera->z += motion[2];
+	}
+}
+
+static void *run(void *arg)
+{
+	simulation *sim = arg;
+	double period = 1.0 / sim->tick_rate;
+	double next_tick = timing_now();
+	camera_state camera = sim->slots[sim->write_slot].current;
+	uint64_t tick = 0;
+
+	while (atomic_load(&sim->running)) {
+		camera_state previous = camera;
+		step(&camera, atomic_load(&sim->input), period, atomic_load(&sim->world));
+
+		sim_snapshot *snapshot = &sim->slots[sim->write_slot];
+		snapshot->previous = previous;
+		snapshot->current = camera;
+		snapshot->tick = ++tick;
+		snapshot->tick_time = timing_now();
+		publish(sim);
+
+		/* A tick that overran is not made up for; the schedule moves on. */
+		next_tick += period;
+		if (next_tick < timing_now())
+			next_tick = timing_now();
+		pacing_sleep_until(next_tick);
+	}
+
+	return NULL;
+}
+
+simulation *simulation_start(const camera_state *camera, double tick_rate)
+{
+	simulation *sim = malloc(sizeof *sim);
+	if (!sim)
+		return NULL;
+
+	uint32_t i;
+	for (i = 0; i < 3; i++) {
+		sim->slots[i].previous = sim->slots[i].current = *camera;
+		sim->slots[i].tick = 0;
+		sim->slots[i].tick_time = timing_now();
+	}
+	sim->read_slot = 0;
+	atomic_init(&sim->shared, 1);
+	sim->write_slot = 2;
+
+	atomic_init(&sim->input, 0);
+	atomic_init(&sim->world, NULL);
+	atomic_init(&sim->running, 1);
+	sim->tick_rate = tick_rate;
+
+	if (pthread_create(&sim->thread, NULL, run, sim)) {
+		free(sim);
+		return NULL;
+	}
+
+	return sim;
+}
+
+void simulation_stop(simulation *sim)
+{
+	atomic_store(&sim->running, 0);
+	pthread_join(sim->thread, NULL);
+	free(sim);
+}
+
+void simulation_set_input(simulation *sim, uint32_t input)
+{
+	atomic_store(&sim->input, input);
+}
+
+void simulation_set_world(simulation *sim, const voxel_grid *world)
+{
+	atomic_store(&sim->world, world);
+}
+
+void camera_forward(const camera_state *camera, float *forward)
+{
+	/* (0, 0, -1) rotated about x and then y, as the move vectors are in step(). */
+	float x_rotation = RAD(camera->x_rotation), y_rotation = RAD(camera->y_rotation);
+
+	forward[0] = -sinf(y_rotation) * cosf(x_rotation);
+	forward[1] = sinf(x_rotation);
+	forward[2] = -cosf(y_rotation) * cosf(x_rotation);
+}
+
+static float lerp_angle(float from, float to, float t)
+{
+	/* The angles wrap at +-360, so take the short way round. */
+	if (to - from > 180.0f)
+		from += 360.0f;
+	else if (from - to > 180.0f)
+		from -= 360.0f;
+
+	return from + (to - from) * t;
+}
+
+void sim_snapshot_interpolate(const sim_snapshot *snapshot, double tick_rate, double now,
+	camera_state *camera)
+{
+	/*
+	 * Frames are drawn one tick behind the simulation: previous is shown as
+	 * current is published, and current once a whole tick has gone by.
+	 */
+	float t = (now - snapshot->tick_time) * tick_rate;
+	if (t < 0.0f)
+		t = 0.0f;
+	if (t > 1.0f)
+		t = 1.0f;
+
+	const camera_state *a = &snapshot->previous, *b = &snapshot->current;
+	camera->x = a->x + (b->x - a->x) * t;
+	camera->y = a->y + (b->y - a->y) * t;
+	camera->z = a->z + (b->z - a->z) * t;
+	camera->x_rotation = lerp_angle(a->x_rotation, b->x_rotation, t);
+	camera->y_rotation = lerp_angle(a->y_rotation, b->y_rotation, t);
+	camera->z_rotation = lerp_angle(a->z_rotation, b->z_rotation, t);
+}
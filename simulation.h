@@ -0,0 +1,68 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <stdint.h>
+
+#include "voxel.h"
+
+/* Held-key bits, sampled by the main thread and integrated every tick. */
+#define INPUT_FORWARD		(1u << 0)
+#define INPUT_BACKWARD		(1u << 1)
+#define INPUT_LEFT		(1u << 2)
+#define INPUT_RIGHT		(1u << 3)
+#define INPUT_UP		(1u << 4)
+#define INPUT_TURN_LEFT		(1u << 5)
+#define INPUT_TURN_RIGHT	(1u << 6)
+#define INPUT_LOOK_UP		(1u << 7)
+#define INPUT_LOOK_DOWN		(1u << 8)
+
+typedef struct
+{
+	double x, y, z;		/* Doubles, so the camera stays precise far from the origin. */
+	float x_rotation, y_rotation, z_rotation;
+} camera_state;
+
+/* What the simulation publishes after every tick. */
+typedef struct
+{
+	camera_state previous, current;
+	double tick_time;	/* timing_now() when current became valid. */
+	uint64_t tick;
+} sim_snapshot;
+
+typedef struct simulation simulation;
+
+/*
+ * Create a simulation that advances tick_rate times a second on its own
+ * thread, starting from the given camera. Returns NULL on failure.
+ */
+simulation *simulation_start(const camera_state *camera, double tick_rate);
+
+/* Stop the thread and free the simulation. */
+void simulation_stop(simulation *sim);
+
+/* Replace the held-key bits. Safe to call from any thread. */
+void simulation_set_input(simulation *sim, uint32_t input);
+
+/*
+ * Make the camera collide with world from the next tick on, or pass through
+ * everything again if it is NULL. The simulation thread reads the voxels and
+ * brick masks every tick, so they must not change while it is set. Safe to
+ * call from any thread.
+ */
+void simulation_set_world(simulation *sim, const voxel_grid *world);
+
+/*
+ * The newest published snapshot. Only one thread may read snapshots, and the
+ * pointer stays valid until its next call.
+ */
+const sim_snapshot *simulation_latest(simulation *sim);
+
+/* The unit vector the camera looks along. */
+void camera_forward(const camera_state *camera, float *forward);
+
+/* Blend the snapshot's two camera states for a frame drawn at time now. */
+void sim_snapshot_interpolate(const sim_snapshot *snapshot, double tick_rate, double now,
+	camera_state *camera);
+
+#endif
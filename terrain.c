@@ -0,0 +1,430 @@
+#include <math.h>
+#include <string.h>
+
+#include "parallel.h"
+#include "terrain.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_AVX2 1
+#include <immintrin.h>
+#define AVX2 __attribute__((target("avx2")))
+#endif
+
+/*
+ * Every multiply and add is rounded separately, in the same order, in both
+ * paths; fusing them into FMAs would make the AVX2 and scalar terrain differ.
+ */
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
+#define LANES 8
+
+#define PRIME_X 0x8da6b343u
+#define PRIME_Y 0xcb1ab31fu
+#define PRIME_Z 0xd8163841u
+#define OCTAVE_SEED_STEP 0x9e3779b9u
+#define CAVE_SEED 0x68e31da4u
+
+/* Below the surface: a layer of grass, then dirt, then stone. */
+#define GRASS_DEPTH 1.0f
+#define DIRT_DEPTH 4.0f
+
+void terrain_params_default(terrain_params *params, uint32_t seed, int32_t size_y)
+{
+	params->seed = seed;
+
+	params->octaves = 5;
+	params->frequency = 1.0f / 64.0f;
+	params->base_height = size_y * 0.45f;
+	params->height_scale = size_y * 0.35f;
+
+	params->cave_octaves = 2;
+	params->cave_frequency = 1.0f / 24.0f;
+	params->cave_threshold = 0.3f;
+
+#ifdef HAVE_AVX2
+	params->use_avx2 = __builtin_cpu_supports("avx2");
+#else
+	params->use_avx2 = 0;
+#endif
+}
+
+/* Scalar noise: the reference the AVX2 path has to match. */
+
+static inline uint32_t mix(uint32_t h)
+{
+	h ^= h >> 15;
+	h *= 0x2c1b3c6du;
+	h ^= h >> 12;
+	h *= 0x297a2d39u;
+	h ^= h >> 15;
+	return h;
+}
+
+static inline uint32_t hash2(uint32_t seed, int32_t x, int32_t z)
+{
+	return mix(seed ^ ((uint32_t) x * PRIME_X) ^ ((uint32_t) z * PRIME_Z));
+}
+
+static inline uint32_t hash3(uint32_t seed, int32_t x, int32_t y, int32_t z)
+{
+	return mix(seed ^ ((uint32_t) x * PRIME_X) ^ ((uint32_t) y * PRIME_Y) ^ ((uint32_t) z * PRIME_Z));
+}
+
+/* Negate f if the top bit of sign is set. */
+static inline float flip(float f, uint32_t sign)
+{
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof bits);
+	bits ^= sign & 0x80000000u;
+	memcpy(&f, &bits, sizeof f);
+	return f;
+}
+
+/* The gradients are the diagonals (+-1, +-1[, +-1]), picked by the low bits of h. */
+static inline float grad2(uint32_t h, float x, float z)
+{
+	return flip(x, h << 31) + flip(z, (h >> 1) << 31);
+}
+
+static inline float grad3(uint32_t h, float x, float y, float z)
+{
+	return flip(x, h << 31) + flip(y, (h >> 1) << 31) + flip(z, (h >> 2) << 31);
+}
+
+static inline float fade(float t)
+{
+	return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+static inline float lerp(float a, float b, float t)
+{
+	return a + t * (b - a);
+}
+
+static float noise2(uint32_t seed, float x, float z)
+{
+	float x0 = floorf(x), z0 = floorf(z);
+	float fx = x - x0, fz = z - z0;
+	int32_t ix = (int32_t) x0, iz = (int32_t) z0;
+	float u = fade(fx), v = fade(fz);
+
+	float n00 = grad2(hash2(seed, ix, iz), fx, fz);
+	float n10 = grad2(hash2(seed, ix + 1, iz), fx - 1.0f, fz);
+	float n01 = grad2(hash2(seed, ix, iz + 1), fx, fz - 1.0f);
+	float n11 = grad2(hash2(seed, ix + 1, iz + 1), fx - 1.0f, fz - 1.0f);
+
+	return lerp(lerp(n00, n10, u), lerp(n01, n11, u), v);
+}
+
+static float noise3(uint32_t seed, float x, float y, float z)
+{
+	float x0 = floorf(x), y0 = floorf(y), z0 = floorf(z);
+	float fx = x - x0, fy = y - y0, fz = z - z0;
+	int32_t ix = (int32_t) x0, iy = (int32_t) y0, iz = (int32_t) z0;
+	float u = fade(fx), v = fade(fy), w = fade(fz);
+
+	float n000 = grad3(hash3(seed, ix, iy, iz), fx, fy, fz);
+	float n100 = grad3(hash3(seed, ix + 1, iy, iz), fx - 1.0f, fy, fz);
+	float n010 = grad3(hash3(seed, ix, iy + 1, iz), fx, fy - 1.0f, fz);
+	float n110 = grad3(hash3(seed, ix + 1, iy + 1, iz), fx - 1.0f, fy - 1.0f, fz);
+	float n001 = grad3(hash3(seed, ix, iy, iz + 1), fx, fy, fz - 1.0f);
+	float n101 = grad3(hash3(seed, ix + 1, iy, iz + 1), fx - 1.0f, fy, fz - 1.0f);
+	float n011 = grad3(hash3(seed, ix, iy + 1, iz + 1), fx, fy - 1.0f, fz - 1.0f);
+	float n111 = grad3(hash3(seed, ix + 1, iy + 1, iz + 1), fx - 1.0f, fy - 1.0f, fz - 1.0f);
+
+	return lerp(lerp(lerp(n000, n100, u), lerp(n010, n110, u), v),
+		lerp(lerp(n001, n101, u), lerp(n011, n111, u), v), w);
+}
+
+static float fbm2(uint32_t seed, int32_t octaves, float frequency, int32_t x, int32_t z)
+{
+	float sum = 0.0f, amplitude = 1.0f;
+	int32_t octave;
+
+	for (octave = 0; octave < octaves; octave++) {
+		sum = sum + amplitude * noise2(seed, (float) x * frequency, (float) z * frequency);
+		seed += OCTAVE_SEED_STEP;
+		amplitude *= 0.5f;
+		frequency *= 2.0f;
+	}
+
+	return sum;
+}
+
+static float fbm3(uint32_t seed, int32_t octaves, float frequency, int32_t x, int32_t y, int32_t z)
+{
+	float sum = 0.0f, amplitude = 1.0f;
+	int32_t octave;
+
+	for (octave = 0; octave < octaves; octave++) {
+		sum = sum + amplitude * noise3(seed, (float) x * frequency, (float) y * frequency,
+			(float) z * frequency);
+		seed += OCTAVE_SEED_STEP;
+		amplitude *= 0.5f;
+		frequency *= 2.0f;
+	}
+
+	return sum;
+}
+
+#ifdef HAVE_AVX2
+
+/* The same noise for eight consecutive z at once. */
+
+static AVX2 inline __m256i mix8(__m256i h)
+{
+	h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+	h = _mm256_mullo_epi32(h, _mm256_set1_epi32(0x2c1b3c6d));
+	h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 12));
+	h = _mm256_mullo_epi32(h, _mm256_set1_epi32(0x297a2d39));
+	h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+	return h;
+}
+
+static AVX2 inline __m256i hash2_8(__m256i seed, __m256i x, __m256i z)
+{
+	__m256i h = _mm256_xor_si256(seed, _mm256_mullo_epi32(x, _mm256_set1_epi32(PRIME_X)));
+	h = _mm256_xor_si256(h, _mm256_mullo_epi32(z, _mm256_set1_epi32(PRIME_Z)));
+	return mix8(h);
+}
+
+static AVX2 inline __m256i hash3_8(__m256i seed, __m256i x, __m256i y, __m256i z)
+{
+	__m256i h = _mm256_xor_si256(seed, _mm256_mullo_epi32(x, _mm256_set1_epi32(PRIME_X)));
+	h = _mm256_xor_si256(h, _mm256_mullo_epi32(y, _mm256_set1_epi32(PRIME_Y)));
+	h = _mm256_xor_si256(h, _mm256_mullo_epi32(z, _mm256_set1_epi32(PRIME_Z)));
+	return mix8(h);
+}
+
+static AVX2 inline __m256 flip8(__m256 f, __m256i h, int32_t bit)
+{
+	__m256i sign = _mm256_slli_epi32(_mm256_srli_epi32(h, bit), 31);
+	return _mm256_xor_ps(f, _mm256_castsi256_ps(sign));
+}
+
+static AVX2 inline __m256 grad2_8(__m256i h, __m256 x, __m256 z)
+{
+	return _mm256_add_ps(flip8(x, h, 0), flip8(z, h, 1));
+}
+
+static AVX2 inline __m256 grad3_8(__m256i h, __m256 x, __m256 y, __m256 z)
+{
+	return _mm256_add_ps(_mm256_add_ps(flip8(x, h, 0), flip8(y, h, 1)), flip8(z, h, 2));
+}
+
+static AVX2 inline __m256 fade8(__m256 t)
+{
+	__m256 t3 = _mm256_mul_ps(_mm256_mul_ps(t, t), t);
+	__m256 inner = _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6.0f)), _mm256_set1_ps(15.0f));
+	inner = _mm256_add_ps(_mm256_mul_ps(t, inner), _mm256_set1_ps(10.0f));
+	return _mm256_mul_ps(t3, inner);
+}
+
+static AVX2 inline __m256 lerp8(__m256 a, __m256 b, __m256 t)
+{
+	return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+}
+
+static AVX2 __m256 noise2_8(__m256i seed, __m256 x, __m256 z)
+{
+	__m256 one = _mm256_set1_ps(1.0f);
+	__m256i one_i = _mm256_set1_epi32(1);
+
+	__m256 x0 = _mm256_floor_ps(x), z0 = _mm256_floor_ps(z);
+	__m256 fx = _mm256_sub_ps(x, x0), fz = _mm256_sub_ps(z, z0);
+	__m256 fx1 = _mm256_sub_ps(fx, one), fz1 = _mm256_sub_ps(fz, one);
+	__m256i ix = _mm256_cvttps_epi32(x0), iz = _mm256_cvttps_epi32(z0);
+	__m256i ix1 = _mm256_add_epi32(ix, one_i), iz1 = _mm256_add_epi32(iz, one_i);
+	__m256 u = fade8(fx), v = fade8(fz);
+
+	__m256 n00 = grad2_8(hash2_8(seed, ix, iz), fx, fz);
+	__m256 n10 = grad2_8(hash2_8(seed, ix1, iz), fx1, fz);
+	__m256 n01 = grad2_8(hash2_8(seed, ix, iz1), fx, fz1);
+	__m256 n11 = grad2_8(hash2_8(seed, ix1, iz1), fx1, fz1);
+
+	return lerp8(lerp8(n00, n10, u), lerp8(n01, n11, u), v);
+}
+
+static AVX2 __m256 noise3_8(__m256i seed, __m256 x, __m256 y, __m256 z)
+{
+	__m256 one = _mm256_set1_ps(1.0f);
+	__m256i one_i = _mm256_set1_epi32(1);
+
+	__m256 x0 = _mm256_floor_ps(x), y0 = _mm256_floor_ps(y), z0 = _mm256_floor_ps(z);
+	__m256 fx = _mm256_sub_ps(x, x0), fy = _mm256_sub_ps(y, y0), fz = _mm256_sub_ps(z, z0);
+	__m256 fx1 = _mm256_sub_ps(fx, one), fy1 = _mm256_sub_ps(fy, one), fz1 = _mm256_sub_ps(fz, one);
+	__m256i ix = _mm256_cvttps_epi32(x0), iy = _mm256_cvttps_epi32(y0), iz = _mm256_cvttps_epi32(z0);
+	__m256i ix1 = _mm256_add_epi32(ix, one_i), iy1 = _mm256_add_epi32(iy, one_i);
+	__m256i iz1 = _mm256_add_epi32(iz, one_i);
+	__m256 u = fade8(fx), v = fade8(fy), w = fade8(fz);
+
+	__m256 n000 = grad3_8(hash3_8(seed, ix, iy, iz), fx, fy, fz);
+	__m256 n100 = grad3_8(hash3_8(seed, ix1, iy, iz), fx1, fy, fz);
+	__m256 n010 = grad3_8(hash3_8(seed, ix, iy1, iz), fx, fy1, fz);
+	__m256 n110 = grad3_8(hash3_8(seed, ix1, iy1, iz), fx1, fy1, fz);
+	__m256 n001 = grad3_8(hash3_8(seed, ix, iy, iz1), fx, fy, fz1);
+	__m256 n101 = grad3_8(hash3_8(seed, ix1, iy, iz1), fx1, fy, fz1);
+	__m256 n011 = grad3_8(hash3_8(seed, ix, iy1, iz1), fx, fy1, fz1);
+	__m256 n111 = grad3_8(hash3_8(seed, ix1, iy1, iz1), fx1, fy1, fz1);
+
+	return lerp8(lerp8(lerp8(n000, n100, u), lerp8(n010, n110, u), v),
+		lerp8(lerp8(n001, n101, u), lerp8(n011, n111, u), v), w);
+}
+
+static AVX2 void fbm2_avx2(uint32_t seed, int32_t octaves, float frequency, int32_t x, int32_t z,
+	float *out)
+{
+	__m256 xs = _mm256_set1_ps((float) x);
+	__m256 zs = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(z),
+		_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+	__m256 sum = _mm256_setzero_ps();
+	float amplitude = 1.0f;
+	int32_t octave;
+
+	for (octave = 0; octave < octaves; octave++) {
+		__m256 f = _mm256_set1_ps(frequency);
+		__m256 n = noise2_8(_mm256_set1_epi32(seed), _mm256_mul_ps(xs, f), _mm256_mul_ps(zs, f));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(amplitude), n));
+		seed += OCTAVE_SEED_STEP;
+		amplitude *= 0.5f;
+		frequency *= 2.0f;
+	}
+
+	_mm256_storeu_ps(out, sum);
+}
+
+static AVX2 void fbm3_avx2(uint32_t seed, int32_t octaves, float frequency, int32_t x, int32_t y,
+	int32_t z, float *out)
+{
+	__m256 xs = _mm256_set1_ps((float) x), ys = _mm256_set1_ps((float) y);
+	__m256 zs = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(z),
+		_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+	__m256 sum = _mm256_setzero_ps();
+	float amplitude = 1.0f;
+	int32_t octave;
+
+	for (octave = 0; octave < octaves; octave++) {
+		__m256 f = _mm256_set1_ps(frequency);
+		__m256 n = noise3_8(_mm256_set1_epi32(seed), _mm256_mul_ps(xs, f), _mm256_mul_ps(ys, f),
+			_mm256_mul_ps(zs, f));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(amplitude), n));
+		seed += OCTAVE_SEED_STEP;
+		amplitude *= 0.5f;
+		frequency *= 2.0f;
+	}
+
+	_mm256_storeu_ps(out, sum);
+}
+
+#endif
+
+/* Surface heights at (x, z .. z + LANES - 1). */
+static void heights(const terrain_params *params, int32_t x, int32_t z, float *out)
+{
+	int32_t lane;
+
+#ifdef HAVE_AVX2
+	if (params->use_avx2) {
+		fbm2_avx2(params->seed, params->octaves, params->frequency, x, z, out);
+	} else
+#endif
+	{
+		for (lane = 0; lane < LANES; lane++)
+			out[lane] = fbm2(params->seed, params->octaves, params->frequency, x, z + lane);
+	}
+
+	for (lane = 0; lane < LANES; lane++)
+		out[lane] = params->base_height + params->height_scale * out[lane];
+}
+
+/* Cave noise at (x, y, z .. z + LANES - 1). */
+static void caves(const terrain_params *params, int32_t x, int32_t y, int32_t z, float *out)
+{
+	uint32_t seed = params->seed ^ CAVE_SEED;
+
+#ifdef HAVE_AVX2
+	if (params->use_avx2) {
+		fbm3_avx2(seed, params->cave_octaves, params->cave_frequency, x, y, z, out);
+		return;
+	}
+#endif
+
+	int32_t lane;
+	for (lane = 0; lane < LANES; lane++)
+		out[lane] = fbm3(seed, params->cave_octaves, params->cave_frequency, x, y, z + lane);
+}
+
+struct terrain_job
+{
+	voxel_grid *grid;
+	const terrain_params *params;
+};
+
+static void generate_column(void *context, uint32_t column)
+{
+	const struct terrain_job *job = context;
+	voxel_grid *grid = job->grid;
+	const terrain_params *params = job->params;
+
+	int32_t x0 = (column / grid->chunks_z) * CHUNK_SIZE, x1 = x0 + CHUNK_SIZE;
+	int32_t z0 = (column % grid->chunks_z) * CHUNK_SIZE, z1 = z0 + CHUNK_SIZE;
+	if (x1 > grid->size_x)
+		x1 = grid->size_x;
+	if (z1 > grid->size_z)
+		z1 = grid->size_z;
+
+	/* CHUNK_SIZE is a multiple of LANES, so whole blocks of lanes fit. */
+	float surface[CHUNK_SIZE][CHUNK_SIZE], cave[LANES];
+	int32_t x, y, z, lane;
+
+	for (x = x0; x < x1; x++)
+		for (z = z0; z < z1; z += LANES)
+			heights(params, x, z, &surface[x - x0][z - z0]);
+
+	for (x = x0; x < x1; x++) {
+		for (z = z0; z < z1; z += LANES) {
+			int32_t lanes = z1 - z < LANES ? z1 - z : LANES;
+			const float *height = &surface[x - x0][z - z0];
+
+			float top = height[0];
+			for (lane = 1; lane < lanes; lane++)
+				if (height[lane] > top)
+					top = height[lane];
+
+			for (y = 0; y < grid->size_y; y++) {
+				uint8_t *voxels = &grid->voxels[((int64_t) x * grid->size_y + y) * grid->size_z + z];
+
+				if (y >= top) {
+					memset(voxels, VOXEL_EMPTY, lanes);
+					continue;
+				}
+
+				caves(params, x, y, z, cave);
+
+				for (lane = 0; lane < lanes; lane++) {
+					float depth = height[lane] - y;
+
+					if (depth <= 0.0f || (y > 0 && cave[lane] > params->cave_threshold))
+						voxels[lane] = VOXEL_EMPTY;
+					else if (depth <= GRASS_DEPTH)
+						voxels[lane] = VOXEL_GRASS;
+					else if (depth <= DIRT_DEPTH)
+						voxels[lane] = VOXEL_DIRT;
+					else
+						voxels[lane] = VOXEL_STONE;
+				}
+			}
+		}
+	}
+}
+
+void terrain_generate(voxel_grid *grid, const terrain_params *params)
+{
+	struct terrain_job job = { .grid = grid, .params = params };
+
+	parallel_for(grid->chunks_x * grid->chunks_z, generate_column, &job);
+}
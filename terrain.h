@@ -0,0 +1,34 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <stdint.h>
+
+#include "voxel.h"
+
+/*
+ * Procedural terrain: a fractal (fBm) gradient noise heightmap, with 3D noise
+ * carving caves out of the ground beneath it. The same seed and parameters
+ * always give the same voxels, whether or not AVX2 is used.
+ */
+typedef struct
+{
+	uint32_t seed;
+
+	int32_t octaves;
+	float frequency;	/* Of the first octave, in cycles per voxel. */
+	float base_height, height_scale;
+
+	int32_t cave_octaves;
+	float cave_frequency;
+	float cave_threshold;	/* Where the cave noise is above this, there is air. */
+
+	int32_t use_avx2;
+} terrain_params;
+
+/* Parameters that suit a grid size_y voxels tall. AVX2 is used if the CPU has it. */
+void terrain_params_default(terrain_params *params, uint32_t seed, int32_t size_y);
+
+/* Overwrite every voxel of the grid, one column of chunks per worker. */
+void terrain_generate(voxel_grid *grid, const terrain_params *params);
+
+#endif
@@ -0,0 +1,42 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "timing.h"
+
+double timing_now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void timing_phase_begin(timing_phase *phase, const char *name)
+{
+	phase->name = name;
+	phase->start = timing_now();
+	phase->end = phase->start;
+}
+
+void timing_phase_end(timing_phase *phase)
+{
+	phase->end = timing_now();
+}
+
+static int compare_phases(const void *a, const void *b)
+{
+	const timing_phase *pa = a, *pb = b;
+	return (pa->start > pb->start) - (pa->start < pb->start);
+}
+
+void timing_report(timing_phase *phases, uint32_t num_phases, double origin)
+{
+	qsort(phases, num_phases, sizeof *phases, compare_phases);
+
+	uint32_t i;
+	for (i = 0; i < num_phases; i++)
+		printf("%-20s %8.2f ms -> %8.2f ms (%8.2f ms)\n", phases[i].name,
+			(phases[i].start - origin) * 1e3,
+			(phases[i].end - origin) * 1e3,
+			(phases[i].end - phases[i].start) * 1e3);
+}
@@ -0,0 +1,22 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+
+/* A named interval of wall-clock time, used to report startup phases. */
+typedef struct
+{
+	const char *name;
+	double start, end;
+} timing_phase;
+
+/* Seconds on a monotonic clock. Only differences between calls are meaningful. */
+double timing_now(void);
+
+void timing_phase_begin(timing_phase *phase, const char *name);
+void timing_phase_end(timing_phase *phase);
+
+/* Print each phase relative to origin, sorted by start time. */
+void timing_report(timing_phase *phases, uint32_t num_phases, double origin);
+
+#endif
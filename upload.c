@@ -0,0 +1,352 @@
+#include <stdlib.h>
+
+#include "gl_state.h"
+#include "gpu_memory.h"
+#include "upload.h"
+
+struct upload_job
+{
+	uint32_t chunk;
+	chunk_mesh *mesh;
+	upload_job *next;
+};
+
+upload_queue *upload_queue_new(uint32_t num_meshes, uint64_t budget)
+{
+	upload_queue *queue = calloc(1, sizeof *queue);
+	if (!queue)
+		return NULL;
+
+	queue->meshes = calloc(num_meshes, sizeof *queue->meshes);
+	queue->evicted = calloc(num_meshes, sizeof *queue->evicted);
+	if (!queue->meshes || !queue->evicted) {
+		free(queue->meshes);
+		free(queue->evicted);
+		free(queue);
+		return NULL;
+	}
+
+	pthread_mutex_init(&queue->lock, NULL);
+	queue->num_meshes = num_meshes;
+	queue->budget = budget;
+
+	return queue;
+}
+
+static void delete_gpu_mesh(gpu_mesh *mesh)
+{
+	if (mesh->vao) {
+		gl_state_delete_vertex_array(mesh->vao);
+		gpu_memory_buffer_delete(mesh->vbo);
+	}
+
+	mesh->vao = mesh->vbo = 0;
+	mesh->num_vertices = 0;
+	mesh->bytes = 0;
+	mesh->pulled = 0;
+}
+
+void gpu_mesh_draw(gpu_mesh *mesh)
+{
+	if (!mesh->num_vertices)
+		return;
+
+	gl_state_bind_vertex_array(mesh->vao);
+	if (mesh->pulled)
+		gl_state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, 0, mesh->vbo);
+	glDrawArrays(GL_TRIANGLES, 0, mesh->num_vertices);
+	mesh->drawn = 1;
+}
+
+/* What goes into a mesh's vbo: its vertices or its face records. */
+static const void *mesh_data(const chunk_mesh *mesh)
+{
+	return mesh->num_faces ? (const void *) mesh->faces : (const void *) mesh->vertices;
+}
+
+static uint64_t mesh_bytes(const chunk_mesh *mesh)
+{
+	return mesh->num_faces ? sizeof(uint32_t) * mesh->num_faces
+		: (uint64_t) COMPONENTS_PER_VERTEX * mesh->num_vertices;
+}
+
+static void free_job(upload_job *job)
+{
+	chunk_mesh_free(job->mesh);
+	free(job);
+}
+
+void upload_queue_free(upload_queue *queue)
+{
+	if (!queue)
+		return;
+
+	while (queue->head) {
+		upload_job *next = queue->head->next;
+		free_job(queue->head);
+		queue->head = next;
+	}
+
+	if (queue->current) {
+		delete_gpu_mesh(&queue->staging);
+		free_job(queue->current);
+	}
+
+	uint32_t i;
+	for (i = 0; i < queue->num_meshes; i++)
+		delete_gpu_mesh(&queue->meshes[i]);
+
+	pthread_mutex_destroy(&queue->lock);
+	free(queue->meshes);
+	free(queue->evicted);
+	free(queue);
+}
+
+void upload_queue_push(upload_queue *queue, uint32_t chunk, chunk_mesh *mesh)
+{
+	upload_job *job = malloc(sizeof *job);
+	if (!job) {
+		chunk_mesh_free(mesh);
+		return;
+	}
+
+	job->chunk = chunk;
+	job->mesh = mesh;
+	job->next = NULL;
+
+	pthread_mutex_lock(&queue->lock);
+	if (queue->tail)
+		queue->tail->next = job;
+	else
+		queue->head = job;
+	queue->tail = job;
+	queue->queue_depth++;
+	pthread_mutex_unlock(&queue->lock);
+}
+
+/* Note that chunk has lost a mesh of bytes bytes. */
+static void evict(upload_queue *queue, uint32_t chunk, uint64_t bytes)
+{
+	pthread_mutex_lock(&queue->lock);
+	queue->evicted[chunk] = bytes;
+	pthread_mutex_unlock(&queue->lock);
+}
+
+int32_t upload_queue_take_evicted(upload_queue *queue, uint32_t chunk)
+{
+	pthread_mutex_lock(&queue->lock);
+	uint64_t bytes = queue->evicted[chunk];
+	int32_t taken = bytes && bytes <= queue->room;
+	if (taken) {
+		queue->evicted[chunk] = 0;
+		queue->room -= bytes;
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	return taken;
+}
+
+uint32_t upload_queue_depth(upload_queue *queue)
+{
+	pthread_mutex_lock(&queue->lock);
+	uint32_t depth = queue->queue_depth;
+	pthread_mutex_unlock(&queue->lock);
+
+	return depth;
+}
+
+static upload_job *pop(upload_queue *queue)
+{
+	pthread_mutex_lock(&queue->lock);
+	upload_job *job = queue->head;
+	if (job) {
+		queue->head = job->next;
+		if (!queue->head)
+			queue->tail = NULL;
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	return job;
+}
+
+/* Done with the current job, whether or not its mesh made it. */
+static void retire(upload_queue *queue)
+{
+	free_job(queue->current);
+	queue->current = NULL;
+
+	pthread_mutex_lock(&queue->lock);
+	queue->queue_depth--;
+	pthread_mutex_unlock(&queue->lock);
+}
+
+static void finish(upload_queue *queue)
+{
+	upload_job *job = queue->current;
+	gpu_mesh *staging = &queue->staging;
+
+	/* Pulled meshes have no attributes; their vertex array is empty. */
+	if (staging->vao && !staging->pulled) {
+		gl_state_bind_vertex_array(staging->vao);
+		gl_state_bind_buffer(GL_ARRAY_BUFFER, staging->vbo);
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_BYTE, GL_FALSE, COMPONENTS_PER_VERTEX, 0);
+		glEnableVertexAttribArray(0);
+		glVertexAttribIPointer(1, 1, GL_UNSIGNED_BYTE, COMPONENTS_PER_VERTEX, (const void *) 3);
+		glEnableVertexAttribArray(1);
+		glVertexAttribIPointer(2, 1, GL_UNSIGNED_BYTE, COMPONENTS_PER_VERTEX, (const void *) 4);
+		glEnableVertexAttribArray(2);
+		glVertexAttribIPointer(3, 1, GL_UNSIGNED_BYTE, COMPONENTS_PER_VERTEX, (const void *) 5);
+		glEnableVertexAttribArray(3);
+		gl_state_bind_vertex_array(0);
+	}
+	if (staging->vao)
+		gpu_memory_set_category(staging->vbo, GPU_MEMORY_MESH);
+
+	/* Only now does the chunk stop drawing its old mesh. */
+	delete_gpu_mesh(&queue->meshes[job->chunk]);
+	queue->meshes[job->chunk] = *staging;
+	queue->meshes[job->chunk].last_drawn = queue->frame;
+	staging->vao = staging->vbo = 0;
+	staging->num_vertices = 0;
+	staging->bytes = 0;
+	staging->pulled = 0;
+
+	retire(queue);
+	queue->stats.meshes_uploaded++;
+}
+
+/* Whether the mesh was drawn in this frame or the one before, or has only just been uploaded. */
+static int32_t on_screen(const upload_queue *queue, const gpu_mesh *mesh)
+{
+	return mesh->last_drawn + 1 >= queue->frame;
+}
+
+/*
+ * Evict meshes until size more bytes fit in the memory budget, least
+ * recently drawn first. Meshes last drawn in the same frame go largest
+ * first, so that as few chunks as possible disappear. Returns 0 if the
+ * meshes left are all on screen.
+ */
+static int32_t make_room(upload_queue *queue, uint64_t size)
+{
+	while (!gpu_memory_fits(size)) {
+		uint32_t victim = queue->num_meshes;
+
+		uint32_t i;
+		for (i = 0; i < queue->num_meshes; i++) {
+			const gpu_mesh *mesh = &queue->meshes[i];
+			if (!mesh->vao || on_screen(queue, mesh))
+				continue;
+
+			const gpu_mesh *best = &queue->meshes[victim];
+			if (victim == queue->num_meshes || mesh->last_drawn < best->last_drawn
+				|| (mesh->last_drawn == best->last_drawn && mesh->bytes > best->bytes))
+				victim = i;
+		}
+
+		if (victim == queue->num_meshes)
+			return 0;
+
+		evict(queue, victim, queue->meshes[victim].bytes);
+		delete_gpu_mesh(&queue->meshes[victim]);
+		queue->stats.meshes_evicted++;
+	}
+
+	return 1;
+}
+
+static void start(upload_queue *queue, upload_job *job)
+{
+	gpu_mesh *staging = &queue->staging;
+	queue->current = job;
+	queue->current_offset = 0;
+	staging->num_vertices = chunk_mesh_num_vertices(job->mesh);
+	if (!staging->num_vertices)
+		return;
+
+	/* A mesh that only fits by taking the place of what is on screen waits for room. */
+	if (!make_room(queue, mesh_bytes(job->mesh))) {
+		staging->num_vertices = 0;
+		evict(queue, job->chunk, mesh_bytes(job->mesh));
+		retire(queue);
+		queue->stats.meshes_dropped++;
+		return;
+	}
+
+	staging->bytes = mesh_bytes(job->mesh);
+	staging->pulled = job->mesh->num_faces != 0;
+	glGenVertexArrays(1, &staging->vao);
+	staging->vbo = gpu_memory_buffer_new(GPU_MEMORY_STAGING, GL_ARRAY_BUFFER,
+		mesh_bytes(job->mesh), NULL, GL_STATIC_DRAW);
+	if (!staging->vbo) {
+		evict(queue, job->chunk, mesh_bytes(job->mesh));
+		delete_gpu_mesh(staging);
+		retire(queue);
+		queue->stats.meshes_dropped++;
+	}
+}
+
+/* Upload up to budget bytes of the current mesh. */
+static uint64_t upload_some(upload_queue *queue, uint64_t budget)
+{
+	const chunk_mesh *mesh = queue->current->mesh;
+	uint64_t size = mesh_bytes(mesh) - queue->current_offset;
+	if (size > budget)
+		size = budget;
+
+	/* An empty mesh has no buffer to upload into. */
+	if (!size)
+		return 0;
+
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, queue->staging.vbo);
+	glBufferSubData(GL_ARRAY_BUFFER, queue->current_offset, size,
+		(const uint8_t *) mesh_data(mesh) + queue->current_offset);
+	queue->current_offset += size;
+
+	return size;
+}
+
+void upload_queue_process(upload_queue *queue)
+{
+	uint64_t spent = 0;
+
+	/* Whatever was drawn since the last call was drawn in the frame before this one. */
+	queue->frame++;
+	uint64_t reclaimable = 0;
+	uint32_t i;
+	for (i = 0; i < queue->num_meshes; i++) {
+		gpu_mesh *mesh = &queue->meshes[i];
+		if (mesh->drawn) {
+			mesh->last_drawn = queue->frame - 1;
+			mesh->drawn = 0;
+		}
+		if (mesh->vao && !on_screen(queue, mesh))
+			reclaimable += mesh->bytes;
+	}
+
+	while (spent < queue->budget) {
+		if (!queue->current) {
+			upload_job *job = pop(queue);
+			if (!job)
+				break;
+			start(queue, job);
+			if (!queue->current)
+				continue;
+		}
+
+		spent += upload_some(queue, queue->budget - spent);
+
+		if (queue->current_offset == mesh_bytes(queue->current->mesh))
+			finish(queue);
+	}
+
+	/* What evicted chunks can have back: free memory and the meshes that are off screen. */
+	uint64_t available = gpu_memory_available();
+	pthread_mutex_lock(&queue->lock);
+	queue->room = available > UINT64_MAX - reclaimable ? UINT64_MAX : available + reclaimable;
+	pthread_mutex_unlock(&queue->lock);
+
+	queue->stats.bytes_this_frame = spent;
+	queue->stats.bytes_total += spent;
+	queue->stats.queue_depth = upload_queue_depth(queue);
+}
@@ -0,0 +1,102 @@
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include <GL/glew.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#include "mesher.h"
+
+/* The buffers a chunk is drawn from. A chunk with no vertices has no buffers. */
+typedef struct
+{
+	GLuint vao, vbo;
+	uint32_t num_vertices;
+	uint64_t bytes;		/* What its vbo takes. */
+	int32_t pulled;		/* vbo holds face records for the vertex shader to read, not vertices. */
+	uint64_t last_drawn;	/* The upload queue's frame count when it was last drawn. */
+	int32_t drawn;		/* Drawn since the queue last looked. */
+} gpu_mesh;
+
+typedef struct upload_job upload_job;
+
+typedef struct
+{
+	uint32_t queue_depth;		/* Meshes waiting, including a partly uploaded one. */
+	uint64_t bytes_this_frame;
+	uint64_t bytes_total;
+	uint64_t meshes_uploaded;
+	uint64_t meshes_evicted;	/* To stay within the GPU memory budget. */
+	uint64_t meshes_dropped;	/* No room without evicting meshes that are on screen. */
+} upload_stats;
+
+/*
+ * Meshes built on worker threads are pushed here and uploaded by the render
+ * thread a little at a time, so that a large world streams in over several
+ * frames instead of stalling one. Each mesh is written into fresh buffers
+ * with glBufferSubData; the chunk keeps drawing its old mesh until the new
+ * one is complete.
+ *
+ * Buffers are made through gpu_memory.c. When a new mesh would take them
+ * over its budget, the meshes drawn least recently are deleted to make room,
+ * but never those drawn in this frame or the one before; if that isn't
+ * enough the new mesh is dropped instead. Either way the chunk is noted as
+ * evicted, and upload_queue_take_evicted hands it back to be meshed again
+ * once there is room for it.
+ */
+typedef struct
+{
+	pthread_mutex_t lock;
+	upload_job *head, *tail;
+	uint32_t queue_depth;
+
+	upload_job *current;
+	gpu_mesh staging;
+	uint64_t current_offset;
+
+	gpu_mesh *meshes;
+	uint32_t num_meshes;
+	uint64_t budget;
+	uint64_t frame;		/* Calls to upload_queue_process. */
+	upload_stats stats;
+
+	/*
+	 * Under lock: per chunk, the bytes of the mesh it lost, or 0 if it
+	 * didn't lose one, and the bytes that could be made room for as of the
+	 * last upload_queue_process.
+	 */
+	uint64_t *evicted;
+	uint64_t room;
+} upload_queue;
+
+/* A queue for num_meshes chunks that uploads at most budget bytes per frame. */
+upload_queue *upload_queue_new(uint32_t num_meshes, uint64_t budget);
+
+/* Delete every buffer and free the queue. Must be called with the context current. */
+void upload_queue_free(upload_queue *queue);
+
+/* Hand over a finished mesh for chunk. Can be called from any thread. */
+void upload_queue_push(upload_queue *queue, uint32_t chunk, chunk_mesh *mesh);
+
+/* Spend this frame's byte budget. Must be called with the context current. */
+void upload_queue_process(upload_queue *queue);
+
+/*
+ * Draw the mesh, if it has any vertices, and mark it as used. A pulled mesh's
+ * face records are bound to storage buffer 0 for the program to read. Must
+ * be called with the context current.
+ */
+void gpu_mesh_draw(gpu_mesh *mesh);
+
+/*
+ * Whether chunk lost its mesh to the memory budget and there is now room
+ * for it again. If so the caller must mesh the chunk again and push it; the
+ * chunk isn't handed back again unless it is evicted again. Safe from any
+ * thread.
+ */
+int32_t upload_queue_take_evicted(upload_queue *queue, uint32_t chunk);
+
+/* Meshes waiting to be uploaded; safe from any thread. */
+uint32_t upload_queue_depth(upload_queue *queue);
+
+#endif
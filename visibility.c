@@ -0,0 +1,235 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mesher.h"
+#include "visibility.h"
+
+/* Where the search starts: no face came before it. */
+#define NO_FACE 6
+
+/* Half a chunk's diagonal: how far a chunk reaches from its centre. */
+#define CHUNK_RADIUS (CHUNK_SIZE * 0.8660254f)
+
+/*
+ * A chunk the search has reached, with the face it came in by and the
+ * directions taken on the way there, a bit for each of mesher.h's faces.
+ */
+struct chunk_visibility_step
+{
+	uint32_t chunk;
+	uint8_t face, directions;
+};
+
+/* The step to the next chunk, or voxel, through each face. */
+static const int32_t face_steps[6][3] =
+{
+	{ -1, 0, 0 }, { 0, -1, 0 }, { 0, 0, -1 }, { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 }
+};
+
+static int32_t opposite_face(int32_t face)
+{
+	return (face + 3) % 6;
+}
+
+/* The bit for faces a and b, which differ, being joined: bits 0-4 pair face 0 with 1-5, bits 5-8 face 1 with 2-5 and so on. */
+static uint16_t pair_bit(int32_t a, int32_t b)
+{
+	if (a > b) {
+		int32_t t = a;
+		a = b;
+		b = t;
+	}
+	return 1u << (a * (11 - a) / 2 + b - a - 1);
+}
+
+/* Every pair of the faces in faces, a bit per face, joined. */
+static uint16_t join_faces(uint32_t faces)
+{
+	uint16_t joined = 0;
+	int32_t a, b;
+	for (a = 0; a < 6; a++)
+		for (b = a + 1; b < 6; b++)
+			if (faces >> a & faces >> b & 1)
+				joined |= pair_bit(a, b);
+	return joined;
+}
+
+chunk_visibility *chunk_visibility_new(const voxel_grid *grid)
+{
+	chunk_visibility *visibility = calloc(1, sizeof *visibility);
+	if (!visibility)
+		return NULL;
+
+	visibility->chunks_x = grid->chunks_x;
+	visibility->chunks_y = grid->chunks_y;
+	visibility->chunks_z = grid->chunks_z;
+	visibility->num_chunks = voxel_grid_num_chunks(grid);
+
+	visibility->connections = malloc(visibility->num_chunks * sizeof *visibility->connections);
+	visibility->visible = calloc(visibility->num_chunks, 1);
+	visibility->queue = malloc(visibility->num_chunks * sizeof *visibility->queue);
+	if (!visibility->connections || !visibility->visible || !visibility->queue) {
+		chunk_visibility_free(visibility);
+		return NULL;
+	}
+
+	uint32_t chunk;
+	for (chunk = 0; chunk < visibility->num_chunks; chunk++)
+		visibility->connections[chunk] = CHUNK_FACES_ALL_JOINED;
+
+	return visibility;
+}
+
+void chunk_visibility_free(chunk_visibility *visibility)
+{
+	if (!visibility)
+		return;
+
+	free(visibility->connections);
+	free(visibility->visible);
+	free(visibility->queue);
+	free(visibility);
+}
+
+void chunk_visibility_build_chunk(chunk_visibility *visibility, const voxel_grid *grid, uint32_t chunk)
+{
+	if (!grid->brick_masks[chunk]) {
+		visibility->connections[chunk] = CHUNK_FACES_ALL_JOINED;
+		return;
+	}
+
+	int32_t cx, cy, cz;
+	voxel_grid_chunk_coords(grid, chunk, &cx, &cy, &cz);
+	int32_t low[3] = { cx * CHUNK_SIZE, cy * CHUNK_SIZE, cz * CHUNK_SIZE };
+	int32_t grid_size[3] = { grid->size_x, grid->size_y, grid->size_z };
+	int32_t size[3], i;
+	for (i = 0; i < 3; i++)
+		size[i] = grid_size[i] - low[i] < CHUNK_SIZE ? grid_size[i] - low[i] : CHUNK_SIZE;
+
+	/* Voxels within the chunk are numbered x-major like the grid's, with strides of their own. */
+	int64_t strides[3] = { (int64_t) grid->size_y * grid->size_z, grid->size_z, 1 };
+	const int32_t local_strides[3] = { CHUNK_SIZE * CHUNK_SIZE, CHUNK_SIZE, 1 };
+	const uint8_t *voxels = grid->voxels + low[0] * strides[0] + low[1] * strides[1] + low[2];
+
+	uint8_t seen[CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE] = { 0 };
+	uint16_t stack[CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE];
+	uint16_t connections = 0;
+
+	/*
+	 * Flood-fill each empty region from a voxel on the chunk's edge, noting
+	 * the faces it reaches. Regions that reach none are left alone, since
+	 * they can't join any.
+	 */
+	int32_t x, y, z;
+	for (x = 0; x < size[0] && connections != CHUNK_FACES_ALL_JOINED; x++) {
+		for (y = 0; y < size[1]; y++) {
+			for (z = 0; z < size[2]; z++) {
+				int32_t edge = x == 0 || y == 0 || z == 0 || x == size[0] - 1 || y == size[1] - 1
+					|| z == size[2] - 1;
+				uint16_t local = (x * CHUNK_SIZE + y) * CHUNK_SIZE + z;
+				if (!edge || seen[local] || voxels[x * strides[0] + y * strides[1] + z])
+					continue;
+
+				uint32_t faces = 0;
+				int32_t top = 0;
+				seen[local] = 1;
+				stack[top++] = local;
+				while (top) {
+					uint16_t voxel = stack[--top];
+					int32_t position[3] = { voxel / (CHUNK_SIZE * CHUNK_SIZE), voxel / CHUNK_SIZE % CHUNK_SIZE,
+						voxel % CHUNK_SIZE };
+
+					int32_t face;
+					for (face = 0; face < 6; face++) {
+						int32_t axis = face % 3, step = face_steps[face][axis];
+						int32_t next = position[axis] + step;
+						if (next < 0 || next >= size[axis]) {
+							faces |= 1u << face;
+							continue;
+						}
+
+						uint16_t neighbour = voxel + step * local_strides[axis];
+						if (seen[neighbour])
+							continue;
+						seen[neighbour] = 1;
+
+						int64_t index = position[0] * strides[0] + position[1] * strides[1] + position[2]
+							+ step * strides[axis];
+						if (!voxels[index])
+							stack[top++] = neighbour;
+					}
+				}
+
+				connections |= join_faces(faces);
+			}
+		}
+	}
+
+	visibility->connections[chunk] = connections;
+}
+
+uint32_t chunk_visibility_search(chunk_visibility *visibility, const double *eye, const float *forward)
+{
+	int32_t chunks[3] = { visibility->chunks_x, visibility->chunks_y, visibility->chunks_z };
+	int32_t start[3], i;
+	for (i = 0; i < 3; i++) {
+		/* Voxel v spans v - 0.5 to v + 0.5. */
+		start[i] = (int32_t) floor((eye[i] + 0.5) / CHUNK_SIZE);
+		if (start[i] < 0 || start[i] >= chunks[i]) {
+			memset(visibility->visible, 1, visibility->num_chunks);
+			return visibility->num_chunks;
+		}
+	}
+
+	memset(visibility->visible, 0, visibility->num_chunks);
+	struct chunk_visibility_step *queue = visibility->queue;
+	uint32_t head = 0, tail = 0;
+
+	uint32_t first = (start[0] * chunks[1] + start[1]) * chunks[2] + start[2];
+	visibility->visible[first] = 1;
+	queue[tail++] = (struct chunk_visibility_step) { first, NO_FACE, 0 };
+
+	while (head < tail) {
+		struct chunk_visibility_step step = queue[head++];
+		int32_t position[3] =
+		{
+			step.chunk / (chunks[2] * chunks[1]), step.chunk / chunks[2] % chunks[1], step.chunk % chunks[2]
+		};
+
+		int32_t face;
+		for (face = 0; face < 6; face++) {
+			/* Going back the way the search came can only find what another path would. */
+			if (step.directions >> opposite_face(face) & 1)
+				continue;
+			if (step.face != NO_FACE && !(visibility->connections[step.chunk] & pair_bit(step.face, face)))
+				continue;
+
+			int32_t next[3];
+			for (i = 0; i < 3; i++)
+				next[i] = position[i] + face_steps[face][i];
+			if (next[0] < 0 || next[1] < 0 || next[2] < 0 || next[0] >= chunks[0] || next[1] >= chunks[1]
+				|| next[2] >= chunks[2])
+				continue;
+
+			uint32_t chunk = (next[0] * chunks[1] + next[1]) * chunks[2] + next[2];
+			if (visibility->visible[chunk])
+				continue;
+
+			/* Wholly behind the plane through the eye facing forward. */
+			float ahead = 0.0f;
+			for (i = 0; i < 3; i++)
+				ahead += (float) ((next[i] + 0.5) * CHUNK_SIZE - 0.5 - eye[i]) * forward[i];
+			if (ahead < -CHUNK_RADIUS)
+				continue;
+
+			visibility->visible[chunk] = 1;
+			queue[tail++] = (struct chunk_visibility_step)
+			{
+				chunk, opposite_face(face), step.directions | 1u << face
+			};
+		}
+	}
+
+	return tail;
+}
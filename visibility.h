@@ -0,0 +1,56 @@
+#ifndef VISIBILITY_H
+#define VISIBILITY_H
+
+#include <stdint.h>
+
+#include "voxel.h"
+
+/* Every pair of a chunk's faces joined: what a chunk with nothing in it has. */
+#define CHUNK_FACES_ALL_JOINED 0x7fff
+
+/*
+ * Which chunks the camera might see into, for leaving out those behind solid
+ * rock. Each chunk records which pairs of its six faces are joined by empty
+ * space inside it, one bit per pair. A search from the camera's chunk then
+ * only goes through a chunk from the face it came in by to the faces that
+ * face is joined to, so caves and rooms walled off from the camera are
+ * never reached.
+ *
+ * Chunks are indexed as voxel_grid_chunk_index has them.
+ */
+typedef struct
+{
+	int32_t chunks_x, chunks_y, chunks_z;
+	uint32_t num_chunks;
+
+	/* Per chunk, the pairs of faces joined; all of them until chunk_visibility_build_chunk. */
+	uint16_t *connections;
+
+	/* Per chunk, whether the last chunk_visibility_search reached it. */
+	uint8_t *visible;
+
+	struct chunk_visibility_step *queue;
+} chunk_visibility;
+
+/* Returns NULL on failure. */
+chunk_visibility *chunk_visibility_new(const voxel_grid *grid);
+void chunk_visibility_free(chunk_visibility *visibility);
+
+/*
+ * Work out which faces of chunk are joined from the grid's voxels, by
+ * flood-filling the empty voxels within it. Different chunks can be built
+ * on different threads at once.
+ */
+void chunk_visibility_build_chunk(chunk_visibility *visibility, const voxel_grid *grid, uint32_t chunk);
+
+/*
+ * Mark in visible the chunks that can be seen from eye, in voxels like
+ * camera_state's position, looking along forward. The search goes
+ * breadth-first from the camera's chunk through joined faces. It never
+ * steps back along an axis it has already gone along the other way, and
+ * never into a chunk wholly behind the camera. If eye is outside the grid,
+ * every chunk is visible. Returns how many are.
+ */
+uint32_t chunk_visibility_search(chunk_visibility *visibility, const double *eye, const float *forward);
+
+#endif
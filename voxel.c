@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "parallel.h"
+#include "voxel.h"
+
+voxel_grid *voxel_grid_new(int32_t size_x, int32_t size_y, int32_t size_z)
+{
+	voxel_grid *grid = malloc(sizeof *grid);
+	if (!grid)
+		return NULL;
+
+	grid->size_x = size_x;
+	grid->size_y = size_y;
+	grid->size_z = size_z;
+	grid->chunks_x = (size_x + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	grid->chunks_y = (size_y + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	grid->chunks_z = (size_z + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+	grid->voxels = calloc((size_t) size_x * size_y * size_z, 1);
+	grid->brick_masks = calloc(voxel_grid_num_chunks(grid), sizeof *grid->brick_masks);
+	if (!grid->voxels || !grid->brick_masks) {
+		free(grid->voxels);
+		free(grid->brick_masks);
+		free(grid);
+		return NULL;
+	}
+
+	return grid;
+}
+
+void voxel_grid_free(voxel_grid *grid)
+{
+	if (!grid)
+		return;
+
+	free(grid->voxels);
+	free(grid->brick_masks);
+	free(grid);
+}
+
+static void fill_solid_slab(void *context, uint32_t x)
+{
+	voxel_grid *grid = context;
+	size_t slab = (size_t) grid->size_y * grid->size_z;
+
+	memset(grid->voxels + x * slab, VOXEL_GRASS, slab);
+}
+
+void voxel_grid_fill_solid(voxel_grid *grid)
+{
+	parallel_for(grid->size_x, fill_solid_slab, grid);
+}
+
+/* Whether any voxel of the brick with its lowest corner at (x, y, z) is solid. */
+static int32_t brick_occupied(const voxel_grid *grid, int32_t x, int32_t y, int32_t z)
+{
+	int32_t x1 = x + BRICK_SIZE < grid->size_x ? x + BRICK_SIZE : grid->size_x;
+	int32_t y1 = y + BRICK_SIZE < grid->size_y ? y + BRICK_SIZE : grid->size_y;
+	int32_t z1 = z + BRICK_SIZE < grid->size_z ? z + BRICK_SIZE : grid->size_z;
+	int32_t i, j, k;
+
+	for (i = x; i < x1; i++)
+		for (j = y; j < y1; j++)
+			for (k = z; k < z1; k++)
+				if (voxel_grid_get(grid, i, j, k))
+					return 1;
+
+	return 0;
+}
+
+static void build_chunk_occupancy(void *context, uint32_t chunk)
+{
+	voxel_grid *grid = context;
+	int32_t cx, cy, cz, x, y, z;
+	uint64_t mask = 0;
+
+	voxel_grid_chunk_coords(grid, chunk, &cx, &cy, &cz);
+
+	for (x = cx * CHUNK_SIZE; x < (cx + 1) * CHUNK_SIZE && x < grid->size_x; x += BRICK_SIZE)
+		for (y = cy * CHUNK_SIZE; y < (cy + 1) * CHUNK_SIZE && y < grid->size_y; y += BRICK_SIZE)
+			for (z = cz * CHUNK_SIZE; z < (cz + 1) * CHUNK_SIZE && z < grid->size_z; z += BRICK_SIZE)
+				if (brick_occupied(grid, x, y, z))
+					mask |= (uint64_t) 1 << voxel_grid_brick_bit(x, y, z);
+
+	grid->brick_masks[chunk] = mask;
+}
+
+void voxel_grid_build_occupancy(voxel_grid *grid)
+{
+	parallel_for(voxel_grid_num_chunks(grid), build_chunk_occupancy, grid);
+}
+
+void voxel_grid_update_occupancy(voxel_grid *grid, int32_t x, int32_t y, int32_t z)
+{
+	uint64_t *mask = &grid->brick_masks[voxel_grid_chunk_index(grid,
+		x / CHUNK_SIZE, y / CHUNK_SIZE, z / CHUNK_SIZE)];
+	uint64_t bit = (uint64_t) 1 << voxel_grid_brick_bit(x, y, z);
+
+	if (brick_occupied(grid, x - x % BRICK_SIZE, y - y % BRICK_SIZE, z - z % BRICK_SIZE))
+		*mask |= bit;
+	else
+		*mask &= ~bit;
+}
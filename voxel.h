@@ -0,0 +1,90 @@
+#ifndef VOXEL_H
+#define VOXEL_H
+
+#include <stdint.h>
+
+/* Edge length of the cubic chunks the grid is split into for meshing. */
+#define CHUNK_SIZE 16
+
+/*
+ * Chunks are further split into 4x4x4 bricks of 4x4x4 voxels, so a chunk's
+ * brick occupancy fits in one 64-bit mask. A clear bit means the brick is
+ * empty; a chunk with a zero mask is empty.
+ */
+#define BRICK_SIZE 4
+#define BRICKS_PER_CHUNK (CHUNK_SIZE / BRICK_SIZE)
+
+/* Voxel values. Zero is empty space, anything else is solid. */
+#define VOXEL_EMPTY 0
+#define VOXEL_GRASS 1
+#define VOXEL_DIRT 2
+#define VOXEL_STONE 3
+#define VOXEL_LAMP 4	/* Gives off light; see light.h. */
+
+/*
+ * A three-dimensional grid of uniformly-spaced voxels. A value of zero is
+ * empty space, anything else is solid. Storage is x-major, so
+ * voxels[(x * size_y + y) * size_z + z] is the voxel at (x, y, z).
+ */
+typedef struct
+{
+	int32_t size_x, size_y, size_z;
+	int32_t chunks_x, chunks_y, chunks_z;
+	uint8_t *voxels;
+	uint64_t *brick_masks;
+} voxel_grid;
+
+voxel_grid *voxel_grid_new(int32_t size_x, int32_t size_y, int32_t size_z);
+void voxel_grid_free(voxel_grid *grid);
+
+static inline uint8_t voxel_grid_get(const voxel_grid *grid, int32_t x, int32_t y, int32_t z)
+{
+	return grid->voxels[((int64_t) x * grid->size_y + y) * grid->size_z + z];
+}
+
+static inline void voxel_grid_set(voxel_grid *grid, int32_t x, int32_t y, int32_t z, uint8_t value)
+{
+	grid->voxels[((int64_t) x * grid->size_y + y) * grid->size_z + z] = value;
+}
+
+static inline uint32_t voxel_grid_num_chunks(const voxel_grid *grid)
+{
+	return grid->chunks_x * grid->chunks_y * grid->chunks_z;
+}
+
+/* Convert a chunk index in [0, voxel_grid_num_chunks) to chunk coordinates. */
+static inline void voxel_grid_chunk_coords(const voxel_grid *grid, uint32_t chunk,
+	int32_t *cx, int32_t *cy, int32_t *cz)
+{
+	*cz = chunk % grid->chunks_z;
+	*cy = (chunk / grid->chunks_z) % grid->chunks_y;
+	*cx = chunk / (grid->chunks_z * grid->chunks_y);
+}
+
+static inline uint32_t voxel_grid_chunk_index(const voxel_grid *grid, int32_t cx, int32_t cy, int32_t cz)
+{
+	return (cx * grid->chunks_y + cy) * grid->chunks_z + cz;
+}
+
+static inline uint32_t voxel_grid_brick_bit(int32_t x, int32_t y, int32_t z)
+{
+	return ((x % CHUNK_SIZE / BRICK_SIZE) * BRICKS_PER_CHUNK + y % CHUNK_SIZE / BRICK_SIZE)
+		* BRICKS_PER_CHUNK + z % CHUNK_SIZE / BRICK_SIZE;
+}
+
+/* The brick mask of the chunk holding voxel (x, y, z). */
+static inline uint64_t voxel_grid_chunk_mask(const voxel_grid *grid, int32_t x, int32_t y, int32_t z)
+{
+	return grid->brick_masks[voxel_grid_chunk_index(grid, x / CHUNK_SIZE, y / CHUNK_SIZE, z / CHUNK_SIZE)];
+}
+
+/* Set every voxel to VOXEL_GRASS, one x slab per worker. */
+void voxel_grid_fill_solid(voxel_grid *grid);
+
+/* Recompute every chunk's brick mask after the voxels were filled in. */
+void voxel_grid_build_occupancy(voxel_grid *grid);
+
+/* Bring the brick mask up to date after voxel (x, y, z) was changed. */
+void voxel_grid_update_occupancy(voxel_grid *grid, int32_t x, int32_t y, int32_t z);
+
+#endif